@@ -28,7 +28,12 @@
 
 #pragma link C++ class pueo::GeomTool-;
 #pragma link C++ class pueo::RawEvent+;
+#pragma link C++ class pueo::EventSummary+;
 #pragma link C++ class pueo::Dataset+;
+#pragma link C++ enum pueo::FetchWhat;
+#pragma link C++ class pueo::EventBundle-;
+#pragma link C++ class pueo::EventFuture-;
+#pragma link C++ class pueo::DatasetFetcher-;
 #pragma link C++ class pueo::TruthEvent+;
 #pragma link C++ class pueo::UsefulEvent+;
 #pragma link C++ class pueo::RawHeader+;
@@ -40,11 +45,19 @@
 #pragma link C++ class pueo::nav::SunSensor+;
 #pragma link C++ class pueo::nav::SunSensors+;
 
+#pragma link C++ namespace pueo::hsk;
 #pragma link C++ class pueo::hsk::Sensor+;
+#pragma link C++ class pueo::hsk::SensorInfo+;
+#pragma link C++ class pueo::hsk::Reading+;
+#pragma link C++ class pueo::hsk::SensorDictionary-;
 #pragma link C++ class pueo::daqhsk::DaqHsk+;
 #pragma link C++ class pueo::daqhsk::Surf+;
 #pragma link C++ class pueo::daqhsk::Beam+;
 #pragma link C++ class pueo::Timemark+;
+#pragma link C++ namespace pueo::timing;
+#pragma link C++ struct pueo::timing::TimeTableRow+;
+#pragma link C++ class pueo::timing::TimeTable-;
+#pragma link C++ class pueo::CachedWebFile-;
 
 #pragma read \
   targetClass = "pueo::RawEvent"\
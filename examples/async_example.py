@@ -0,0 +1,37 @@
+#! /usr/bin/env python3 
+# Async fetch example 
+# Reads the next event in the background while working on this one.
+# This assumes you have the environmental PUEO_ROOT_DATA pointing somewhere reasonable
+
+import ROOT
+import sys
+import numpy as np
+
+run = 813 
+nevents = 100
+
+if len(sys.argv) > 1: 
+    run = int(sys.argv[1])
+if len(sys.argv) > 2: 
+    nevents = int(sys.argv[2])
+
+ROOT.gSystem.Load("libpueoEvent.so") # assume in LD_LIBRARY_PATH (or DYLD_LIBRARY_PATH if you're using a mac for some reason) 
+
+pueo = ROOT.pueo # shortcut
+d = pueo.Dataset(run)
+d.setAsyncFetch(2, 4) # 2 I/O threads, at most 4 events on their way
+
+nevents = min(nevents, d.N())
+chan = pueo.GeomTool.Instance().getChanIndexFromRingPhiPol(pueo.ring.ring_t.kTopRing, 10, pueo.pol.pol_t.kVertical)
+
+f = d.fetchAsync(0)
+for entry in range(nevents): 
+    # ask for the next one before working on this one 
+    next_f = d.fetchAsync(entry + 1) if entry + 1 < nevents else None
+
+    b = f.get() # waits for it, None if it couldn't be loaded
+    if b:
+        v = np.array(b.useful().volts[chan])
+        print("event %d: rms %.3f V" % (b.header().eventNumber, v.std()))
+
+    f = next_f
@@ -3,6 +3,9 @@
 # This generates the header file containing file info
 #  Since this information is almost static, let's just compile it into the program rather than having go find some other file and parse it
 #  For a future flight you'll probably have to update a few variables down below
+#
+#  Superseded by pueo-run-catalog, which writes a runcatalog.dat that's picked up at runtime
+#  (see pueo/RunCatalog.h). The generated header is still compiled in as the fallback for flight 1.
 
 import ROOT
 import os
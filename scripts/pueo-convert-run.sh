@@ -2,6 +2,7 @@
 
 if [ "$#" -lt 3 ]; then
   echo "Usage:  pueo-convert-run rawdir rootdir run"
+  echo "        (with PUEO_CONVERT_SUMMARY=1 in the environment, also writes the summaryFile)"
   exit 1;
 fi
 
@@ -15,3 +16,8 @@ mkdir -p $OUTDIR
 
 pueo-convert header $OUTDIR/headFile$RUN.root $INDIR/  "$EXTRA_ARG"
 pueo-convert event $OUTDIR/eventFile$RUN.root $INDIR/ "$EXTRA_ARG"
+
+# another pass over the waveforms, so only if asked for (pueo-summarize can make it from the eventFile later)
+if [ -n "$PUEO_CONVERT_SUMMARY" ]; then
+  pueo-convert summary $OUTDIR/summaryFile$RUN.root $INDIR/ "$EXTRA_ARG"
+fi
@@ -1,21 +1,16 @@
 #!/bin/bash
 
 #SBATCH -A PAS2608
-#SBATCH -t 3:00:00
+#SBATCH -t 1:00:00
+#SBATCH --nodes=1
 #SBATCH --ntasks-per-node=1
+#SBATCH --cpus-per-task=48
 
-#SBATCH --output=/dev/null
-#SBATCH --error=/dev/null
-#normally one could use %a to store the output of task number `a`, but we are remapping task numbers.
+#SBATCH --output=/fs/scratch/PAS2608/jason/global_timing_calibration/time_tables.out
+#SBATCH --error=/fs/scratch/PAS2608/jason/global_timing_calibration/time_tables.err
 
 #SBATCH --mail-type=FAIL
 #SBATCH --mail-user=unmovingcastle
-  
-# A remap b/w run number and task id is needed because SLURM task id upper limit is 1000...
-run_number=$(( SLURM_ARRAY_TASK_ID + 700 ))
 
-# Have the standard output and standard error reflect the actual run number instead of task id
-exec > /fs/scratch/PAS2608/jason/global_timing_calibration/${run_number}.out
-exec 2>/fs/scratch/PAS2608/jason/global_timing_calibration/${run_number}.err
-
-time root -l -q "${PARENT_DIR}/macros/make_time_table.C(${run_number}, \"${TIMEMARK_ROOTFILE_PATH}\", \"${TIME_TABLE_PATH}\")"
+# every run in PUEO_ROOT_DATA, in one process sharing one copy of the timemarks
+time pueo-time-table -j ${SLURM_CPUS_PER_TASK} -o "${TIME_TABLE_PATH}" "${TIMEMARK_ROOTFILE_PATH}"
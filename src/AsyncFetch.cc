@@ -0,0 +1,228 @@
+/****************************************************************************************
+*  AsyncFetch.cc            Implementation of Dataset::fetchAsync's thread pool
+*
+*  (C) 2023-, The Payload for Ultrahigh Energy Observations (PUEO) Collaboration
+*
+*  This file is part of pueoEvent, the ROOT I/O library for PUEO.
+*
+*  pueoEvent is free software: you can redistribute it and/or modify it under the
+*  terms of the GNU General Public License as published by the Free Software
+*  Foundation, either version 2 of the License, or (at your option) any later
+*  version.
+*
+*  Foobar is distributed in the hope that it will be useful, but WITHOUT ANY
+*  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+*  A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+*
+*  You should have received a copy of the GNU General Public License along with
+*  Foobar. If not, see <https://www.gnu.org/licenses/
+*
+****************************************************************************************/
+
+#include "pueo/AsyncFetch.h"
+#include "pueo/Dataset.h"
+#include "pueo/RawHeader.h"
+#include "pueo/RawEvent.h"
+#include "pueo/UsefulEvent.h"
+#include "pueo/TruthEvent.h"
+#include "pueo/Nav.h"
+
+#include "TROOT.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+pueo::EventBundle::EventBundle() : fRun(-1), fEntry(-1) {}
+pueo::EventBundle::~EventBundle() {}
+
+struct pueo::EventFuture::State
+{
+  std::mutex m;
+  std::condition_variable cv;
+  bool done = false;
+  std::shared_ptr<const EventBundle> bundle; // null if it failed
+
+  void finish(std::shared_ptr<const EventBundle> b)
+  {
+    {
+      std::lock_guard<std::mutex> lock(m);
+      bundle = std::move(b);
+      done = true;
+    }
+    cv.notify_all();
+  }
+};
+
+bool pueo::EventFuture::ready() const
+{
+  if (!fState) return false;
+  std::lock_guard<std::mutex> lock(fState->m);
+  return fState->done;
+}
+
+bool pueo::EventFuture::wait(double timeout) const
+{
+  if (!fState) return false;
+  std::unique_lock<std::mutex> lock(fState->m);
+  if (timeout < 0) fState->cv.wait(lock, [this] { return fState->done; });
+  else fState->cv.wait_for(lock, std::chrono::duration<double>(timeout), [this] { return fState->done; });
+  return fState->done;
+}
+
+const pueo::EventBundle * pueo::EventFuture::get() const
+{
+  return share().get();
+}
+
+std::shared_ptr<const pueo::EventBundle> pueo::EventFuture::share() const
+{
+  if (!wait()) return nullptr;
+  return fState->bundle;
+}
+
+
+struct pueo::DatasetFetcher::Impl
+{
+  struct Request
+  {
+    int run;
+    Long64_t entry;
+    unsigned what;
+    std::shared_ptr<EventFuture::State> state;
+  };
+
+  std::function<Dataset*(int)> make;
+  int max_in_flight;
+
+  mutable std::mutex m;
+  std::condition_variable work;   // for the threads: a request or stop
+  std::condition_variable room;   // for fetch(): in_flight went down
+  std::deque<Request> queue;
+  int in_flight = 0;
+  bool stop = false;
+  std::vector<std::thread> threads;
+
+  void worker();
+  std::shared_ptr<const EventBundle> load(std::unique_ptr<Dataset> & d, const Request & r);
+};
+
+pueo::DatasetFetcher::DatasetFetcher(std::function<Dataset*(int)> make, int nthreads, int max_in_flight)
+  : fImpl(new Impl)
+{
+  ROOT::EnableThreadSafety();
+  fImpl->make = std::move(make);
+  fImpl->max_in_flight = std::max(1, max_in_flight);
+  for (int i = 0; i < std::max(1, nthreads); i++) fImpl->threads.emplace_back(&Impl::worker, fImpl.get());
+}
+
+pueo::DatasetFetcher::~DatasetFetcher()
+{
+  std::deque<Impl::Request> left;
+  {
+    std::lock_guard<std::mutex> lock(fImpl->m);
+    fImpl->stop = true;
+    left.swap(fImpl->queue);
+  }
+  fImpl->work.notify_all();
+  fImpl->room.notify_all();
+  for (auto & t : fImpl->threads) t.join();
+  for (auto & r : left) r.state->finish(nullptr);
+}
+
+pueo::EventFuture pueo::DatasetFetcher::fetch(int run, Long64_t entry, unsigned what)
+{
+  EventFuture f;
+  f.fState = std::make_shared<EventFuture::State>();
+
+  std::unique_lock<std::mutex> lock(fImpl->m);
+  fImpl->room.wait(lock, [this] { return fImpl->stop || fImpl->in_flight < fImpl->max_in_flight; });
+  if (fImpl->stop)
+  {
+    lock.unlock();
+    f.fState->finish(nullptr);
+    return f;
+  }
+  fImpl->queue.push_back(Impl::Request{run, entry, what | kFetchHeader, f.fState});
+  fImpl->in_flight++;
+  lock.unlock();
+  fImpl->work.notify_one();
+  return f;
+}
+
+int pueo::DatasetFetcher::inFlight() const
+{
+  std::lock_guard<std::mutex> lock(fImpl->m);
+  return fImpl->in_flight;
+}
+
+void pueo::DatasetFetcher::Impl::worker()
+{
+  // made when the first request comes in, and again when one is for another run
+  std::unique_ptr<Dataset> d;
+
+  while (true)
+  {
+    Request r;
+    {
+      std::unique_lock<std::mutex> lock(m);
+      work.wait(lock, [this] { return stop || !queue.empty(); });
+      if (stop) return;
+      r = std::move(queue.front());
+      queue.pop_front();
+    }
+
+    std::shared_ptr<const EventBundle> b;
+    try
+    {
+      b = load(d, r);
+    }
+    catch (std::exception & e)
+    {
+      std::cerr << "Fetching entry " << r.entry << " of run " << r.run << " failed: " << e.what() << std::endl;
+    }
+    r.state->finish(std::move(b));
+
+    {
+      std::lock_guard<std::mutex> lock(m);
+      in_flight--;
+    }
+    room.notify_one();
+  }
+}
+
+std::shared_ptr<const pueo::EventBundle> pueo::DatasetFetcher::Impl::load(std::unique_ptr<Dataset> & d, const Request & r)
+{
+  if (!d || d->getCurrRun() != r.run) d.reset(make(r.run));
+  if (!d || !d->fRunLoaded || r.entry < 0 || r.entry >= d->N()) return nullptr;
+
+  d->getEntry(r.entry);
+
+  std::shared_ptr<EventBundle> b = std::make_shared<EventBundle>();
+  b->fRun = r.run;
+  b->fEntry = r.entry;
+  b->fHeader.reset(new RawHeader(*d->header()));
+  if (r.what & kFetchRaw)
+  {
+    if (const RawEvent * ev = d->raw()) b->fRaw.reset(new RawEvent(*ev));
+  }
+  if (r.what & kFetchUseful)
+  {
+    if (const UsefulEvent * ev = d->useful()) b->fUseful.reset(new UsefulEvent(*ev));
+  }
+  if (r.what & kFetchGps)
+  {
+    if (const nav::Attitude * a = d->gps()) b->fGps.reset(new nav::Attitude(*a));
+  }
+  if (r.what & kFetchTruth)
+  {
+    if (const TruthEvent * t = d->truth()) b->fTruth.reset(new TruthEvent(*t));
+  }
+  return b;
+}
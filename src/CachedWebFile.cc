@@ -0,0 +1,325 @@
+/****************************************************************************************
+*  CachedWebFile.cc            Implementation of the PUEO web file block cache
+*
+*  (C) 2023-, The Payload for Ultrahigh Energy Observations (PUEO) Collaboration
+*
+*  This file is part of pueoEvent, the ROOT I/O library for PUEO.
+*
+*  pueoEvent is free software: you can redistribute it and/or modify it under the
+*  terms of the GNU General Public License as published by the Free Software
+*  Foundation, either version 2 of the License, or (at your option) any later
+*  version.
+*
+*  Foobar is distributed in the hope that it will be useful, but WITHOUT ANY
+*  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+*  A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+*
+*  You should have received a copy of the GNU General Public License along with
+*  Foobar. If not, see <https://www.gnu.org/licenses/
+*
+****************************************************************************************/
+
+#include "pueo/CachedWebFile.h"
+
+#include "TMD5.h"
+#include "TString.h"
+
+#include <algorithm>
+#include <vector>
+#include <map>
+#include <string>
+#include <mutex>
+#include <atomic>
+#include <cstring>
+#include <cstdlib>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+
+ClassImp(pueo::CachedWebFile);
+
+namespace
+{
+  std::mutex config_mutex;
+  bool configured = false;
+  std::string cache_dir;
+  size_t max_bytes = 0;
+  std::atomic<size_t> written_since_trim(0);
+
+  // the largest range we ask for in one piece
+  const Long64_t kMaxRange = 64 * pueo::CachedWebFile::kBlockSize;
+
+  // with config_mutex held
+  void configure()
+  {
+    if (configured) return;
+    configured = true;
+    if (const char * dir = getenv("PUEO_WEB_CACHE")) cache_dir = dir;
+    const char * mb = getenv("PUEO_WEB_CACHE_MB");
+    max_bytes = (mb ? strtoull(mb, 0, 10) : 10240) << 20;
+  }
+
+  bool readBlock(const std::string & path, Long64_t len, std::string * data)
+  {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat st;
+    bool ok = !fstat(fd, &st) && st.st_size == len;
+    if (ok)
+    {
+      data->resize(len);
+      Long64_t got = 0;
+      while (got < len)
+      {
+        ssize_t n = pread(fd, &(*data)[got], len - got, got);
+        if (n <= 0) break;
+        got += n;
+      }
+      ok = got == len;
+    }
+
+    // the modification time is what trim() goes by
+    if (ok) futimens(fd, nullptr);
+    close(fd);
+    return ok;
+  }
+
+  // best effort: a block that can't be written is just fetched again next time
+  void writeBlock(const std::string & path, const std::string & data)
+  {
+    std::string tmp = path + ".XXXXXX";
+    int fd = mkstemp(&tmp[0]);
+    if (fd < 0) return;
+
+    size_t put = 0;
+    while (put < data.size())
+    {
+      ssize_t n = write(fd, data.data() + put, data.size() - put);
+      if (n <= 0) break;
+      put += n;
+    }
+    fchmod(fd, 0644);
+    bool ok = !close(fd) && put == data.size();
+
+    // renamed into place, so other processes only ever see whole blocks
+    if (!ok || rename(tmp.c_str(), path.c_str()))
+    {
+      unlink(tmp.c_str());
+      return;
+    }
+
+    written_since_trim += data.size();
+    if (written_since_trim > max_bytes / 16)
+    {
+      written_since_trim = 0;
+      pueo::CachedWebFile::trim();
+    }
+  }
+}
+
+
+pueo::CachedWebFile::CachedWebFile(const char * url, Option_t * opt)
+  : TWebFile(url, opt)
+{
+  if (IsZombie() || !cacheDir()) return;
+
+  // the size stands in for a version of the file
+  TString id = TString::Format("%s\n%lld", GetEndpointUrl()->GetUrl(), GetSize());
+  TMD5 md5;
+  md5.Update((const UChar_t *) id.Data(), id.Length());
+  md5.Final();
+  fKey = md5.AsString();
+
+  std::string dir = std::string(cacheDir()) + "/" + fKey.substr(0,2);
+  mkdir(cacheDir(), 0777);
+  mkdir(dir.c_str(), 0777);
+}
+
+std::string pueo::CachedWebFile::blockPath(Long64_t block) const
+{
+  return std::string(cacheDir()) + "/" + fKey.substr(0,2) + "/" + fKey + "." + std::to_string(block);
+}
+
+Bool_t pueo::CachedWebFile::ReadBuffer(char * buf, Int_t len)
+{
+  if (fKey.empty()) return TWebFile::ReadBuffer(buf, len);
+
+  // the TTreeCache, if there is one, goes first
+  if (Int_t st = ReadBufferViaCache(buf, len)) return st == 2;
+
+  Long64_t pos = fOffset;
+  if (readCached(buf, &pos, &len, 1)) return kTRUE;
+  fOffset += len;
+  return kFALSE;
+}
+
+Bool_t pueo::CachedWebFile::ReadBuffers(char * buf, Long64_t * pos, Int_t * len, Int_t nbuf)
+{
+  if (fKey.empty()) return TWebFile::ReadBuffers(buf, pos, len, nbuf);
+  return readCached(buf, pos, len, nbuf);
+}
+
+Bool_t pueo::CachedWebFile::readCached(char * buf, const Long64_t * pos, const Int_t * len, Int_t nbuf)
+{
+  Long64_t size = GetSize();
+
+  std::vector<Long64_t> blocks;
+  for (Int_t i = 0; i < nbuf; i++)
+  {
+    if (len[i] <= 0) continue;
+    if (pos[i] < 0 || pos[i] + len[i] > size) return kTRUE;
+    for (Long64_t b = pos[i] / kBlockSize; b <= (pos[i] + len[i] - 1) / kBlockSize; b++) blocks.push_back(b);
+  }
+  std::sort(blocks.begin(), blocks.end());
+  blocks.erase(std::unique(blocks.begin(), blocks.end()), blocks.end());
+
+  std::map<Long64_t, std::string> data;
+  std::vector<Long64_t> missing;
+  for (Long64_t b : blocks)
+  {
+    Long64_t blen = std::min(kBlockSize, size - b * kBlockSize);
+    if (readBlock(blockPath(b), blen, &data[b])) fBlockHits++;
+    else missing.push_back(b);
+  }
+
+  if (missing.size())
+  {
+    // adjacent missing blocks are one range, and all the ranges go in one request
+    std::vector<Long64_t> rpos;
+    std::vector<Int_t> rlen;
+    Long64_t total = 0;
+    for (Long64_t b : missing)
+    {
+      Long64_t start = b * kBlockSize;
+      Long64_t blen = std::min(kBlockSize, size - start);
+      if (rpos.size() && rpos.back() + rlen.back() == start && rlen.back() + blen <= kMaxRange) rlen.back() += blen;
+      else
+      {
+        rpos.push_back(start);
+        rlen.push_back(blen);
+      }
+      total += blen;
+    }
+
+    std::vector<char> fetched(total);
+    if (TWebFile::ReadBuffers(fetched.data(), rpos.data(), rlen.data(), rpos.size())) return kTRUE;
+
+    // the ranges are back to back in fetched, in block order
+    Long64_t offset = 0;
+    for (Long64_t b : missing)
+    {
+      Long64_t blen = std::min(kBlockSize, size - b * kBlockSize);
+      data[b].assign(fetched.data() + offset, blen);
+      offset += blen;
+      writeBlock(blockPath(b), data[b]);
+      fBlockMisses++;
+    }
+  }
+
+  // a null buffer is just a prefetch
+  if (!buf) return kFALSE;
+
+  char * out = buf;
+  for (Int_t i = 0; i < nbuf; i++)
+  {
+    Long64_t p = pos[i];
+    Long64_t remaining = len[i];
+    while (remaining > 0)
+    {
+      const std::string & block = data[p / kBlockSize];
+      Long64_t in = p % kBlockSize;
+      Long64_t n = std::min<Long64_t>(remaining, block.size() - in);
+      memcpy(out, block.data() + in, n);
+      out += n;
+      p += n;
+      remaining -= n;
+    }
+  }
+
+  return kFALSE;
+}
+
+const char * pueo::CachedWebFile::cacheDir()
+{
+  std::lock_guard<std::mutex> lock(config_mutex);
+  configure();
+  return cache_dir.size() ? cache_dir.c_str() : nullptr;
+}
+
+void pueo::CachedWebFile::setCache(const char * dir, size_t max_mb)
+{
+  std::lock_guard<std::mutex> lock(config_mutex);
+  configure();
+  cache_dir = dir ? dir : "";
+  if (max_mb) max_bytes = max_mb << 20;
+}
+
+void pueo::CachedWebFile::trim()
+{
+  std::string dir;
+  size_t limit;
+  {
+    std::lock_guard<std::mutex> lock(config_mutex);
+    configure();
+    dir = cache_dir;
+    limit = max_bytes;
+  }
+  if (dir.empty()) return;
+
+  // one process trims at a time, the others just carry on
+  int lockfd = open((dir + "/.lock").c_str(), O_CREAT | O_RDWR, 0666);
+  if (lockfd < 0) return;
+  if (flock(lockfd, LOCK_EX | LOCK_NB))
+  {
+    close(lockfd);
+    return;
+  }
+
+  struct Block
+  {
+    time_t mtime;
+    off_t size;
+    std::string path;
+  };
+  std::vector<Block> all;
+  size_t total = 0;
+
+  if (DIR * top = opendir(dir.c_str()))
+  {
+    while (struct dirent * d = readdir(top))
+    {
+      if (d->d_name[0] == '.') continue;
+      std::string sub = dir + "/" + d->d_name;
+      DIR * subdir = opendir(sub.c_str());
+      if (!subdir) continue;
+      while (struct dirent * f = readdir(subdir))
+      {
+        if (f->d_name[0] == '.') continue;
+        std::string path = sub + "/" + f->d_name;
+        struct stat st;
+        if (stat(path.c_str(), &st)) continue;
+        all.push_back(Block { st.st_mtime, st.st_size, path });
+        total += st.st_size;
+      }
+      closedir(subdir);
+    }
+    closedir(top);
+  }
+
+  if (total > limit)
+  {
+    // leave some room, so we don't come straight back here
+    std::sort(all.begin(), all.end(), [](const Block & l, const Block & r) { return l.mtime < r.mtime; });
+    for (const Block & b : all)
+    {
+      if (total <= limit / 10 * 9) break;
+      if (!unlink(b.path.c_str())) total -= b.size;
+    }
+  }
+
+  flock(lockfd, LOCK_UN);
+  close(lockfd);
+}
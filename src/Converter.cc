@@ -26,15 +26,21 @@
 
 #include "pueo/Converter.h"
 #include "pueo/RawEvent.h"
+#include "pueo/EventSummary.h"
 #include "pueo/RawHeader.h"
 #include "pueo/Nav.h"
 #include "pueo/DaqHsk.h"
 #include "pueo/Hsk.h"
 #include "pueo/Timemark.h"
+#include "pueo/Timing.h"
+#include "pueo/RunFiles.h"
 
 
 #include "TFile.h"
 #include "TTree.h"
+#include "TBranch.h"
+#include "TDirectory.h"
+#include "TTreeFormula.h"
 
 #include <vector>
 #include <iostream>
@@ -48,6 +54,27 @@
 #include <stdint.h>
 #include <unistd.h>
 #include <unordered_map>
+#include <unordered_set>
+#include <deque>
+#include <memory>
+#include <string>
+#include <type_traits>
+
+#ifdef HAVE_RNTUPLE
+#include "TClass.h"
+#include "RVersion.h"
+#include <ROOT/RField.hxx>
+#include <ROOT/RNTupleModel.hxx>
+#include <ROOT/RNTupleWriter.hxx>
+#include <ROOT/RNTupleWriteOptions.hxx>
+
+// RNTuple moved out of ROOT::Experimental in 6.36
+#if ROOT_VERSION_CODE >= ROOT_VERSION(6,36,0)
+namespace rnt = ROOT;
+#else
+namespace rnt = ROOT::Experimental;
+#endif
+#endif
 
 
 
@@ -85,55 +112,584 @@ static const char * getTagFromRawName(const char* raw_name)
 
 
 
-template <typename RootType, typename RawType, int (*ReaderFn)(pueo_handle_t*, RawType*), pueo::convert::postprocess_fn PostProcess  = nullptr, bool Arity = false>
-static int converterImpl(size_t N, const char ** infiles,  const char * outfile, const pueo::convert::ConvertOpts & opts  )
+/* Things that should be written once per output file alongside the tree.
+ * The default does nothing, specialize for types that need it. */
+template <typename RootType>
+struct FileExtras
 {
+  void add(const RootType * R) { (void) R; }
+  void write(TDirectory * dir) { (void) dir; }
+};
 
-  std::string tmpfilename = outfile + std::string(opts.tmp_suffix);
-
-  TFile outf(tmpfilename.c_str(), "RECREATE");
-  outf.SetCompressionAlgorithm(opts.compression_algo);
-  outf.SetCompressionLevel(opts.compression_level);
-
-  if (!outf.IsOpen())
+/* The compact hsk format stores the sensor metadata once per file */
+template <>
+struct FileExtras<pueo::hsk::Reading>
+{
+  std::vector<bool> seen = std::vector<bool>(PUEO_MAX_SENSORS, false);
+  void add(const pueo::hsk::Reading * R) { seen[R->sensor_id] = true; }
+  void write(TDirectory * dir)
   {
-    std::cerr <<"Couldn't open temporary output file " << tmpfilename << std::endl;
-    return -1;
+    TDirectory::TContext ctx(dir);
+    TTree * dict = new TTree(pueo::hsk::SensorDictionary::tree_name, "sensor dictionary");
+    pueo::hsk::SensorInfo * info = new pueo::hsk::SensorInfo;
+    dict->Branch("sensor", &info);
+    for (size_t id = 0; id < seen.size(); id++)
+    {
+      if (!seen[id]) continue;
+      *info = pueo::hsk::SensorInfo(id);
+      dict->Fill();
+    }
+    dict->ResetBranchAddresses();
+    delete info;
   }
+};
 
-  const char * typetag = getName<RootType>();
-  const char * treename = getTreeName<RootType>();
 
-  Long64_t old_max_size = TTree::GetMaxTreeSize();
-  TTree::SetMaxTreeSize(1000000000000LL);
+/* Key used to find repeated packets when deduplicating. Specializations define
+ * key(), filling a 64-bit key and returning true, and describe() for the report.
+ * The default doesn't deduplicate. */
+template <typename RootType>
+struct DedupKey
+{
+  static bool key(const RootType & R, uint64_t * k) { (void) R; (void) k; return false; }
+  static std::string describe(const RootType & R) { (void) R; return ""; }
+};
+
+// splitmix64 finalizer, to combine fields into a key
+static inline uint64_t mix(uint64_t x)
+{
+  x += 0x9e3779b97f4a7c15ULL;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+static inline uint64_t nsecs(uint64_t secs, uint64_t ns) { return secs * 1000000000ULL + ns; }
+static inline uint64_t nsecs(const TTimeStamp & ts) { return nsecs(ts.GetSec(), ts.GetNanoSec()); }
+
+template <> struct DedupKey<pueo::RawEvent>
+{
+  static bool key(const pueo::RawEvent & R, uint64_t * k) { *k = ((uint64_t) R.runNumber << 32) | (uint32_t) R.eventNumber; return true; }
+  static std::string describe(const pueo::RawEvent & R) { return "run " + std::to_string(R.runNumber) + " event " + std::to_string(R.eventNumber); }
+};
+
+template <> struct DedupKey<pueo::EventSummary>
+{
+  static bool key(const pueo::EventSummary & R, uint64_t * k) { *k = ((uint64_t) R.run << 32) | R.eventNumber; return true; }
+  static std::string describe(const pueo::EventSummary & R) { return "run " + std::to_string(R.run) + " event " + std::to_string(R.eventNumber); }
+};
+
+template <> struct DedupKey<pueo::RawHeader>
+{
+  static bool key(const pueo::RawHeader & R, uint64_t * k) { *k = ((uint64_t) R.run << 32) | R.eventNumber; return true; }
+  static std::string describe(const pueo::RawHeader & R) { return "run " + std::to_string(R.run) + " event " + std::to_string(R.eventNumber); }
+};
+
+template <> struct DedupKey<pueo::nav::Attitude>
+{
+  static bool key(const pueo::nav::Attitude & R, uint64_t * k) { *k = mix(nsecs(R.readoutTime, R.readoutTimeNsecs) ^ mix(R.source)); return true; }
+  static std::string describe(const pueo::nav::Attitude & R) { return std::string("source ") + R.source + " readout " + std::to_string(R.readoutTime) + "." + std::to_string(R.readoutTimeNsecs); }
+};
+
+template <> struct DedupKey<pueo::nav::SunSensors>
+{
+  static bool key(const pueo::nav::SunSensors & R, uint64_t * k) { *k = mix(nsecs(R.readoutTime, R.readoutTimeNsecs) ^ mix(R.sequence_number)); return true; }
+  static std::string describe(const pueo::nav::SunSensors & R) { return "sequence " + std::to_string(R.sequence_number) + " readout " + std::to_string(R.readoutTime) + "." + std::to_string(R.readoutTimeNsecs); }
+};
+
+template <> struct DedupKey<pueo::hsk::Reading>
+{
+  static bool key(const pueo::hsk::Reading & R, uint64_t * k) { *k = ((uint64_t) R.sensor_id << 48) | ((uint64_t) R.time_secs << 10) | R.time_ms; return true; }
+  static std::string describe(const pueo::hsk::Reading & R) { return "sensor " + std::to_string(R.sensor_id) + " time " + std::to_string(R.time_secs) + "." + std::to_string(R.time_ms); }
+};
+
+template <> struct DedupKey<pueo::hsk::Sensor>
+{
+  static bool key(const pueo::hsk::Sensor & R, uint64_t * k) { *k = ((uint64_t) R.sensor_id << 48) | ((uint64_t) R.time_secs << 10) | R.time_ms; return true; }
+  static std::string describe(const pueo::hsk::Sensor & R) { return "sensor " + std::to_string(R.sensor_id) + " time " + std::to_string(R.time_secs) + "." + std::to_string(R.time_ms); }
+};
+
+template <> struct DedupKey<pueo::daqhsk::DaqHsk>
+{
+  static bool key(const pueo::daqhsk::DaqHsk & R, uint64_t * k) { *k = nsecs(R.l2_readout_time, R.l2_readout_timeNsecs); return true; }
+  static std::string describe(const pueo::daqhsk::DaqHsk & R) { return "l2 readout " + std::to_string(R.l2_readout_time) + "." + std::to_string(R.l2_readout_timeNsecs); }
+};
+
+template <> struct DedupKey<pueo::Timemark>
+{
+  static bool key(const pueo::Timemark & R, uint64_t * k) { *k = mix(nsecs(R.rising) ^ mix(R.channel)); return true; }
+  static std::string describe(const pueo::Timemark & R) { return "channel " + std::to_string(R.channel) + " rising " + R.rising.AsString("s"); }
+};
+
+
+/* Remembers the last `window` keys exactly (dropping the oldest first). Keys
+ * that fall out of the window go into a bloom filter, which is only used to
+ * count repeats we can no longer be sure about (those are kept). */
+class DedupFilter
+{
+  public:
+    DedupFilter(size_t window)
+      : window(window ? window : 1), bloom(std::max<size_t>(1 << 23, 16 * window), false)
+    {
+      seen.reserve(this->window);
+    }
+
+    // returns true if k was seen within the window
+    bool check(uint64_t k)
+    {
+      if (seen.count(k)) return true;
+
+      if (maybeInBloom(k)) possible_repeats++;
+
+      if (order.size() == window)
+      {
+        uint64_t oldest = order.front();
+        order.pop_front();
+        seen.erase(oldest);
+        addToBloom(oldest);
+      }
+      order.push_back(k);
+      seen.insert(k);
+      return false;
+    }
+
+    size_t possible_repeats = 0;
+
+  private:
+    size_t window;
+    std::unordered_set<uint64_t> seen;
+    std::deque<uint64_t> order;
+    std::vector<bool> bloom;
+
+    static constexpr int nhashes = 4;
+    size_t bit(uint64_t k, int i) const
+    {
+      uint64_t h1 = mix(k);
+      uint64_t h2 = mix(h1) | 1;
+      return (h1 + i * h2) % bloom.size();
+    }
+    void addToBloom(uint64_t k) { for (int i = 0; i < nhashes; i++) bloom[bit(k,i)] = true; }
+    bool maybeInBloom(uint64_t k) const
+    {
+      for (int i = 0; i < nhashes; i++) if (!bloom[bit(k,i)]) return false;
+      return true;
+    }
+};
+
+
+/* Creates the output tree with a branch for R, set up according to the storage profile of the type */
+template <typename RootType>
+static TTree * makeTree(const char * treename, const char * typetag, RootType ** R, const pueo::convert::ConvertOpts & opts)
+{
   TTree * t = new TTree(treename, treename);
   t->SetAutoSave(0);
-  RootType * R = new RootType();
-  t->Branch(typetag, &R);
-  RawType r;
 
-  int nprocessed = 0;
+  const pueo::convert::StorageProfile * prof = opts.use_storage_profiles ? pueo::convert::getStorageProfile(typetag) : nullptr;
+  if (!prof)
+  {
+    t->Branch(typetag, R);
+    return t;
+  }
+
+  t->Branch(typetag, R, prof->basket_size > 0 ? prof->basket_size : 32000, prof->split_level);
+  if (prof->auto_flush) t->SetAutoFlush(prof->auto_flush);
+
+  return t;
+}
+
+
+/* Drops repeats, see DedupKey and DedupFilter */
+template <typename RootType>
+class DedupStage : public pueo::convert::Stage<RootType>
+{
+  public:
+    DedupStage(const pueo::convert::ConvertOpts & opts)
+      : filter(opts.dedup_window)
+    {
+      // appending and line buffered, since with demux several writers share the report
+      if (opts.dedup_report && !(report = fopen(opts.dedup_report, "a")))
+      {
+        std::cerr << "Couldn't open dedup report " << opts.dedup_report << std::endl;
+      }
+      if (report) setvbuf(report, nullptr, _IOLBF, 0);
+    }
+
+    ~DedupStage() { if (report) fclose(report); }
+
+    const char * name() const override { return "dedup"; }
+    void beginFile(const char * infile) override { current_file = infile; }
+
+    bool process(RootType & R) override
+    {
+      uint64_t k;
+      nseen++;
+      if (!DedupKey<RootType>::key(R, &k) || !filter.check(k)) return true;
+
+      ndropped++;
+      if (report) fprintf(report, "%s\t%s\t%s\n", current_file, getName<RootType>(), DedupKey<RootType>::describe(R).c_str());
+      return false;
+    }
+
+    void replay(const RootType & R) override
+    {
+      uint64_t k;
+      nseen++;
+      if (DedupKey<RootType>::key(R, &k)) filter.check(k);
+    }
+
+    void finish() override
+    {
+      std::cout << "Dropped " << ndropped << " repeated " << getName<RootType>() << " of " << nseen;
+      if (filter.possible_repeats) std::cout << ", kept " << filter.possible_repeats << " possible repeats older than the dedup window";
+      std::cout << std::endl;
+    }
+
+  private:
+    DedupFilter filter;
+    FILE * report = nullptr;
+    const char * current_file = "";
+    size_t nseen = 0;
+    size_t ndropped = 0;
+};
+
+
+/* Corrects header trigger times with a time table as they're converted, so no
+ * separate pass over the header file is needed. The time table can be a file or a
+ * directory with run<N>/time_table.root, in which case it's picked by run. */
+class TimeCorrectionStage : public pueo::convert::Stage<pueo::RawHeader>
+{
+  public:
+    TimeCorrectionStage(const char * path) : path(path)
+    {
+      struct stat st;
+      is_dir = !stat(path, &st) && S_ISDIR(st.st_mode);
+      if (!is_dir) single.load(path);
+    }
+
+    const char * name() const override { return "time correction"; }
+
+    bool process(pueo::RawHeader & h) override
+    {
+      const pueo::timing::TimeTable * table = &single;
+      if (is_dir)
+      {
+        auto it = tables.find(h.run);
+        if (it == tables.end())
+        {
+          std::string file = path + "/run" + std::to_string(h.run) + "/time_table.root";
+          it = tables.emplace(h.run, pueo::timing::TimeTable()).first;
+          if (access(file.c_str(), R_OK) || !it->second.load(file.c_str()))
+          {
+            std::cerr << "No time table for run " << h.run << ", not correcting its trigger times" << std::endl;
+          }
+        }
+        table = &it->second;
+      }
+
+      if (table->correct(h)) ncorrected++;
+      else nuncorrected++;
+      return true;
+    }
+
+    void finish() override
+    {
+      std::cout << "Corrected trigger times of " << ncorrected << " headers";
+      if (nuncorrected) std::cout << ", " << nuncorrected << " had no time table entry";
+      std::cout << std::endl;
+    }
+
+  private:
+    std::string path;
+    bool is_dir = false;
+    pueo::timing::TimeTable single;
+    std::unordered_map<uint32_t, pueo::timing::TimeTable> tables;
+    size_t ncorrected = 0;
+    size_t nuncorrected = 0;
+};
+
+
+/* Fills in the run and event_number of timemarks, from the event whose trigger time is closest to the
+ * rising edge (see TimemarkIndex::match). That needs every timemark of the file, so it's a whole-tree
+ * stage: the match is done on the staged rising edges and applied on the final pass. The events come
+ * from a headFile or a directory of run<N>/headFile<N>.root, with corrected trigger times (e.g. converted
+ * with a time table). */
+class TimemarkEventStage : public pueo::convert::Stage<pueo::Timemark>
+{
+  public:
+    TimemarkEventStage(const char * path) : path(path) {}
+
+    const char * name() const override { return "timemark events"; }
+    bool wholeTree() const override { return true; }
+
+    bool prepare(const pueo::convert::StagedView & view) override
+    {
+      std::vector<double> sec = view.column("rising.fSec");
+      std::vector<double> nsec = view.column("rising.fNanoSec");
+      if (sec.size() != (size_t) view.size() || nsec.size() != sec.size()) return false;
+
+      std::vector<pueo::Timemark> marks(sec.size());
+      for (size_t i = 0; i < marks.size(); i++) marks[i].rising = TTimeStamp((time_t) sec[i], (Int_t) nsec[i]);
 
-  for (size_t i = 0; i < N; i++)
+      std::vector<pueo::timing::EventTime> events;
+      struct stat st;
+      if (!stat(path.c_str(), &st) && S_ISDIR(st.st_mode))
+      {
+        std::vector<int> runs;
+        pueo::runfiles::findRuns(path.c_str(), &runs);
+        for (int run : runs)
+        {
+          std::string file = path + "/run" + std::to_string(run) + "/headFile" + std::to_string(run) + ".root";
+          if (!access(file.c_str(), R_OK)) pueo::timing::loadEventTimes(file.c_str(), &events);
+        }
+      }
+      else if (pueo::timing::loadEventTimes(path.c_str(), &events))
+      {
+        return false;
+      }
+
+      if (events.empty())
+      {
+        std::cerr << "No events in " << path << " to assign timemarks to" << std::endl;
+        return false;
+      }
+
+      pueo::timing::TimemarkIndex index(marks);
+      index.match(std::move(events));
+      for (const auto & m : index.marks())
+      {
+        if (m.run || m.event_number) matches[toNs(m.rising)] = std::make_pair(m.run, m.event_number);
+      }
+      return true;
+    }
+
+    bool process(pueo::Timemark & m) override
+    {
+      auto it = matches.find(toNs(m.rising));
+      if (it == matches.end())
+      {
+        nunmatched++;
+        return true;
+      }
+      m.run = it->second.first;
+      m.event_number = it->second.second;
+      nmatched++;
+      return true;
+    }
+
+    void finish() override
+    {
+      std::cout << "Assigned events to " << nmatched << " timemarks";
+      if (nunmatched) std::cout << ", " << nunmatched << " had no event near them";
+      std::cout << std::endl;
+    }
+
+  private:
+    static int64_t toNs(const TTimeStamp & t) { return (int64_t) t.GetSec() * 1000000000LL + t.GetNanoSec(); }
+
+    std::string path;
+    std::unordered_map<int64_t, std::pair<uint32_t, uint32_t>> matches; // rising edge in ns -> (run, event)
+    size_t nmatched = 0;
+    size_t nunmatched = 0;
+};
+
+
+/* The stages to run for a type, in order. Specialize to add type-specific stages. */
+template <typename RootType>
+static void addTypeStages(std::vector<std::unique_ptr<pueo::convert::Stage<RootType>>> & stages, const pueo::convert::ConvertOpts & opts)
+{
+  (void) stages;
+  (void) opts;
+}
+
+template <>
+void addTypeStages<pueo::RawHeader>(std::vector<std::unique_ptr<pueo::convert::Stage<pueo::RawHeader>>> & stages, const pueo::convert::ConvertOpts & opts)
+{
+  if (opts.time_table) stages.emplace_back(new TimeCorrectionStage(opts.time_table));
+}
+
+template <>
+void addTypeStages<pueo::Timemark>(std::vector<std::unique_ptr<pueo::convert::Stage<pueo::Timemark>>> & stages, const pueo::convert::ConvertOpts & opts)
+{
+  if (opts.timemark_events) stages.emplace_back(new TimemarkEventStage(opts.timemark_events));
+}
+
+template <typename RootType>
+static void makeStages(std::vector<std::unique_ptr<pueo::convert::Stage<RootType>>> & stages, const pueo::convert::ConvertOpts & opts)
+{
+  if (opts.dedup)
   {
-    pueo_handle_t h;
-    std::cout << "Processing file " << infiles[i] << std::endl;
-    pueo_handle_init(&h, infiles[i], "r");
+    uint64_t k;
+    RootType R;
+    if (DedupKey<RootType>::key(R, &k)) stages.emplace_back(new DedupStage<RootType>(opts));
+    else std::cerr << "No deduplication key defined for " << getName<RootType>() << ", not deduplicating" << std::endl;
+  }
+  addTypeStages<RootType>(stages, opts);
+}
 
 
-    while (ReaderFn(&h, &r) > 0)
+/* Output side of a conversion, so that we can feed several of them from one pass over the input */
+class TreeWriterBase
+{
+  public:
+    virtual ~TreeWriterBase() {}
+    /* Decodes a packet of the writer's raw type and adds it */
+    virtual void addPacket(const pueo_packet_t * p, const char * infile) = 0;
+    /* Finishes the output file, returning the number of things processed or -1 on failure */
+    virtual int finish() = 0;
+};
+
+
+template <typename RootType, typename RawType, pueo::convert::postprocess_fn PostProcess  = nullptr, bool Arity = false,
+          int (*PacketFn)(const pueo_packet_t*, RawType*) = nullptr>
+class TreeWriter : public TreeWriterBase
+{
+  public:
+    TreeWriter(const char * outfile, const pueo::convert::ConvertOpts & opts)
+      : outfile(outfile), tmpfilename(outfile + std::string(opts.tmp_suffix)), opts(opts)
+    {
+    }
+
+    ~TreeWriter()
+    {
+      if (R) ::operator delete(R);
+    }
+
+    /* Opens the temporary output file and sets up the tree and stages, returns false on failure */
+    bool open()
     {
+      TDirectory::TContext ctx; // the tree goes in our file, but don't leave gDirectory there
+      outf.reset(new TFile(tmpfilename.c_str(), "RECREATE"));
+      outf->SetCompressionAlgorithm(opts.compression_algo);
+      outf->SetCompressionLevel(opts.compression_level);
+
+      if (!outf->IsOpen())
+      {
+        std::cerr <<"Couldn't open temporary output file " << tmpfilename << std::endl;
+        return false;
+      }
+
+      R = new RootType();
+      t = makeTree(treename, typetag, &R, opts);
+
+      makeStages(stages, opts);
+      for (const auto & stage : stages)
+      {
+        if (stage->wholeTree()) deferred = true;
+      }
+      return true;
+    }
+
+    /* Reopens the temporary output at its last checkpoint instead of starting a new one, returns false
+     * (having done nothing) if there isn't a usable checkpoint for these inputs. On success, ifile and
+     * nitems are where in the input to continue from: the file index and how many raw items of it to skip.
+     */
+    bool resume(size_t nfiles, const char ** infiles, size_t * ifile, size_t * nitems)
+    {
+      FILE * f = fopen(ckptname.c_str(), "r");
+      if (!f)
+      {
+        std::cerr << "No checkpoint " << ckptname << ", starting from the beginning" << std::endl;
+        return false;
+      }
+
+      // one line per checkpoint, written before the tree is saved, so the one to use is the last one matching the saved tree
+      struct Record { long long entries; int processed; size_t ifile; size_t nitems; std::string infile; };
+      std::vector<Record> records;
+      char path[4096];
+      Record rec;
+      while (fscanf(f, "%lld %d %zu %zu %4095[^\n]", &rec.entries, &rec.processed, &rec.ifile, &rec.nitems, path) == 5)
+      {
+        rec.infile = path;
+        records.push_back(rec);
+      }
+      fclose(f);
+
+      TDirectory::TContext ctx;
+      std::unique_ptr<TFile> f_tmp(new TFile(tmpfilename.c_str(), "UPDATE"));
+      TTree * t_tmp = f_tmp->IsOpen() ? f_tmp->Get<TTree>(treename) : nullptr;
+      if (!t_tmp)
+      {
+        std::cerr << "No " << treename << " in " << tmpfilename << ", can't resume" << std::endl;
+        return false;
+      }
+
+      auto it = std::find_if(records.rbegin(), records.rend(), [&](const Record & r) { return r.entries == t_tmp->GetEntries(); });
+      if (it == records.rend())
+      {
+        std::cerr << "No checkpoint in " << ckptname << " matches the " << t_tmp->GetEntries() << " entries in " << tmpfilename << ", can't resume" << std::endl;
+        return false;
+      }
+      if (it->ifile >= nfiles || it->infile != infiles[it->ifile])
+      {
+        std::cerr << "Checkpoint was taken in " << it->infile << ", which isn't input " << it->ifile << " any more, can't resume" << std::endl;
+        return false;
+      }
+
+      outf = std::move(f_tmp);
+      outf->SetCompressionAlgorithm(opts.compression_algo);
+      outf->SetCompressionLevel(opts.compression_level);
+      t = t_tmp;
+      R = new RootType();
+      t->SetBranchAddress(typetag, &R);
+
+      makeStages(stages, opts);
+      for (const auto & stage : stages)
+      {
+        if (stage->wholeTree()) deferred = true;
+      }
+
+      // what's already written gets replayed so stages (e.g. the dedup filter) and extras pick up where they were
+      bool replay = !stages.empty() || !std::is_empty<FileExtras<RootType>>::value;
+      for (Long64_t i = 0; replay && i < t->GetEntries(); i++)
+      {
+        t->GetEntry(i);
+        if (!deferred)
+        {
+          for (const auto & stage : stages) stage->replay(*R);
+        }
+        extras.add(R);
+      }
+
+      nprocessed = it->processed;
+      *ifile = it->ifile;
+      *nitems = it->nitems;
+      std::cout << "Resuming " << tmpfilename << " at " << t->GetEntries() << " entries, after " << it->nitems << " items of " << it->infile << std::endl;
+      return true;
+    }
+
+    /* Saves the tree so far and records where in the input we are (nitems items of infiles[ifile]), see resume() */
+    void checkpoint(size_t ifile, const char * infile, size_t nitems)
+    {
+      FILE * f = fopen(ckptname.c_str(), "a");
+      if (!f)
+      {
+        std::cerr << "Couldn't write checkpoint " << ckptname << std::endl;
+        return;
+      }
+      fprintf(f, "%lld %d %zu %zu %s\n", (long long) t->GetEntries(), nprocessed, ifile, nitems, infile);
+      fflush(f);
+      fsync(fileno(f));
+      fclose(f);
+
+      TDirectory::TContext ctx;
+      t->AutoSave("SaveSelf;FlushBaskets");
+    }
+
+    /* Converts one raw item (which may be more than one ROOT item) and adds it */
+    void add(const RawType * r, const char * infile)
+    {
+      beginFile(infile);
       if constexpr (Arity)
       {
-        int num_items = pueo::convert::arity(&r);
+        int num_items = pueo::convert::arity(r);
         for (int j = 0; j < num_items; j++)
         {
           nprocessed++;
           R->~RootType();
           try
           {
-            R = new (R) RootType(&r, j);
-            t->Fill();
+            R = new (R) RootType(r, j);
+            fill();
           }
           catch (const char * f)
           {
@@ -149,8 +705,8 @@ static int converterImpl(size_t N, const char ** infiles,  const char * outfile,
         R->~RootType();
         try
         {
-          R = new (R) RootType(&r);
-          t->Fill();
+          R = new (R) RootType(r);
+          fill();
         }
         catch (const char * f)
         {
@@ -158,104 +714,390 @@ static int converterImpl(size_t N, const char ** infiles,  const char * outfile,
         }
       }
     }
-    pueo_handle_close(&h);
-  }
 
-  bool out_of_sorts = false;
-  std::vector<std::pair<size_t,double>> sorted;
+    /* Adds an already converted item (for post-processing existing files) */
+    void addConverted(const RootType & item, const char * infile)
+    {
+      beginFile(infile);
+      nprocessed++;
+      *R = item;
+      fill();
+    }
 
-  if (opts.sort_by)
-  {
-    //see if we are sorted or not
+    void addPacket(const pueo_packet_t * p, const char * infile) override
+    {
+      if constexpr (PacketFn != nullptr)
+      {
+        if (!r) r.reset(new RawType);
+        if (PacketFn(p, r.get()) >= 0) add(r.get(), infile);
+        else std::cerr << "Failed to decode " << typetag << " packet in " << infile << std::endl;
+      }
+      else
+      {
+        (void) p;
+        (void) infile;
+      }
+    }
 
-    size_t N = t->Draw(opts.sort_by,"","goff");
-    for (size_t i = 1; i < N; i++)
+    int finish() override
     {
-      if (t->GetV1()[i] < t->GetV1()[i-1]) 
+      pueo::convert::StagedView view(t);
+      bool failed = false;
+
+      for (const auto & stage : stages)
+      {
+        if (stage->wholeTree() && !stage->prepare(view))
+        {
+          std::cerr << "  stage " << stage->name() << " failed to prepare" << std::endl;
+          failed = true;
+        }
+      }
+
+      bool out_of_sorts = false;
+      std::vector<std::pair<Long64_t,double>> sorted;
+
+      if (opts.sort_by && !failed)
       {
-        out_of_sorts = true;
-        break;
+        //see if we are sorted or not
+        std::vector<double> key = view.column(opts.sort_by);
+        for (size_t i = 1; i < key.size(); i++)
+        {
+          if (key[i] < key[i-1]) 
+          {
+            out_of_sorts = true;
+            break;
+          }
+
+        }
+
+        if (out_of_sorts)
+        {
+          sorted.resize(key.size());
+
+          for (size_t i = 0; i < key.size(); i++)
+          {
+            sorted[i].first = i;
+            sorted[i].second = key[i];
+          }
+
+          std::stable_sort(sorted.begin(), sorted.end(),
+              [](const auto & l, const auto & r) { return l.second < r.second; });
+
+        }
+
       }
 
+
+      // the tree we just wrote is used as a staging area if we need to sort it, run whole-tree stages or write it out as an RNTuple
+      bool resort = opts.sort_by && out_of_sorts;
+      bool rewrite = resort || deferred || opts.rntuple;
+
+      if (!rewrite) extras.write(outf.get());
+      outf->Write();
+
+      if (rewrite && !failed)
+      {
+        TFile fsorted(tmpfilename.c_str(),"RECREATE"); //will overwrite original temp file, but it will still exist until we close outf
+
+        fsorted.SetCompressionAlgorithm(opts.compression_algo);
+        fsorted.SetCompressionLevel(opts.compression_level);
+        beginFile(tmpfilename.c_str());
+
+        if (opts.rntuple)
+        {
+          std::vector<Long64_t> order;
+          for (size_t i = 0; i < sorted.size(); i++) order.push_back(sorted[i].first);
+          auto filter = [this](void * obj) { return !deferred || runStages(*(RootType*) obj); };
+          failed = pueo::convert::treeToRNTuple(t, typetag, treename, &fsorted, opts, resort ? &order : nullptr, filter) < 0;
+        }
+        else
+        {
+          TTree * t_sorted = makeTree(treename, typetag, &R, opts);
+          Long64_t n = resort ? (Long64_t) sorted.size() : t->GetEntries();
+          for (Long64_t i = 0; i < n; i++)
+          {
+            t->GetEntry(resort ? sorted[i].first : i);
+            if (deferred && !runStages(*R)) continue;
+            t_sorted->Fill();
+          }
+        }
+        extras.write(&fsorted);
+
+        outf->Close();
+        fsorted.Write();
+        fsorted.Close();
+      }
+      else
+      {
+        outf->Close();
+      }
+
+      for (const auto & stage : stages) stage->finish();
+
+      if (failed)
+      {
+        std::cerr << "  failed writing " << typetag << " output, removing temp file" << std::endl;
+        unlink(tmpfilename.c_str());
+        unlink(ckptname.c_str());
+        return -1;
+      }
+      unlink(ckptname.c_str());
+
+      if (PostProcess != nullptr)
+      {
+        if (!PostProcess(tmpfilename.c_str(), outfile.c_str(), opts.postprocess_args))
+        {
+          unlink(tmpfilename.c_str());
+        }
+        else
+        {
+          std::cerr << "  postprocesser for " << typetag << "  didn't return 0, leaving stray temp file" << std::endl;
+          return -1;
+        }
+      }
+      else
+      {
+        if (rename(tmpfilename.c_str(), outfile.c_str()))
+        {
+          std::cerr << " rename returned non-zero " << std::endl;
+          return -1;
+        }
+      }
+
+      return nprocessed;
     }
 
-    if (out_of_sorts)
+  private:
+    void beginFile(const char * infile)
     {
-      sorted.resize(N);
+      if (infile == current_file) return;
+      current_file = infile;
+      for (const auto & stage : stages) stage->beginFile(infile);
+    }
 
-      for (size_t i = 0; i < N; i++)
+    // returns false if a stage dropped R
+    bool runStages(RootType & item)
+    {
+      for (const auto & stage : stages)
       {
-        sorted[i].first = i;
-        sorted[i].second = t->GetV1()[i];
+        if (!stage->process(item)) return false;
       }
+      return true;
+    }
 
-      std::sort(sorted.begin(), sorted.end(),
-          [](const auto & l, const auto & r) { return l.second < r.second; });
-
+    // fills the tree with R, running the streaming stages first unless they're deferred to the final pass
+    void fill()
+    {
+      if (!deferred && !runStages(*R)) return;
+      t->Fill();
+      extras.add(R);
     }
 
-  }
+    std::string outfile;
+    std::string tmpfilename;
+    std::string ckptname = tmpfilename + ".ckpt";
+    const pueo::convert::ConvertOpts & opts;
+    const char * typetag = getName<RootType>();
+    const char * treename = getTreeName<RootType>();
 
+    std::unique_ptr<TFile> outf;
+    TTree * t = nullptr;
+    RootType * R = nullptr;
+    std::unique_ptr<RawType> r; // only used for packets
+    FileExtras<RootType> extras;
 
-  outf.Write();
+    std::vector<std::unique_ptr<pueo::convert::Stage<RootType>>> stages;
+    bool deferred = false; // if there are whole-tree stages, all stages run on the final pass
+    const char * current_file = nullptr;
 
-  if (opts.sort_by && out_of_sorts)
+    int nprocessed = 0;
+};
+
+
+/* Truncates the dedup report, if any, since the writers append to it */
+static void resetDedupReport(const pueo::convert::ConvertOpts & opts)
+{
+  if (!opts.dedup || !opts.dedup_report) return;
+  if (FILE * f = fopen(opts.dedup_report, "w")) fclose(f);
+}
+
+
+/* Converting needs a bigger max tree size than the default, restored afterwards */
+struct MaxTreeSizeGuard
+{
+  Long64_t old_max_size = TTree::GetMaxTreeSize();
+  MaxTreeSizeGuard() { TTree::SetMaxTreeSize(1000000000000LL); }
+  ~MaxTreeSizeGuard() { TTree::SetMaxTreeSize(old_max_size); }
+};
+
+
+template <typename RootType, typename RawType, int (*ReaderFn)(pueo_handle_t*, RawType*), pueo::convert::postprocess_fn PostProcess  = nullptr, bool Arity = false>
+static int converterImpl(size_t N, const char ** infiles,  const char * outfile, const pueo::convert::ConvertOpts & opts  )
+{
+  MaxTreeSizeGuard guard;
+
+  // big raw types (full_waveforms) don't belong on the stack
+  std::unique_ptr<TreeWriter<RootType, RawType, PostProcess, Arity>> writer(new TreeWriter<RootType, RawType, PostProcess, Arity>(outfile, opts));
+
+  size_t first_file = 0;
+  size_t skip = 0;
+  if (!opts.resume || !writer->resume(N, infiles, &first_file, &skip))
   {
-    TFile fsorted(tmpfilename.c_str(),"RECREATE"); //will overwrite original temp file, but it will still exist until we close outf
+    resetDedupReport(opts);
+    if (!writer->open()) return -1;
+  }
 
-    fsorted.SetCompressionAlgorithm(opts.compression_algo);
-    fsorted.SetCompressionLevel(opts.compression_level);
-    TTree * t_sorted = new TTree(treename, treename);
-    t_sorted->SetAutoSave(0);
-    t_sorted->Branch(typetag, &R);
-    for (size_t i = 0; i < sorted.size(); i++)
+  std::unique_ptr<RawType> r(new RawType);
+  size_t since_checkpoint = 0;
+
+  for (size_t i = first_file; i < N; i++)
+  {
+    pueo_handle_t h;
+    std::cout << "Processing file " << infiles[i] << std::endl;
+    pueo_handle_init(&h, infiles[i], "r");
+
+    // the handle can't seek, so items already converted before a checkpoint are read again and skipped
+    size_t nitems = 0;
+    while (ReaderFn(&h, r.get()) > 0)
+    {
+      if (nitems++ < skip) continue;
+      writer->add(r.get(), infiles[i]);
+
+      if (opts.checkpoint_every && ++since_checkpoint >= opts.checkpoint_every)
+      {
+        writer->checkpoint(i, infiles[i], nitems);
+        since_checkpoint = 0;
+      }
+    }
+    if (nitems < skip)
     {
-      t->GetEntry(sorted[i].first);
-      t_sorted->Fill();
+      std::cerr << infiles[i] << " has fewer items (" << nitems << ") than were converted before the checkpoint (" << skip << "), did it change?" << std::endl;
     }
+    skip = 0;
+    pueo_handle_close(&h);
+  }
+
+  return writer->finish();
+}
 
-    outf.Close();
-    fsorted.Write();
-    fsorted.Close();
+
+int pueo::convert::convertFilesDemux(int nfiles, const char ** infiles, const char * outdir, const ConvertOpts & opts)
+{
+  if (nfiles == 0 || !infiles || !outdir)
+  {
+    return 0;
   }
-  else
+
+  std::vector<std::string> tags;
+  std::string taglist = opts.demux_tags ? opts.demux_tags : "";
+  for (size_t pos = 0; pos <= taglist.size(); )
   {
-    outf.Close();
+    size_t comma = taglist.find(',', pos);
+    if (comma == std::string::npos) comma = taglist.size();
+    if (comma > pos) tags.push_back(taglist.substr(pos, comma - pos));
+    pos = comma + 1;
   }
 
-  ::operator delete(R);
+  if (!tags.size())
+  {
+    std::cerr << "No typetags to demultiplex into" << std::endl;
+    return -1;
+  }
 
-  if (PostProcess != nullptr)
+  if (opts.resume || opts.checkpoint_every)
   {
-    if (!PostProcess(tmpfilename.c_str(), outfile, opts.postprocess_args))
+    std::cerr << "Checkpointing isn't supported when demultiplexing, the conversion will start over if interrupted" << std::endl;
+  }
+
+  MaxTreeSizeGuard guard;
+  resetDedupReport(opts);
+  mkdir(outdir, 0755);
+
+  // writers indexed by packet type, there may be more than one per packet type (e.g. event and header)
+  std::unordered_map<int, std::vector<TreeWriterBase*>> writers;
+  std::vector<std::unique_ptr<TreeWriterBase>> all;
+
+  for (const auto & tag : tags)
+  {
+    std::string out = std::string(outdir) + "/" + tag + ".root";
+    if (!opts.clobber && !access(out.c_str(),F_OK))
     {
-      unlink(tmpfilename.c_str());
+      std::cerr << out << " already exists and we didn't enable clobber" <<std::endl;
+      return -1;
     }
-    else
+
+    const char * raw_name = nullptr;
+    TreeWriterBase * w = nullptr;
+#define DEMUX_WRITER(TAG, RAW, ROOT, POST, ARITY)\
+    if (tag == #TAG)\
+    {\
+      auto tw = new TreeWriter<ROOT, pueo_##RAW##_t, POST, ARITY, pueo_read_packet_##RAW>(out.c_str(), opts);\
+      w = tw;\
+      raw_name = #RAW;\
+      if (!tw->open()) { delete tw; return -1; }\
+    }
+    PUEO_CONVERTIBLE_TYPES(DEMUX_WRITER)
+
+    if (!w)
     {
-      std::cerr << "  postprocesser for " << getName<RootType>() << "  didn't return 0, leaving stray temp file" << std::endl;
+      std::cerr <<"Unhandled typetag \"" << tag << "\"" << std::endl;
       return -1;
     }
+    all.emplace_back(w);
+
+#define DEMUX_REGISTER(TYPE, NAME)\
+    if (!strcmp(raw_name, #NAME)) writers[TYPE].push_back(w);
+    PUEO_IO_DISPATCH_TABLE(DEMUX_REGISTER)
   }
-  else
+
+  std::unordered_map<int, size_t> skipped;
+  pueo_packet_t * packet = NULL;
+  for (int i = 0; i < nfiles; i++)
   {
-    if (rename(tmpfilename.c_str(), outfile))
+    pueo_handle_t h;
+    std::cout << "Processing file " << infiles[i] << std::endl;
+    pueo_handle_init(&h, infiles[i], "r");
+
+    while (pueo_ll_read_realloc(&h, &packet) > 0)
     {
-      std::cerr << " rename returned non-zero " << std::endl;
-      return -1;
+      auto it = writers.find(packet->head.type);
+      if (it == writers.end())
+      {
+        skipped[packet->head.type]++;
+        continue;
+      }
+      for (TreeWriterBase * w : it->second) w->addPacket(packet, infiles[i]);
     }
+    pueo_handle_close(&h);
   }
+  free(packet);
 
-  //restore
-  TTree::SetMaxTreeSize(old_max_size);
+  for (const auto & sk : skipped)
+  {
+    std::cout << "Skipped " << sk.second << " packets of type " << sk.first << " (not in the demux typetags)" << std::endl;
+  }
 
-  return nprocessed;
+  int nprocessed = 0;
+  bool failed = false;
+  for (auto & w : all)
+  {
+    int n = w->finish();
+    if (n < 0) failed = true;
+    else nprocessed += n;
+  }
+
+  return failed ? -1 : nprocessed;
 }
 
 
 int pueo::convert::convertFiles(const char * typetag, int nfiles, const char ** infiles,  const char * outfile, const ConvertOpts & opts)
 {
 
+  if (typetag && !strcmp(typetag, tags::demux))
+  {
+    return convertFilesDemux(nfiles, infiles, outfile, opts);
+  }
+
   if (!opts.clobber && !access(outfile,F_OK))
   {
     std::cerr << outfile << " already exists and we didn't enable clobber" <<std::endl;
@@ -317,6 +1159,71 @@ int pueo::convert::convertFiles(const char * typetag, int nfiles, const char **
 }
 
 
+/* Runs an already converted file through a TreeWriter, so it gets the same stages (and sorting) as a conversion */
+template <typename RootType, typename RawType>
+static int postprocessFile(const char * infile, const char * outfile, const pueo::convert::ConvertOpts & opts)
+{
+  MaxTreeSizeGuard guard;
+  resetDedupReport(opts);
+
+  const char * typetag = getName<RootType>();
+  std::unique_ptr<TFile> f(TFile::Open(infile));
+  TTree * t = f ? f->Get<TTree>(getTreeName<RootType>()) : nullptr;
+  if (!t)
+  {
+    std::cerr << "No " << getTreeName<RootType>() << " in " << infile << std::endl;
+    return -1;
+  }
+
+  std::unique_ptr<TreeWriter<RootType, RawType>> writer(new TreeWriter<RootType, RawType>(outfile, opts));
+  if (!writer->open()) return -1;
+
+  RootType * R = nullptr;
+  t->SetBranchAddress(typetag, &R);
+  for (Long64_t i = 0; i < t->GetEntries(); i++)
+  {
+    t->GetEntry(i);
+    writer->addConverted(*R, infile);
+  }
+  t->ResetBranchAddresses();
+  delete R;
+
+  return writer->finish() < 0 ? -1 : 0;
+}
+
+
+int pueo::convert::postprocess_headers(const char * infile, const char * outfile, const char * args)
+{
+  ConvertOpts opts;
+  opts.clobber = true;
+  opts.time_table = args;
+  if (!args)
+  {
+    std::cerr << "postprocess_headers needs a time table" << std::endl;
+    return -1;
+  }
+  return postprocessFile<pueo::RawHeader, pueo_full_waveforms_t>(infile, outfile, opts);
+}
+
+int pueo::convert::postprocess_attitudes(const char * infile, const char * outfile, const char * args)
+{
+  ConvertOpts opts;
+  opts.clobber = true;
+  opts.dedup = true;
+  opts.sort_by = args ? args : "readoutTime+1e-9*readoutTimeNsecs";
+  return postprocessFile<pueo::nav::Attitude, pueo_nav_att_t>(infile, outfile, opts);
+}
+
+int pueo::convert::postprocess_hsks(const char * infile, const char * outfile, const char * args)
+{
+  ConvertOpts opts;
+  opts.clobber = true;
+  opts.dedup = true;
+  opts.sort_by = args ? args : "time_secs+1e-3*time_ms";
+  return postprocessFile<pueo::hsk::Sensor, pueo_sensors_disk_t>(infile, outfile, opts);
+}
+
+
 #else
 
 int pueo::convert::convertFiles(const char * typetag, int nfiles, const char ** infiles,  const char * outfile, const ConvertOpts & opts)
@@ -331,8 +1238,158 @@ int pueo::convert::convertFiles(const char * typetag, int nfiles, const char **
 }
 
 
+int pueo::convert::convertFilesDemux(int nfiles, const char ** infiles, const char * outdir, const ConvertOpts & opts)
+{
+  (void) nfiles;
+  (void) infiles;
+  (void) outdir;
+  (void) opts;
+  std::cerr << "You need to compile with libpueorawdata support to convert files. Sorry." << std::endl;
+  return -1;
+}
+
+
+
+#define POSTPROCESS_STUB(NAME)\
+int pueo::convert::NAME(const char * infile, const char * outfile, const char * args)\
+{\
+  (void) infile;\
+  (void) outfile;\
+  (void) args;\
+  std::cerr << "You need to compile with libpueorawdata support to post-process files. Sorry." << std::endl;\
+  return -1;\
+}
+
+POSTPROCESS_STUB(postprocess_headers)
+POSTPROCESS_STUB(postprocess_attitudes)
+POSTPROCESS_STUB(postprocess_hsks)
+
+
+#endif
+
+#ifdef HAVE_RNTUPLE
+
+Long64_t pueo::convert::treeToRNTuple(TTree * t, const char * branch, const char * ntuple_name, TDirectory * dir,
+                                      const ConvertOpts & opts, const std::vector<Long64_t> * order,
+                                      const std::function<bool(void*)> & filter)
+{
+  TBranch * b = t ? t->GetBranch(branch) : nullptr;
+  if (!b || !dir)
+  {
+    std::cerr << "No branch " << branch << " to write to an RNTuple" << std::endl;
+    return -1;
+  }
+
+  TClass * cl = nullptr;
+  EDataType dt;
+  b->GetExpectedType(cl, dt);
+  if (!cl)
+  {
+    std::cerr << "Branch " << branch << " doesn't hold an object, can't write it to an RNTuple" << std::endl;
+    return -1;
+  }
+
+  void * obj = cl->New();
+  t->SetBranchAddress(branch, &obj, nullptr, cl, kOther_t, true);
+
+  Long64_t n = order ? (Long64_t) order->size() : t->GetEntries();
+  Long64_t nwritten = 0;
+  try
+  {
+    auto model = rnt::RNTupleModel::CreateBare();
+    model->AddField(rnt::RFieldBase::Create(branch, cl->GetName()).Unwrap());
+
+    rnt::RNTupleWriteOptions wopts;
+    wopts.SetCompression(opts.compression_algo, opts.compression_level);
+
+    auto writer = rnt::RNTupleWriter::Append(std::move(model), ntuple_name, *dir, wopts);
+    auto entry = writer->CreateEntry();
+    entry->BindRawPtr(branch, obj);
+
+    for (Long64_t i = 0; i < n; i++)
+    {
+      t->GetEntry(order ? (*order)[i] : i);
+      if (filter && !filter(obj)) continue;
+      writer->Fill(*entry);
+      nwritten++;
+    }
+    // the writer commits the dataset when it goes out of scope
+  }
+  catch (const std::exception & e)
+  {
+    std::cerr << "Failed writing RNTuple " << ntuple_name << ": " << e.what() << std::endl;
+    nwritten = -1;
+  }
+
+  t->ResetBranchAddress(b);
+  cl->Destructor(obj);
+  return nwritten;
+}
+
+#else
+
+Long64_t pueo::convert::treeToRNTuple(TTree * t, const char * branch, const char * ntuple_name, TDirectory * dir,
+                                      const ConvertOpts & opts, const std::vector<Long64_t> * order,
+                                      const std::function<bool(void*)> & filter)
+{
+  (void) t;
+  (void) branch;
+  (void) ntuple_name;
+  (void) dir;
+  (void) opts;
+  (void) order;
+  (void) filter;
+  std::cerr << "You need to compile against ROOT >= 6.34 to write RNTuples. Sorry." << std::endl;
+  return -1;
+}
+
 #endif
 
+std::vector<double> pueo::convert::StagedView::column(const char * expr) const
+{
+  std::vector<double> v;
+  if (!t) return v;
+
+  // TTree::Draw would stop at its estimate (1M entries by default), so evaluate it ourselves
+  TTreeFormula f("column", expr, t);
+  if (f.GetNdim() == 0)
+  {
+    std::cerr << "Couldn't evaluate " << expr << " on " << t->GetName() << std::endl;
+    return v;
+  }
+
+  v.reserve(t->GetEntries());
+  for (Long64_t i = 0; i < t->GetEntries(); i++)
+  {
+    t->LoadTree(i);
+    f.GetNdata();
+    v.push_back(f.EvalInstance());
+  }
+  return v;
+}
+
+Long64_t pueo::convert::StagedView::size() const
+{
+  return t ? t->GetEntries() : 0;
+}
+
+const pueo::convert::StorageProfile * pueo::convert::getStorageProfile(const char * typetag)
+{
+  static const StorageProfile profiles[] =
+  {
+#define PROFILE_ENTRY(TAG, BASKET, FLUSH, SPLIT)\
+    { #TAG, BASKET, FLUSH, SPLIT },
+    PUEO_STORAGE_PROFILES(PROFILE_ENTRY)
+  };
+
+  if (!typetag) return nullptr;
+  for (const auto & p : profiles)
+  {
+    if (!strcmp(p.tag, typetag)) return &p;
+  }
+  return nullptr;
+}
+
 static int convert_filter(const struct dirent * d)
 {
   return d->d_name[0]!='.';
@@ -35,10 +35,23 @@
 #include "pueo/RawHeader.h"
 #include "pueo/Nav.h"
 #include "pueo/TruthEvent.h" 
+#include "pueo/EventSummary.h"
 #include "pueo/Version.h" 
 #include "pueo/Conventions.h"
+#include "pueo/Timing.h"
+#include "pueo/RunCatalog.h"
+#include "pueo/CachedWebFile.h"
+#include "pueo/DatasetStats.h"
+#include "pueo/SharedEventCache.h"
 
 #include "TTreeIndex.h" 
+#include "TSystem.h"
+#include "TTreeCache.h"
+#include "TBranch.h"
+#include "TBasket.h"
+#include "TBuffer.h"
+#include "TBufferFile.h"
+#include "TUUID.h"
 #include <math.h>
 #include "TFile.h" 
 #include "TTree.h" 
@@ -56,15 +69,42 @@
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <memory>
+#include <limits>
+#include <chrono>
+#include <csignal>
+#include <mutex>
 
+#ifdef HAVE_RNTUPLE
+#include "RVersion.h"
+#include <ROOT/RNTuple.hxx>
+#include <ROOT/RNTupleReader.hxx>
+#include <ROOT/RNTupleView.hxx>
 
+// RNTuple moved out of ROOT::Experimental in 6.36
+#if ROOT_VERSION_CODE >= ROOT_VERSION(6,36,0)
+namespace rnt = ROOT;
+#else
+namespace rnt = ROOT::Experimental;
+#endif
 
-static TFile* fHiCalGpsFile[2];
-static TTree* fHiCalGpsTree[2];
-static Double_t fHiCalLon[2];
-static Double_t fHiCalLat[2];
-static Double_t fHiCalAlt[2];
-static Int_t fHiCalUnixTime[2];
+#endif
+
+
+
+// the HiCal tracks are read once into memory, and only read after that, so any number of Datasets can share them
+namespace
+{
+  struct HiCalPoint
+  {
+    Int_t unixTime;
+    Double_t longitude;
+    Double_t latitude;
+    Double_t altitude;
+  };
+}
+static std::vector<HiCalPoint> fHiCalTrack[2];
+static std::once_flag fHiCalLoaded[2];
 
 
 
@@ -74,30 +114,178 @@ static bool verbose = false;
 void pueo::Dataset::setVerboseOutput(bool v) { verbose = v; }
 
 
+#ifdef HAVE_RNTUPLE
+struct pueo::Dataset::NTupleSources
+{
+  std::unique_ptr<rnt::RNTupleReader> head;
+  std::unique_ptr<rnt::RNTupleReader> event;
+  std::unique_ptr<rnt::RNTupleReader> gps;
+  std::unique_ptr<rnt::REntry> head_entry;
+  std::unique_ptr<rnt::REntry> event_entry;
+  std::unique_ptr<rnt::REntry> gps_entry;
+  Long64_t head_loaded = -1;
+  Long64_t event_loaded = -1;
+  Long64_t gps_loaded = -1;
+  std::vector<std::pair<UInt_t, Long64_t>> by_event; // (eventNumber, entry) sorted, our equivalent of the TTreeIndex
+  std::vector<Long64_t> indices; // entries sorted by eventNumber, as TTreeIndex::GetIndex
+  std::vector<std::pair<ULong64_t, Long64_t>> gps_by_time; // (realTime in ns, entry) sorted, only when not using gpsEvent files
+};
+
+// returns a reader if there is an RNTuple called name in f
+static std::unique_ptr<rnt::RNTupleReader> openNTuple(TFile * f, const char * name)
+{
+  std::unique_ptr<ROOT::RNTuple> anchor(f->Get<ROOT::RNTuple>(name));
+  if (!anchor) return nullptr;
+  if (verbose) std::cout << "Using RNTuple " << name << " from " << f->GetName() << std::endl;
+  return rnt::RNTupleReader::Open(*anchor);
+}
+
+#else
+struct pueo::Dataset::NTupleSources {};
+#endif
+
+
+namespace
+{
+// Times something into a DatasetStats::Timer, if there is one (stats are on)
+struct StatsTimer
+{
+  pueo::DatasetStats::Timer * timer;
+  std::chrono::steady_clock::time_point start;
+
+  StatsTimer(pueo::DatasetStats::Timer * t) : timer(t)
+  {
+    if (timer) start = std::chrono::steady_clock::now();
+  }
+  ~StatsTimer()
+  {
+    if (timer) timer->add(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+  }
+};
+
+// The same for reading an entry, also counting the bytes read from the tree's file
+struct StatsRead : public StatsTimer
+{
+  pueo::DatasetStats::TreeStats * tree;
+  TFile * file = 0;
+  Long64_t bytes_before = 0;
+  Long64_t unzipped = 0; // set to what GetEntry returns
+
+  StatsRead(pueo::DatasetStats * stats, pueo::DatasetStats::Tree which, TTree * t)
+    : StatsTimer(stats ? &stats->trees[which].get_entry : 0), tree(stats ? &stats->trees[which] : 0)
+  {
+    if (!tree || !t) return;
+    file = t->GetCurrentFile();
+    if (file) bytes_before = file->GetBytesRead();
+  }
+  ~StatsRead()
+  {
+    if (!tree) return;
+    if (file) tree->bytes_read += file->GetBytesRead() - bytes_before;
+    tree->bytes_unzipped += unzipped > 0 ? unzipped : 0;
+  }
+};
+}
+
+static void buildIndex(pueo::DatasetStats * stats, TTree * t, const char * major, const char * minor = "0")
+{
+  StatsTimer timer(stats ? &stats->index_build : 0);
+  t->BuildIndex(major, minor);
+}
+
+// records in the shared event cache are the objects as streamed, which is a lot cheaper to read back than baskets to unzip
+template <class T>
+static bool shmLoad(pueo::SharedEventCache * cache, const pueo::SharedEventCache::Key & key, T *& obj)
+{
+  static thread_local std::vector<char> buf;
+  if (!cache->get(key, buf)) return false;
+  if (!obj) obj = new T;
+  TBufferFile b(TBuffer::kRead, buf.size(), buf.data(), kFALSE);
+  obj->Streamer(b);
+  return true;
+}
+
+template <class T>
+static void shmStore(pueo::SharedEventCache * cache, const pueo::SharedEventCache::Key & key, T * obj)
+{
+  if (!obj) return;
+  TBufferFile b(TBuffer::kWrite);
+  obj->Streamer(b);
+  cache->put(key, b.Buffer(), b.Length());
+}
+
+// what a tree's records are cached under: its file (by UUID, so a rewritten file is a different one) and the class layout
+static uint64_t shmFileKey(TTree * t, TClass * cl)
+{
+  TFile * f = t ? t->GetCurrentFile() : 0;
+  if (!f) return 0;
+  TString id = f->GetUUID().AsString();
+  return id.Hash() * 0x9e3779b97f4a7c15ULL + cl->GetCheckSum();
+}
+
+// bumped by each signal; every Dataset remembers the last one it printed its stats for
+static volatile sig_atomic_t stats_generation = 0;
+static void requestStats(int) { stats_generation = stats_generation + 1; }
+
+
+namespace
+{
+/* Quiets ROOT while a file that may well not exist is opened. gErrorIgnoreLevel is global, so it stays
+ * raised until the last thread doing this is done, rather than each one putting back what it saw. */
+struct QuietOpen
+{
+  static std::mutex m;
+  static int nquiet;
+  static int saved_level;
+
+  QuietOpen()
+  {
+    std::lock_guard<std::mutex> lock(m);
+    if (!nquiet++)
+    {
+      saved_level = gErrorIgnoreLevel;
+      gErrorIgnoreLevel = kFatal;
+    }
+  }
+  ~QuietOpen()
+  {
+    std::lock_guard<std::mutex> lock(m);
+    if (!--nquiet) gErrorIgnoreLevel = saved_level;
+  }
+};
+std::mutex QuietOpen::m;
+int QuietOpen::nquiet = 0;
+int QuietOpen::saved_level = 0;
+}
+
 static TFile * openIfAnyExist(int num, ...)
 {
 
   va_list args; 
   va_start(args, num); 
 
-  for (int i = 0; i < num; i++) 
+  TFile * opened = 0;
+  for (int i = 0; i < num && !opened; i++) 
   {
     const char * f = va_arg(args, const char *); 
 
-    int olderr = gErrorIgnoreLevel;
-    if (!verbose) gErrorIgnoreLevel = kFatal;
-    TFile * opened = TFile::Open(f);
-    gErrorIgnoreLevel = olderr;
-    
-    if (opened)
+    // local files we can just look for, which doesn't need ROOT quieted
+    if (!strstr(f, "://"))
     {
-      return opened; 
+      if (access(f, R_OK)) continue;
+      opened = TFile::Open(f);
+    }
+    else if (verbose) opened = TFile::Open(f);
+    else
+    {
+      QuietOpen quiet;
+      opened = TFile::Open(f);
     }
   }
 
   va_end(args); 
 
-  return 0; 
+  return opened; 
 }
 static TFile * openIfExists(const char * file)
 {
@@ -106,6 +294,14 @@ static TFile * openIfExists(const char * file)
 
 
 
+// TTreeCache sizes for each access mode, see setAccessMode
+static const Long64_t kInteractiveCacheSize = 4 << 20;
+static const Long64_t kSparseCacheSize = 16 << 20;
+static const Long64_t kMinSequentialCacheSize = 16 << 20;
+static const Long64_t kMaxSequentialCacheSize = 256 << 20;
+static const int kSequentialAfter = 16; // next()'s in a row before kAccessAuto considers it a loop
+static const Long64_t kMinCacheSize = 256 << 10; // below this a memory budget turns the cache off instead
+
 static const char  pueo_root_data_dir_env[]  = "PUEO_ROOT_DATA"; 
 static const char  pueo_versioned_root_data_dir_env[]  = "PUEO%d_ROOT_DATA"; 
 static const char  mc_root_data_dir[] = "PUEO_MC_DATA"; 
@@ -164,14 +360,28 @@ const char * pueo::Dataset::getDataDir(DataDirectory dir)
 
 pueo::Dataset::Dataset(int run,  DataDirectory version, bool decimated, BlindingStrategy strategy)
   : 
-  fHeadTree(0), fHeader(0), 
+  fRunLoaded(false), fNTuple(0),
+  fHeadTree(0), fDecimatedHeadTree(0), fHeader(0), 
   fEventTree(0), fRawEvent(0), fUsefulEvent(0), 
   fGpsTree(0), fGps(0), 
   fTruthTree(0), fTruth(0), 
-  fCutList(0), fRandy()
+  fSummaryTree(0), fSummary(0),
+  fDecimatedEvents(false), fCutList(0), fRandy(),
+  fUseTimeTables(getenv("PUEO_TIME_TABLES")), fTimeTable(0), fTimeTableRun(-1),
+  fAccessMode(kAccessAuto), fCacheMode(kAccessAuto), fCachePlaylist(false), fSequentialReads(0), fPrefetchList(0),
+  fStats(0), fDumpStats(false), fStatsGeneration(stats_generation), fMemoryBudget(0),
+  fShmCache(SharedEventCache::instance()), fShmHeadKey(0), fShmEventKey(0), fShmHeadEntry(-1), fShmEventEntry(-1),
+  fFetcher(0), fFetchThreads(2), fFetchMaxInFlight(8)
 {
   fHaveUsefulFile = false;
   setStrategy(strategy); 
+  const char * stats_env = getenv("PUEO_DATASET_STATS");
+  if (stats_env && atoi(stats_env))
+  {
+    enableStats();
+    fDumpStats = true;
+  }
+  if (const char * budget_env = getenv("PUEO_DATASET_MEMORY_MB")) fMemoryBudget = (size_t) atol(budget_env) << 20;
   currRun = run;
   loadRun(run, version, decimated); 
   loadedBlindTrees = false;
@@ -182,6 +392,18 @@ pueo::Dataset::Dataset(int run,  DataDirectory version, bool decimated, Blinding
 void  pueo::Dataset::unloadRun() 
 {
 
+  delete fNTuple;
+  fNTuple = 0;
+
+  delete fTimeTable;
+  fTimeTable = 0;
+  fTimeTableRun = -1;
+
+  if (verbose && fRunLoaded) printCacheStats(std::cout);
+  delete fPrefetchList;
+  fPrefetchList = 0;
+  fCacheMode = kAccessAuto;
+
   for (unsigned i = 0; i < filesToClose.size(); i++) 
   {
     if (verbose) std::cout << "Closing " << filesToClose[i]->GetName() << std::endl;
@@ -191,7 +413,11 @@ void  pueo::Dataset::unloadRun()
   fHeadTree = 0; 
   fDecimatedHeadTree = 0; 
   fEventTree = 0; 
+  fDecimatedEvents = false;
+  fShmHeadKey = 0;
+  fShmEventKey = 0;
   fGpsTree = 0; 
+  fSummaryTree = 0; 
   fRunLoaded = false;
   filesToClose.clear();
 
@@ -204,15 +430,204 @@ void  pueo::Dataset::unloadRun()
 }
 
 
-pueo::nav::Attitude * pueo::Dataset::gps(bool force_load)
+void pueo::Dataset::setupNTuples()
 {
+#ifdef HAVE_RNTUPLE
+  if (!fNTuple) return;
 
-  if (fHaveGpsEvent)
+  if (!fNTuple->head && !fNTuple->event && !fNTuple->gps)
+  {
+    delete fNTuple;
+    fNTuple = 0;
+    return;
+  }
+
+  if (fNTuple->head)
+  {
+    if (!fHeader) fHeader = new RawHeader;
+    fNTuple->head_entry = fNTuple->head->GetModel().CreateBareEntry();
+    fNTuple->head_entry->BindRawPtr("header", fHeader);
+
+    auto ev = fNTuple->head->GetView<std::uint32_t>("header.eventNumber");
+    fNTuple->by_event.reserve(fNTuple->head->GetNEntries());
+    for (auto i : fNTuple->head->GetEntryRange()) fNTuple->by_event.emplace_back(ev(i), i);
+    std::sort(fNTuple->by_event.begin(), fNTuple->by_event.end());
+    for (const auto & p : fNTuple->by_event) fNTuple->indices.push_back(p.second);
+    if (!fDecimated) fIndices = fNTuple->indices.data();
+  }
+
+  if (fNTuple->event)
+  {
+    fNTuple->event_entry = fNTuple->event->GetModel().CreateBareEntry();
+    if (fHaveUsefulFile)
+    {
+      if (!fUsefulEvent) fUsefulEvent = new UsefulEvent;
+      fNTuple->event_entry->BindRawPtr("event", fUsefulEvent);
+    }
+    else
+    {
+      if (!fRawEvent) fRawEvent = new RawEvent;
+      fNTuple->event_entry->BindRawPtr("event", fRawEvent);
+    }
+  }
+
+  if (fNTuple->gps)
+  {
+    if (!fGps) fGps = new nav::Attitude;
+    fNTuple->gps_entry = fNTuple->gps->GetModel().CreateBareEntry();
+    fNTuple->gps_entry->BindRawPtr("attitude", fGps);
+
+    if (!fHaveGpsEvent)
+    {
+      for (auto i : fNTuple->gps->GetEntryRange())
+      {
+        fNTuple->gps->LoadEntry(i, *fNTuple->gps_entry);
+        fNTuple->gps_by_time.emplace_back(fGps->realTime * 1000000000ULL + fGps->realTimeNsecs, i);
+      }
+      std::sort(fNTuple->gps_by_time.begin(), fNTuple->gps_by_time.end());
+    }
+  }
+#endif
+}
+
+Long64_t pueo::Dataset::headEntries() const
+{
+#ifdef HAVE_RNTUPLE
+  if (fNTuple && fNTuple->head) return fNTuple->head->GetNEntries();
+#endif
+  return fHeadTree ? fHeadTree->GetEntries() : 0;
+}
+
+Long64_t pueo::Dataset::headEntryWithEvent(UInt_t eventNumber) const
+{
+#ifdef HAVE_RNTUPLE
+  if (fNTuple && fNTuple->head)
+  {
+    auto it = std::lower_bound(fNTuple->by_event.begin(), fNTuple->by_event.end(), std::make_pair(eventNumber, (Long64_t) 0));
+    return it != fNTuple->by_event.end() && it->first == eventNumber ? it->second : -1;
+  }
+#endif
+  return fHeadTree->GetEntryNumberWithIndex(eventNumber);
+}
+
+void pueo::Dataset::loadHeadEntry(Long64_t entry, bool force)
+{
+#ifdef HAVE_RNTUPLE
+  if (fNTuple && fNTuple->head)
+  {
+    if (force || fNTuple->head_loaded != entry)
+    {
+      StatsRead read(fStats, DatasetStats::kHead, 0);
+      fNTuple->head->LoadEntry(entry, *fNTuple->head_entry);
+      fNTuple->head_loaded = entry;
+    }
+    return;
+  }
+#endif
+  if (fShmHeadKey)
   {
-    if (fGpsTree->GetReadEntry() != fWantedEntry || force_load) 
+    if (!force && fShmHeadEntry == entry) return;
+    fShmHeadEntry = entry;
+    if (shmLoad(fShmCache, SharedEventCache::Key{fShmHeadKey, entry, currRun, 0}, fHeader))
     {
-      fGpsTree->GetEntry(fWantedEntry);
+      if (fStats) fStats->trees[DatasetStats::kHead].shm_hits++;
+      return;
     }
+    force = true; // the tree may think it still has it
+  }
+
+  if (force || fHeadTree->GetReadEntry() != entry)
+  {
+    StatsRead read(fStats, DatasetStats::kHead, fHeadTree);
+    read.unzipped = fHeadTree->GetEntry(entry);
+    if (fShmHeadKey) shmStore(fShmCache, SharedEventCache::Key{fShmHeadKey, entry, currRun, 0}, fHeader);
+  }
+}
+
+bool pueo::Dataset::haveEvents() const
+{
+#ifdef HAVE_RNTUPLE
+  if (fNTuple && fNTuple->event) return true;
+#endif
+  return fEventTree;
+}
+
+// returns true if the entry was actually (re)read
+bool pueo::Dataset::loadEventEntry(Long64_t entry, bool force)
+{
+#ifdef HAVE_RNTUPLE
+  if (fNTuple && fNTuple->event)
+  {
+    if (!force && fNTuple->event_loaded == entry) return false;
+    StatsRead read(fStats, DatasetStats::kEvent, 0);
+    fNTuple->event->LoadEntry(entry, *fNTuple->event_entry);
+    fNTuple->event_loaded = entry;
+    return true;
+  }
+#endif
+  if (fShmEventKey)
+  {
+    if (!force && fShmEventEntry == entry) return false;
+    fShmEventEntry = entry;
+    if (shmLoad(fShmCache, SharedEventCache::Key{fShmEventKey, entry, currRun, 1}, fRawEvent))
+    {
+      if (fStats) fStats->trees[DatasetStats::kEvent].shm_hits++;
+      return true;
+    }
+    force = true;
+  }
+
+  if (!force && fEventTree->GetReadEntry() == entry) return false;
+  StatsRead read(fStats, DatasetStats::kEvent, fEventTree);
+  read.unzipped = fEventTree->GetEntry(entry);
+  if (fShmEventKey) shmStore(fShmCache, SharedEventCache::Key{fShmEventKey, entry, currRun, 1}, fRawEvent);
+  return true;
+}
+
+void pueo::Dataset::loadGpsEntry(Long64_t entry, bool force)
+{
+#ifdef HAVE_RNTUPLE
+  if (fNTuple && fNTuple->gps)
+  {
+    if (force || fNTuple->gps_loaded != entry)
+    {
+      StatsRead read(fStats, DatasetStats::kGps, 0);
+      fNTuple->gps->LoadEntry(entry, *fNTuple->gps_entry);
+      fNTuple->gps_loaded = entry;
+    }
+    return;
+  }
+#endif
+  if (force || fGpsTree->GetReadEntry() != entry)
+  {
+    StatsRead read(fStats, DatasetStats::kGps, fGpsTree);
+    read.unzipped = fGpsTree->GetEntry(entry);
+  }
+}
+
+// like TTree::GetEntryNumberWithBestIndex on the (realTime, realTimeNsecs) index
+Long64_t pueo::Dataset::gpsEntryAtTime(UInt_t sec, UInt_t nsec) const
+{
+#ifdef HAVE_RNTUPLE
+  if (fNTuple && fNTuple->gps)
+  {
+    ULong64_t t = sec * 1000000000ULL + nsec;
+    auto it = std::upper_bound(fNTuple->gps_by_time.begin(), fNTuple->gps_by_time.end(),
+                               std::make_pair(t, std::numeric_limits<Long64_t>::max()));
+    if (it == fNTuple->gps_by_time.begin()) return -1;
+    return (it-1)->second;
+  }
+#endif
+  return fGpsTree->GetEntryNumberWithBestIndex(sec, nsec);
+}
+
+
+pueo::nav::Attitude * pueo::Dataset::gps(bool force_load)
+{
+
+  if (fHaveGpsEvent)
+  {
+    loadGpsEntry(fWantedEntry, force_load);
   }
   else
   {
@@ -220,8 +635,8 @@ pueo::nav::Attitude * pueo::Dataset::gps(bool force_load)
     {
       //try one that matches realtime
       //TODO use the correct values once they're available
-      int gpsEntry = fGpsTree->GetEntryNumberWithBestIndex(header()->corrected_trigger_time.GetSec(), header()->corrected_trigger_time.GetNanoSec());
-      fGpsTree->GetEntry(gpsEntry);
+      int gpsEntry = gpsEntryAtTime(header()->corrected_trigger_time.GetSec(), header()->corrected_trigger_time.GetNanoSec());
+      loadGpsEntry(gpsEntry, true);
       fGpsDirty = false;
     }
   }
@@ -237,14 +652,17 @@ pueo::RawHeader * pueo::Dataset::header(bool force_load)
   {
     if (force_load)
     {
-      fDecimatedHeadTree->GetEntry(fDecimatedEntry); 
+      StatsRead read(fStats, DatasetStats::kHead, fDecimatedHeadTree);
+      read.unzipped = fDecimatedHeadTree->GetEntry(fDecimatedEntry); 
     }
   }
-  else if ((fHeadTree->GetReadEntry() != fWantedEntry || force_load)) 
+  else
   {
-    fHeadTree->GetEntry(fWantedEntry); 
+    loadHeadEntry(fWantedEntry, force_load);
   }
 
+  // computed from the uncorrected fields, so it doesn't matter if we already did this entry
+  if (const timing::TimeTable * table = timeTable()) table->correct(*fHeader);
 
 
   if(theStrat & kInsertedVPolEvents){
@@ -268,11 +686,8 @@ pueo::RawHeader * pueo::Dataset::header(bool force_load)
 
 pueo::RawEvent * pueo::Dataset::raw(bool force_load) 
 {
-  if (!fEventTree) return nullptr; 
-  if (fEventTree->GetReadEntry() != fWantedEntry || force_load) 
-  {
-    fEventTree->GetEntry(fWantedEntry); 
-  }
+  if (!haveEvents()) return nullptr; 
+  loadEventEntry(eventEntry(), force_load);
   return fHaveUsefulFile ? fUsefulEvent : 
               fRawEvent ? fRawEvent : fUsefulEvent; 
 }
@@ -281,12 +696,10 @@ pueo::RawEvent * pueo::Dataset::raw(bool force_load)
 pueo::UsefulEvent * pueo::Dataset::useful(bool force_load) 
 {
 
-  if (!fEventTree) return nullptr; 
+  if (!haveEvents()) return nullptr; 
 
-  if (fEventTree->GetReadEntry() != fWantedEntry || force_load) 
+  if (loadEventEntry(eventEntry(), force_load))
   {
-
-    fEventTree->GetEntry(fWantedEntry); 
     fUsefulDirty = fRawEvent; //if reading UsefulEvents, then no need to do anything
   }
   
@@ -297,8 +710,10 @@ pueo::UsefulEvent * pueo::Dataset::useful(bool force_load)
       fUsefulEvent = new UsefulEvent; 
     }
 
+    RawHeader * hdr = header();
+    StatsTimer timer(fStats ? &fStats->useful_build : 0);
     fUsefulEvent->~UsefulEvent();
-    new (fUsefulEvent) UsefulEvent(*fRawEvent, *header()); 
+    new (fUsefulEvent) UsefulEvent(*fRawEvent, *hdr); 
     fUsefulDirty = false; 
   }
 
@@ -349,23 +764,46 @@ Bool_t pueo::Dataset::maybeInvertPolarity(UInt_t eventNumber){
 
 int pueo::Dataset::getEntry(int entryNumber)
 {
+  int generation = stats_generation;
+  if (generation != fStatsGeneration && fStats)
+  {
+    fStatsGeneration = generation;
+    fStats->print(std::cerr);
+  }
 
   //invalidate the indices 
   fIndex = -1; 
   fCutIndex=-1; 
   
  
-  if (entryNumber < 0 || entryNumber >= (fDecimated ? fDecimatedHeadTree : fHeadTree)->GetEntries())
+  if (entryNumber < 0 || entryNumber >= (fDecimated ? fDecimatedHeadTree->GetEntries() : headEntries()))
   {
     fprintf(stderr,"Requested entry %d too big or small!\n", entryNumber); 
   }
   else
   {
+    // a loop over entries gets the big caches, anything else goes back to small ones
+    if (fAccessMode == kAccessAuto && (fCacheMode == kAccessInteractive || fCacheMode == kAccessSequential))
+    {
+      if (entryNumber == current() + 1)
+      {
+        if (++fSequentialReads == kSequentialAfter && fCacheMode == kAccessInteractive) setupCaches(kAccessSequential);
+      }
+      else if (entryNumber != current())
+      {
+        fSequentialReads = 0;
+        if (fCacheMode == kAccessSequential) setupCaches(kAccessInteractive);
+      }
+    }
+
     (fDecimated ? fDecimatedEntry : fWantedEntry) = entryNumber; 
     if (fDecimated)
     {
-      fDecimatedHeadTree->GetEntry(fDecimatedEntry); 
-      fWantedEntry = fHeadTree->GetEntryNumberWithIndex(fHeader->eventNumber); 
+      {
+        StatsRead read(fStats, DatasetStats::kHead, fDecimatedHeadTree);
+        read.unzipped = fDecimatedHeadTree->GetEntry(fDecimatedEntry); 
+      }
+      fWantedEntry = headEntryWithEvent(fHeader->eventNumber); 
 
     }
     if (!fHaveUsefulFile) fUsefulDirty = true; 
@@ -373,8 +811,10 @@ int pueo::Dataset::getEntry(int entryNumber)
   }
 
 
-  // use the header to set the PUEO version 
-  version::setVersionFromUnixTime(header()->corrected_trigger_time.GetSec()); 
+  // use the header to set the PUEO version, only writing it when it changes so concurrent Datasets don't keep writing it
+  unsigned t = header()->corrected_trigger_time.GetSec();
+  int v = version::getVersionFromUnixTime(t);
+  if (v <= 0 || v != version::get()) version::setVersionFromUnixTime(t); 
 
   return fDecimated ? fDecimatedEntry : fWantedEntry; 
 }
@@ -383,9 +823,10 @@ int pueo::Dataset::getEntry(int entryNumber)
 int pueo::Dataset::getEvent(int eventNumber, bool quiet)
 {
 
-  int entry  =  (fDecimated ? fDecimatedHeadTree : fHeadTree)->GetEntryNumberWithIndex(eventNumber); 
+  int entry  =  fDecimated ? fDecimatedHeadTree->GetEntryNumberWithIndex(eventNumber) : headEntryWithEvent(eventNumber); 
 
-  if (entry < 0 && (eventNumber < fHeadTree->GetMinimum("eventNumber") || eventNumber > fHeadTree->GetMaximum("eventNumber")))
+  if (entry < 0) fShmHeadEntry = -1; // GetMinimum and GetMaximum read through fHeader
+  if (entry < 0 && (!fHeadTree || eventNumber < fHeadTree->GetMinimum("eventNumber") || eventNumber > fHeadTree->GetMaximum("eventNumber")))
   {
       if (!quiet) fprintf(stderr,"WARNING: event %lld not found in header tree\n", fWantedEntry); 
       if (fDecimated) 
@@ -399,11 +840,347 @@ int pueo::Dataset::getEvent(int eventNumber, bool quiet)
   return fDecimated ? fDecimatedEntry : fWantedEntry; 
 }
   
+void pueo::Dataset::useTimeTables(bool use, const char * dir)
+{
+  // the I/O threads' Datasets should do the same
+  delete fFetcher;
+  fFetcher = 0;
+
+  fUseTimeTables = use;
+  fTimeTableDir = dir ? dir : "";
+
+  // look it up again next time
+  delete fTimeTable;
+  fTimeTable = 0;
+  fTimeTableRun = -1;
+}
+
+const pueo::timing::TimeTable * pueo::Dataset::timeTable()
+{
+  if (!fUseTimeTables) return 0;
+  if (fTimeTableRun == currRun) return fTimeTable;
+
+  fTimeTableRun = currRun;
+  delete fTimeTable;
+  fTimeTable = 0;
+
+  std::vector<TString> candidates;
+  if (fTimeTableDir != "") candidates.push_back(fTimeTableDir);
+  if (const char * env = getenv("PUEO_TIME_TABLES")) candidates.push_back(env);
+  candidates.push_back(getDataDir(datadir));
+
+  for (const TString & dir : candidates)
+  {
+    TString fname = TString::Format("%s/run%d/time_table.root", dir.Data(), currRun);
+    bool remote = fname.Contains("://");
+    if (!remote && access(fname.Data(), R_OK)) continue;
+
+    timing::TimeTable * table = new timing::TimeTable;
+    if (table->load(fname.Data()) && table->valid())
+    {
+      if (verbose) fprintf(stderr, "Using time table: %s\n", fname.Data());
+      fTimeTable = table;
+      return fTimeTable;
+    }
+    delete table;
+  }
+
+  if (verbose) fprintf(stderr, "No valid time table for run %d, using trigger times from the header file\n", currRun);
+  return 0;
+}
+
+// room for a couple of clusters, TTreeCache reads whole ones
+static Long64_t sequentialCacheSize(TTree * t)
+{
+  Long64_t entries = std::max<Long64_t>(1, t->GetEntries());
+  Long64_t cluster_entries = t->GetAutoFlush() > 0 ? std::min(t->GetAutoFlush(), entries) : entries;
+  Long64_t cluster_bytes = t->GetZipBytes() * cluster_entries / entries;
+  return std::min(kMaxSequentialCacheSize, std::max(kMinSequentialCacheSize, 2 * cluster_bytes));
+}
+
+void pueo::Dataset::setAccessMode(AccessMode mode)
+{
+  fAccessMode = mode;
+  fSequentialReads = 0;
+  setupCaches(mode == kAccessAuto ? kAccessInteractive : mode);
+}
+
+void pueo::Dataset::setupCaches(AccessMode mode, bool playlist)
+{
+  TTree * full[] = { fHeadTree, fEventTree, fHaveGpsEvent ? fGpsTree : 0 };
+  TTree * all[] = { fHeadTree, fDecimatedHeadTree, fEventTree, fGpsTree };
+
+  // TTreeCache only prefetches baskets with entries in the tree's event list
+  for (TTree * t : all)
+  {
+    if (t) t->SetEventList(0);
+  }
+  delete fPrefetchList;
+  fPrefetchList = 0;
+
+  fCacheMode = mode;
+  fCachePlaylist = false;
+
+  if (mode == kAccessSparse)
+  {
+    if (fCutList && !playlist)
+    {
+      // the cut is on the decimated tree if we're decimated, which has its own entries
+      if (fDecimated)
+      {
+        if (fDecimatedHeadTree) fDecimatedHeadTree->SetEventList(fCutList);
+        if (fDecimatedEvents) fEventTree->SetEventList(fCutList);
+      }
+      else
+      {
+        for (TTree * t : full) { if (t) t->SetEventList(fCutList); }
+      }
+    }
+    else if (fPlaylist.size() && headEntries())
+    {
+      fCachePlaylist = true;
+      fPrefetchList = new TEventList("pueoPrefetch", "playlist entries");
+      fPrefetchList->SetDirectory(0);
+      for (const auto & p : fPlaylist)
+      {
+        if (p.first != currRun) continue;
+        Long64_t entry = headEntryWithEvent(p.second);
+        if (entry >= 0) fPrefetchList->Enter(entry);
+      }
+      for (TTree * t : full) { if (t) t->SetEventList(fPrefetchList); }
+    }
+  }
+
+  Long64_t sizes[4] = {0};
+  Long64_t wanted = 0;
+  for (int i = 0; i < 4; i++)
+  {
+    if (!all[i]) continue;
+    sizes[i] = mode == kAccessSequential ? sequentialCacheSize(all[i]) :
+               mode == kAccessSparse ? kSparseCacheSize : kInteractiveCacheSize;
+    wanted += sizes[i];
+  }
+
+  // the caches get whatever room the budget leaves, shared in proportion
+  if (fMemoryBudget)
+  {
+    DatasetMemory mem = memoryUsage();
+    Long64_t room = (Long64_t) fMemoryBudget - (Long64_t) (mem.total() - mem.caches);
+    if (wanted > room)
+    {
+      double scale = room > 0 ? double(room) / wanted : 0;
+      for (Long64_t & size : sizes)
+      {
+        size *= scale;
+        if (size < kMinCacheSize) size = 0;
+      }
+      if (verbose) fprintf(stderr, "Memory budget of %zu bytes: caches shrunk to %.0f%% (run %d)\n", fMemoryBudget, 100 * scale, currRun);
+    }
+  }
+
+  for (int i = 0; i < 4; i++)
+  {
+    TTree * t = all[i];
+    if (!t) continue;
+    t->SetCacheSize(sizes[i]);
+    if (!sizes[i]) continue;
+    t->AddBranchToCache("*", kTRUE);
+    t->StopCacheLearningPhase();
+
+    // only read the baskets of the entries we miss, not all of them
+    if (TTreeCache * cache = t->GetReadCache(t->GetCurrentFile())) cache->SetOptimizeMisses(mode != kAccessSequential);
+  }
+}
+
+// the baskets a list of branches (and their sub-branches) have loaded right now
+static Long64_t basketBytes(TObjArray * branches)
+{
+  Long64_t bytes = 0;
+  for (int i = 0; i < branches->GetEntriesFast(); i++)
+  {
+    TBranch * b = (TBranch*) branches->UncheckedAt(i);
+    TObjArray * baskets = b->GetListOfBaskets();
+    for (int j = 0; j < baskets->GetEntriesFast(); j++)
+    {
+      TBasket * basket = (TBasket*) baskets->UncheckedAt(j);
+      if (basket && basket->GetBufferRef()) bytes += basket->GetBufferRef()->BufferSize();
+    }
+    bytes += basketBytes(b->GetListOfBranches());
+  }
+  return bytes;
+}
+
+pueo::DatasetMemory pueo::Dataset::memoryUsage() const
+{
+  DatasetMemory mem;
+
+  TTree * trees[] = { fHeadTree, fDecimatedHeadTree, fEventTree, fGpsTree, fTruthTree, fSummaryTree };
+  for (TTree * t : trees)
+  {
+    if (!t) continue;
+    mem.baskets += basketBytes(t->GetListOfBranches());
+    if (TTreeCache * cache = t->GetReadCache(t->GetCurrentFile())) mem.caches += cache->GetBufferSize();
+
+    // major and minor values plus the sorted entries
+    if (TTreeIndex * index = dynamic_cast<TTreeIndex*>(t->GetTreeIndex())) mem.indices += index->GetN() * 3 * sizeof(Long64_t);
+  }
+
+#ifdef HAVE_RNTUPLE
+  if (fNTuple)
+  {
+    mem.indices += fNTuple->by_event.capacity() * sizeof(fNTuple->by_event[0])
+                 + fNTuple->indices.capacity() * sizeof(fNTuple->indices[0])
+                 + fNTuple->gps_by_time.capacity() * sizeof(fNTuple->gps_by_time[0]);
+  }
+#endif
+  if (fTimeTable) mem.indices += fTimeTable->size() * (sizeof(timing::TimeTableRow) + 1);
+
+  if (fHeader) mem.events += sizeof(RawHeader);
+  if (fRawEvent) mem.events += sizeof(RawEvent);
+  if (fUsefulEvent) mem.events += sizeof(UsefulEvent);
+  if (fGps) mem.events += sizeof(nav::Attitude);
+  if (fTruth) mem.events += sizeof(TruthEvent);
+  if (fSummary) mem.events += sizeof(EventSummary);
+
+  if (fCutList) mem.cut_lists += fCutList->GetN() * sizeof(Long64_t);
+  if (fPrefetchList) mem.cut_lists += fPrefetchList->GetN() * sizeof(Long64_t);
+  mem.cut_lists += fPlaylist.capacity() * sizeof(fPlaylist[0]);
+
+  return mem;
+}
+
+void pueo::Dataset::setMemoryBudget(size_t bytes)
+{
+  fMemoryBudget = bytes;
+  if (fRunLoaded) setupCaches(fCacheMode, fCachePlaylist);
+}
+
+void pueo::Dataset::enableStats(bool enable)
+{
+  if (enable && !fStats) fStats = new DatasetStats;
+  if (!enable)
+  {
+    delete fStats;
+    fStats = 0;
+  }
+}
+
+void pueo::Dataset::dumpStatsOnSignal(int signum)
+{
+  std::signal(signum, requestStats);
+}
+
+void pueo::Dataset::useSharedCache(bool use)
+{
+  fShmCache = use ? SharedEventCache::instance() : 0;
+  if (use && !fShmCache) std::cerr << "No shared event cache, set PUEO_SHM_CACHE_MB to have one" << std::endl;
+  if (!fRunLoaded) return;
+
+  bool head_shared = fShmHeadKey;
+  bool event_shared = fShmEventKey && fShmEventEntry >= 0;
+  setupSharedCache();
+
+  // what came from the shared cache isn't what the trees think they last read, so read it from them again
+  if (!fShmCache)
+  {
+    if (head_shared) header(true);
+    if (event_shared)
+    {
+      loadEventEntry(eventEntry(), true);
+      fUsefulDirty = true;
+    }
+  }
+}
+
+pueo::EventFuture pueo::Dataset::fetchAsync(Long64_t entry, unsigned what)
+{
+  return fetchRunAsync(currRun, entry, what);
+}
+
+pueo::EventFuture pueo::Dataset::fetchRunAsync(int run, Long64_t entry, unsigned what)
+{
+  // the I/O threads' Datasets are made the way this one is now
+  if (fFetcher && (fFetcherDir != datadir || fFetcherDecimated != fDecimated))
+  {
+    delete fFetcher;
+    fFetcher = 0;
+  }
+
+  if (!fFetcher)
+  {
+    DataDirectory dir = datadir;
+    bool decimated = fDecimated;
+    BlindingStrategy strat = theStrat;
+    bool time_tables = fUseTimeTables;
+    TString time_table_dir = fTimeTableDir;
+    size_t budget = fMemoryBudget;
+    auto make = [=](int r)
+    {
+      Dataset * d = new Dataset(r, dir, decimated, strat);
+      d->useTimeTables(time_tables, time_table_dir.Length() ? time_table_dir.Data() : nullptr);
+      if (budget) d->setMemoryBudget(budget);
+      return d;
+    };
+    fFetcher = new DatasetFetcher(make, fFetchThreads, fFetchMaxInFlight);
+    fFetcherDir = dir;
+    fFetcherDecimated = decimated;
+  }
+
+  return fFetcher->fetch(run, entry, what);
+}
+
+void pueo::Dataset::setAsyncFetch(int nthreads, int max_in_flight)
+{
+  fFetchThreads = nthreads;
+  fFetchMaxInFlight = max_in_flight;
+  delete fFetcher;
+  fFetcher = 0;
+}
+
+// only for trees, RNTuples have their own page cache (and RawEvents, UsefulEvents would be no smaller)
+void pueo::Dataset::setupSharedCache()
+{
+  fShmHeadKey = fShmCache && !usingRNTuple() ? shmFileKey(fHeadTree, RawHeader::Class()) : 0;
+  fShmEventKey = fShmCache && !usingRNTuple() && !fHaveUsefulFile ? shmFileKey(fEventTree, RawEvent::Class()) : 0;
+  fShmHeadEntry = -1;
+  fShmEventEntry = -1;
+}
+
+void pueo::Dataset::printCacheStats(std::ostream & os) const
+{
+  static const char * modes[] = { "auto", "sequential", "sparse", "interactive" };
+  os << "Run " << currRun << " caches set up for " << modes[fCacheMode] << " access"
+     << (fAccessMode == kAccessAuto ? " (auto)" : "") << std::endl;
+
+  const TTree * trees[] = { fHeadTree, fDecimatedHeadTree, fEventTree, fGpsTree };
+  for (const TTree * t : trees)
+  {
+    if (!t) continue;
+    TFile * f = t->GetCurrentFile();
+    os << "  " << t->GetName() << " (" << f->GetName() << "): " << f->GetReadCalls() << " read calls, " << f->GetBytesRead() << " bytes read";
+    if (TTreeCache * cache = t->GetReadCache(f))
+    {
+      os << ", " << cache->GetBufferSize() << " byte cache, " << 100 * cache->GetEfficiency() << "% hits";
+    }
+    if (const CachedWebFile * web = dynamic_cast<const CachedWebFile*>(f))
+    {
+      os << ", " << web->blocksFromCache() << " blocks from the disk cache, " << web->blocksFetched() << " fetched";
+    }
+    os << std::endl;
+  }
+  if (fShmCache) fShmCache->print(os);
+}
+
 pueo::Dataset::~Dataset() 
 {
+  delete fFetcher;
+
+  if (fStats && fDumpStats) fStats->print(std::cerr);
 
   unloadRun(); 
 
+  delete fStats;
+
 
 
   if (fHeader) 
@@ -424,6 +1201,9 @@ pueo::Dataset::~Dataset()
   if (fTruth) 
     delete fTruth; 
 
+  if (fSummary) 
+    delete fSummary; 
+
   if (fCutList) 
     delete fCutList;
 
@@ -459,12 +1239,14 @@ pueo::Dataset::~Dataset()
 
 bool  pueo::Dataset::loadRun(int run, DataDirectory dir, bool dec) 
 {
+  StatsTimer timer(fStats ? &fStats->load_run : 0);
+  if (fStats && fRunLoaded) fStats->run_switches++;
 
   datadir = dir; 
 
-  // stop loadRun() changing the ROOT directory
+  // stop loadRun() changing the ROOT directory (however it returns)
   // in case you book histograms or trees after instantiating AnitaDataset  
-  const TString theRootPwd = gDirectory->GetPath();
+  TDirectory::TContext ctx;
   
   fDecimated = dec; 
   fIndices = 0; 
@@ -476,25 +1258,38 @@ bool  pueo::Dataset::loadRun(int run, DataDirectory dir, bool dec)
 
   const char * data_dir = getDataDir(dir); 
 
-  if (strstr(data_dir,"https://") == data_dir)
+  if (strstr(data_dir,"https://") == data_dir || strstr(data_dir,"http://") == data_dir)
   {
-    static bool gtfo_davix = false;
+    // the plugin manager is global, so only one Dataset sets it up, and only again if the cache gets turned on or off
+    static std::mutex plugin_mutex;
+    static int web_handler = -1; // 1 for CachedWebFile, 0 for TWebFile
+    std::lock_guard<std::mutex> lock(plugin_mutex);
 
      // Set up TWebFile because DAVIX is broken
-    if (!gtfo_davix)
+    int want = CachedWebFile::cacheDir() ? 1 : 0;
+    if (web_handler != want)
     {
           // tell ROOT to load all of its plugin handlers, otherwise the first time you open a file this will happen again and override what you are about to do after this
-       gPluginMgr->LoadHandlersFromPluginDirs();
+       if (web_handler < 0) gPluginMgr->LoadHandlersFromPluginDirs();
 
         // Override the plugin handler for web files to use the legacy TWebFile instead of the newer davix which seems to be buggy
-       gPluginMgr->AddHandler("TFile", "^http[s]?:", "TWebFile","Net", "TWebFile(const char*,Option_t*)");
-       gtfo_davix = true;
+        // With PUEO_WEB_CACHE set, our TWebFile that keeps a local block cache instead
+       if (want)
+       {
+         if (verbose) fprintf(stderr, "Caching web files in %s\n", CachedWebFile::cacheDir());
+         gPluginMgr->AddHandler("TFile", "^http[s]?:", "pueo::CachedWebFile","pueoEvent", "CachedWebFile(const char*,Option_t*)");
+       }
+       else
+       {
+         gPluginMgr->AddHandler("TFile", "^http[s]?:", "TWebFile","Net", "TWebFile(const char*,Option_t*)");
+       }
+       web_handler = want;
     }
   }
   //seems like a good idea 
   
   int version = (int) dir; 
-  if (version>0) version::set(version); 
+  if (version>0 && version != version::get()) version::set(version); 
 
   //if decimated, try to load decimated tree
 
@@ -510,7 +1305,7 @@ bool  pueo::Dataset::loadRun(int run, DataDirectory dir, bool dec)
         filesToClose.push_back(f); 
         fDecimatedHeadTree = (TTree*) f->Get("headTree"); 
         if (!fDecimatedHeadTree) fDecimatedHeadTree = (TTree*) f->Get("headerTree");
-        fDecimatedHeadTree->BuildIndex("eventNumber"); 
+        if (!fDecimatedHeadTree->GetTreeIndex()) buildIndex(fStats, fDecimatedHeadTree, "eventNumber"); 
         fDecimatedHeadTree->SetBranchAddress("header",&fHeader); 
         fIndices = ((TTreeIndex*) fDecimatedHeadTree->GetTreeIndex())->GetIndex(); 
     }
@@ -526,6 +1321,11 @@ bool  pueo::Dataset::loadRun(int run, DataDirectory dir, bool dec)
     fDecimatedHeadTree = 0; 
   }
   // try to load timed header file 
+
+#ifdef HAVE_RNTUPLE
+  // filled in as we find RNTuples instead of trees, deleted in setupNTuples if we didn't find any
+  fNTuple = new NTupleSources;
+#endif
   
   // For telemetered crap 
   TString fname0 = TString::Format("%s/run%d/eventHeadFile%d.root", data_dir, run, run);
@@ -542,8 +1342,11 @@ bool  pueo::Dataset::loadRun(int run, DataDirectory dir, bool dec)
     if (strcasestr(f->GetName(),"Simulated")) simulated = true; 
     fprintf(stderr,"Using head file: %s\n",f->GetEndpointUrl()->GetUrl()); 
     filesToClose.push_back(f); 
-    fHeadTree = (TTree*) f->Get("headTree"); 
-    if (!fHeadTree) fHeadTree = (TTree*) f->Get("headerTree");
+    fHeadTree = f->Get<TTree>("headTree"); 
+    if (!fHeadTree) fHeadTree = f->Get<TTree>("headerTree");
+#ifdef HAVE_RNTUPLE
+    if (!fHeadTree) fNTuple->head = openNTuple(f, "headerTree");
+#endif
   }
   else 
   {
@@ -552,11 +1355,26 @@ bool  pueo::Dataset::loadRun(int run, DataDirectory dir, bool dec)
     return false; 
   }
 
-  if (!fDecimated) fHeadTree->SetBranchAddress("header",&fHeader); 
+  if (fHeadTree)
+  {
+    if (!fDecimated) fHeadTree->SetBranchAddress("header",&fHeader); 
 
-  fHeadTree->BuildIndex("eventNumber"); 
+    // skims (and the like) come with theirs
+    TVirtualIndex * index = fHeadTree->GetTreeIndex();
+    if (!index || strcmp(index->GetMajorName(), "eventNumber")) buildIndex(fStats, fHeadTree, "eventNumber"); 
 
-  if (!fDecimated) fIndices = ((TTreeIndex*) fHeadTree->GetTreeIndex())->GetIndex(); 
+    if (!fDecimated) fIndices = ((TTreeIndex*) fHeadTree->GetTreeIndex())->GetIndex(); 
+  }
+#ifdef HAVE_RNTUPLE
+  else if (!fNTuple->head)
+#else
+  else
+#endif
+  {
+    fprintf(stderr,"No header tree in head file for run %d, giving up!\n", run); 
+    fRunLoaded = false;
+    return false; 
+  }
 
   //try to load gps event file  
   TString fname = TString::Format("%s/run%d/gpsEvent%d.root", data_dir, run, run);
@@ -565,7 +1383,10 @@ bool  pueo::Dataset::loadRun(int run, DataDirectory dir, bool dec)
   if (TFile  * f = openIfAnyExist(3,fname.Data(),fname2.Data(), fname3.Data()))
   {
      filesToClose.push_back(f); 
-     fGpsTree = (TTree*) f->Get("attitudeTree"); 
+     fGpsTree = f->Get<TTree>("attitudeTree"); 
+#ifdef HAVE_RNTUPLE
+     if (!fGpsTree ) fNTuple->gps = openNTuple(f, "attitudeTree");
+#endif
      fHaveGpsEvent = true; 
 
   }
@@ -576,8 +1397,11 @@ bool  pueo::Dataset::loadRun(int run, DataDirectory dir, bool dec)
     if (TFile * f = openIfAnyExist(1, fname.Data()))
     {
        filesToClose.push_back(f); 
-       fGpsTree = (TTree*) f->Get("attitudeTree"); 
-       if (!fGpsTree->GetTreeIndex()) fGpsTree->BuildIndex("realTime","realTimeNsecs"); 
+       fGpsTree = f->Get<TTree>("attitudeTree"); 
+#ifdef HAVE_RNTUPLE
+       if (!fGpsTree ) fNTuple->gps = openNTuple(f, "attitudeTree");
+#endif
+       if (fGpsTree && !fGpsTree->GetTreeIndex()) buildIndex(fStats, fGpsTree, "realTime", "realTimeNsecs"); 
        fHaveGpsEvent = false; 
     }
     else
@@ -586,8 +1410,11 @@ bool  pueo::Dataset::loadRun(int run, DataDirectory dir, bool dec)
       fname = TString::Format("%s/attitude.root", data_dir);
       f = TFile::Open(fname);
       filesToClose.push_back(f);
-      fGpsTree = (TTree*) f->Get("attitudeTree"); 
-      if (!fGpsTree->GetTreeIndex()) fGpsTree->BuildIndex("realTime","realTimeNsecs");
+      fGpsTree = f->Get<TTree>("attitudeTree"); 
+#ifdef HAVE_RNTUPLE
+      if (!fGpsTree ) fNTuple->gps = openNTuple(f, "attitudeTree");
+#endif
+      if (fGpsTree && !fGpsTree->GetTreeIndex()) buildIndex(fStats, fGpsTree, "realTime", "realTimeNsecs");
       fHaveGpsEvent = false;
     }
   }
@@ -600,12 +1427,26 @@ bool  pueo::Dataset::loadRun(int run, DataDirectory dir, bool dec)
   fname = TString::Format("%s/run%d/usefulEventFile%d.root", data_dir, run, run);
   fname2 = TString::Format("%s/run%d/SimulatedEventFile%d.root", data_dir, run, run); 
   fname3 = TString::Format("%s/run%d/SimulatedPueoEventFile%d.root", data_dir, run, run); 
-  if (TFile * f = openIfAnyExist(3, fname.Data(), fname2.Data(), fname3.Data()))
+
+  // decimated events (pueo-decimate -E) go with the decimated headers, so the full event file isn't needed
+  TString decimated_fname = TString::Format("%s/run%d/decimatedEventFile%d.root", data_dir, run, run);
+  if (TFile * df = fDecimated ? openIfExists(decimated_fname.Data()) : 0)
+  {
+     filesToClose.push_back(df); 
+     fEventTree = df->Get<TTree>("eventTree"); 
+     fHaveUsefulFile = false; 
+     fDecimatedEvents = fEventTree; 
+     if (fEventTree) fEventTree->SetBranchAddress("event",&fRawEvent); 
+  }
+  else if (TFile * f = openIfAnyExist(3, fname.Data(), fname2.Data(), fname3.Data()))
   {
      filesToClose.push_back(f); 
-     fEventTree = (TTree*) f->Get("eventTree"); 
+     fEventTree = f->Get<TTree>("eventTree"); 
+#ifdef HAVE_RNTUPLE
+     if (!fEventTree ) fNTuple->event = openNTuple(f, "eventTree");
+#endif
      fHaveUsefulFile = true; 
-     fEventTree->SetBranchAddress("event",&fUsefulEvent); 
+     if (fEventTree) fEventTree->SetBranchAddress("event",&fUsefulEvent); 
   }
   else 
   {
@@ -613,13 +1454,16 @@ bool  pueo::Dataset::loadRun(int run, DataDirectory dir, bool dec)
     if (TFile *f = openIfExists(fname.Data()))
     {
        filesToClose.push_back(f); 
-       fEventTree = (TTree*) f->Get("eventTree"); 
+       fEventTree = f->Get<TTree>("eventTree"); 
+#ifdef HAVE_RNTUPLE
+       if (!fEventTree ) fNTuple->event = openNTuple(f, "eventTree");
+#endif
        fHaveUsefulFile = false; 
-       fEventTree->SetBranchAddress("event",&fRawEvent); 
+       if (fEventTree) fEventTree->SetBranchAddress("event",&fRawEvent); 
     }
   }
 
-  if (!fEventTree) 
+  if (!haveEvents()) 
   {
     std::cerr << "WARNING: did not load an event tree for run " << run << " in " << data_dir << std::endl; 
 
@@ -639,16 +1483,37 @@ bool  pueo::Dataset::loadRun(int run, DataDirectory dir, bool dec)
     }
   }
 
+  // per-channel features, see pueo-summarize
+  fname = TString::Format("%s/run%d/summaryFile%d.root", data_dir, run, run);
+  if (TFile * f = openIfExists(fname.Data()))
+  {
+    filesToClose.push_back(f); 
+    fSummaryTree = f->Get<TTree>("summaryTree"); 
+    if (fSummaryTree)
+    {
+      fSummaryTree->SetBranchAddress("summary",&fSummary); 
+      if (!fSummaryTree->GetTreeIndex()) buildIndex(fStats, fSummaryTree, "eventNumber"); 
+    }
+  }
+
+  {
+    // builds the RNTuple indices
+    StatsTimer index_timer(fStats ? &fStats->index_build : 0);
+    setupNTuples();
+  }
+
+  setupSharedCache();
+
+  fSequentialReads = 0;
+  setupCaches(fAccessMode == kAccessAuto ? kAccessInteractive : fAccessMode);
+
   //load the first entry 
   getEntry(0); 
   
 
   fRunLoaded = true;
+  if (fStats) fStats->files_opened += filesToClose.size();
 
-  // stop loadRun() changing the ROOT directory
-  // in case you book histograms or trees after instantiating AnitaDataset
-  gDirectory->cd(theRootPwd); 
-  
   return true; 
 }
 
@@ -701,8 +1566,8 @@ int pueo::Dataset::nextEvent()
 
 int pueo::Dataset::N() const
 {
-  TTree* t = fDecimated? fDecimatedHeadTree : fHeadTree;
-  return t ? t->GetEntries() : 0;
+  if (fDecimated) return fDecimatedHeadTree ? fDecimatedHeadTree->GetEntries() : 0;
+  return headEntries();
 }
 
 int pueo::Dataset::previousMinBiasEvent()
@@ -720,7 +1585,7 @@ int pueo::Dataset::previousMinBiasEvent()
       loadRun(currRun - 1);
       fIndex = N() - 1;
     }
-    fHeadTree->GetEntry(fIndex);
+    loadHeadEntry(fIndex);
     if((fHeader->trigType&1) == 0) break;
   }
   
@@ -742,7 +1607,7 @@ int pueo::Dataset::nextMinBiasEvent()
       loadRun(currRun + 1);
       fIndex = 0;
     }
-    fHeadTree->GetEntry(fIndex);
+    loadHeadEntry(fIndex);
     if((fHeader->trigType&1) == 0) break;
   }
   
@@ -752,13 +1617,32 @@ int pueo::Dataset::nextMinBiasEvent()
 
 int pueo::Dataset::setCut(const TCut & cut)
 {
+  // the trees can't have the old cut set on them when we delete it, or be restricted to it for the Draw
+  if (fCacheMode == kAccessSparse) setupCaches(kAccessInteractive);
+
   if (fCutList) 
   {
     delete fCutList; 
+    fCutList = 0;
   }
 
-  int n = (fDecimated? fDecimatedHeadTree : fHeadTree)->Draw(">>evlist1",cut,"goff"); 
-  fCutList = (TEventList*) gDirectory->Get("evlist1");
+  if (!(fDecimated ? fDecimatedHeadTree : fHeadTree))
+  {
+    std::cerr << "setCut() needs a header TTree, it's not supported for RNTuple headers" << std::endl;
+    return -1;
+  }
+
+  // named after us, so Datasets sharing a directory don't end up with (and delete) each other's lists
+  TString name = TString::Format("pueoCut%p", (void*) this);
+  TTree * t = fDecimated ? fDecimatedHeadTree : fHeadTree;
+  // matched by event number through its index, so it works with the decimated headers too
+  if (fSummaryTree) t->AddFriend(fSummaryTree);
+  int n = t->Draw(">>" + name,cut,"goff"); 
+  if (fSummaryTree) t->RemoveFriend(fSummaryTree);
+  fShmHeadEntry = -1; // the Draw read through fHeader
+  fCutList = (TEventList*) gDirectory->Get(name);
+  if (fCutList) fCutList->SetDirectory(0);
+  if (fAccessMode == kAccessSparse) setupCaches(kAccessSparse);
   return n; 
 }
 
@@ -790,6 +1674,7 @@ int pueo::Dataset::nthInCut(int i)
 {
   if (!fCutList) 
     return -1; 
+  if (fAccessMode == kAccessAuto && (fCacheMode != kAccessSparse || fCachePlaylist)) setupCaches(kAccessSparse);
   int ret = getEntry(fCutList->GetEntry(i)); 
 
   fCutIndex = i;
@@ -836,6 +1721,9 @@ int pueo::Dataset::setPlaylist(const char* playlist)
   }
 
   int n = loadPlaylist(playlist); 
+
+  // prefetch the new playlist's events
+  if (fCacheMode == kAccessSparse && fCachePlaylist) setupCaches(fAccessMode == kAccessAuto ? kAccessInteractive : kAccessSparse, true);
   return n; 
 }
 
@@ -866,6 +1754,7 @@ int pueo::Dataset::nthInPlaylist(int i)
   if (fPlaylist.empty()) return -1; 
 	fPlaylistIndex = i;
 	if(getCurrRun() != getPlaylistRun()) loadRun(getPlaylistRun());
+  if (fAccessMode == kAccessAuto && (fCacheMode != kAccessSparse || !fCachePlaylist)) setupCaches(kAccessSparse, true);
   int ret = getEvent(getPlaylistEvent()); 
 
   return ret;
@@ -903,8 +1792,22 @@ int pueo::Dataset::loadPlaylist(const char* playlist)
   int rN;
   int evN;
   std::ifstream pl(playlist);
-  while (pl >> rN >> evN )
+  std::string line;
+  while (std::getline(pl, line))
   {
+    int n = sscanf(line.c_str(), "%d %d", &rN, &evN);
+    if (n == 1)
+    {
+      // just an event number
+      evN = rN;
+      rN = locateEvent(evN);
+      if (rN < 0)
+      {
+        fprintf(stderr,"WARNING: couldn't find the run of event %d in the run catalog, skipping it\n", evN);
+        continue;
+      }
+    }
+    else if (n != 2) continue;
     runEv.push_back(std::pair<int,int>(rN,evN));
   }
   fPlaylist = std::move(runEv);
@@ -912,6 +1815,312 @@ int pueo::Dataset::loadPlaylist(const char* playlist)
 }
 
 
+// Copies the (sorted) entries of t to a new file with t's compression, with an index on major/minor if given.
+// All of t is fast cloned, which copies the compressed baskets as they are, otherwise it has to go entry by entry.
+static bool skimTree(TTree * t, const std::vector<Long64_t> & entries, const char * fname,
+                     const char * major = 0, const char * minor = "0")
+{
+  TDirectory::TContext ctx;
+  TFile * out = TFile::Open(fname, "RECREATE");
+  if (!out || out->IsZombie())
+  {
+    fprintf(stderr, "Couldn't create %s\n", fname);
+    delete out;
+    return false;
+  }
+  if (TFile * in = t->GetCurrentFile()) out->SetCompressionSettings(in->GetCompressionSettings());
+
+  TTree * copy = 0;
+  if ((Long64_t) entries.size() == t->GetEntries())
+  {
+    copy = t->CloneTree(-1, "fast");
+  }
+  else
+  {
+    // so the cache prefetches the baskets of the entries we want, and only those
+    TEventList list;
+    list.SetDirectory(0);
+    for (Long64_t e : entries) list.Enter(e);
+    t->SetEventList(&list);
+
+    copy = t->CloneTree(0);
+    for (Long64_t e : entries)
+    {
+      t->GetEntry(e);
+      copy->Fill();
+    }
+    t->SetEventList(0);
+  }
+
+  bool ok = copy;
+  if (ok)
+  {
+    if (major) copy->BuildIndex(major, minor);
+    copy->Write();
+  }
+  else fprintf(stderr, "Couldn't copy %s to %s\n", t->GetName(), fname);
+
+  out->Close();
+  delete out;
+  return ok;
+}
+
+int pueo::Dataset::skimRun(const char * outdir, std::vector<Long64_t> entries)
+{
+  if (!fHeadTree || usingRNTuple())
+  {
+    std::cerr << "skim() needs TTrees, it's not supported for RNTuples" << std::endl;
+    return -1;
+  }
+
+  Long64_t n = fHeadTree->GetEntries();
+  entries.erase(std::remove_if(entries.begin(), entries.end(), [n](Long64_t e) { return e < 0 || e >= n; }), entries.end());
+  std::sort(entries.begin(), entries.end());
+  entries.erase(std::unique(entries.begin(), entries.end()), entries.end());
+  if (entries.empty()) return 0;
+
+  TString dir = TString::Format("%s/run%d", outdir, currRun);
+  if (gSystem->mkdir(dir, true) && gSystem->AccessPathName(dir))
+  {
+    fprintf(stderr, "Couldn't create %s\n", dir.Data());
+    return -1;
+  }
+
+  // the copies read through our own objects, and the tree event lists of a sparse cache would get in the way
+  AccessMode cache_mode = fCacheMode;
+  bool cache_playlist = fCachePlaylist;
+  if (fCacheMode == kAccessSparse) setupCaches(kAccessInteractive);
+  if (fDecimated) fHeadTree->SetBranchAddress("header", &fHeader);
+
+  // decimated events are only there for the decimated headers, at their entries
+  std::vector<Long64_t> event_entries;
+  if (fDecimatedEvents)
+  {
+    std::vector<Long64_t> kept;
+    for (Long64_t e : entries)
+    {
+      loadHeadEntry(e, true);
+      Long64_t d = fDecimatedHeadTree->GetEntryNumberWithIndex(fHeader->eventNumber);
+      if (d < 0) continue;
+      kept.push_back(e);
+      event_entries.push_back(d);
+    }
+    entries = std::move(kept);
+  }
+  else event_entries = entries;
+
+  // the attitude gps() would pick for each event, if it isn't stored per event
+  std::vector<Long64_t> gps_entries;
+  if (fGpsTree && !fHaveGpsEvent)
+  {
+    const timing::TimeTable * table = timeTable();
+    for (Long64_t e : entries)
+    {
+      loadHeadEntry(e, true);
+      if (table) table->correct(*fHeader);
+      Long64_t g = gpsEntryAtTime(fHeader->corrected_trigger_time.GetSec(), fHeader->corrected_trigger_time.GetNanoSec());
+      if (g >= 0) gps_entries.push_back(g);
+    }
+    std::sort(gps_entries.begin(), gps_entries.end());
+    gps_entries.erase(std::unique(gps_entries.begin(), gps_entries.end()), gps_entries.end());
+  }
+
+  // the summaries of the kept events, by event number since the summary file needn't match the headers entry for entry
+  std::vector<Long64_t> summary_entries;
+  if (fSummaryTree)
+  {
+    for (Long64_t e : entries)
+    {
+      loadHeadEntry(e, true);
+      Long64_t sm = fSummaryTree->GetEntryNumberWithIndex(fHeader->eventNumber);
+      if (sm >= 0) summary_entries.push_back(sm);
+    }
+  }
+
+  auto outName = [&dir](TTree * t) { return dir + "/" + gSystem->BaseName(t->GetCurrentFile()->GetName()); };
+
+  bool ok = skimTree(fHeadTree, entries, outName(fHeadTree), "eventNumber");
+  if (ok && fEventTree)
+  {
+    // which a Dataset reading the skim looks for
+    TString name = fDecimatedEvents ? TString::Format("%s/eventFile%d.root", dir.Data(), currRun) : outName(fEventTree);
+    ok = skimTree(fEventTree, event_entries, name);
+  }
+  if (ok && fTruthTree) ok = skimTree(fTruthTree, entries, outName(fTruthTree));
+  if (ok && fSummaryTree) ok = skimTree(fSummaryTree, summary_entries, outName(fSummaryTree), "eventNumber");
+  if (ok && fGpsTree)
+  {
+    if (fHaveGpsEvent) ok = skimTree(fGpsTree, entries, outName(fGpsTree));
+    else
+    {
+      // a run of the global attitude file gets its own gpsFile
+      TString name = outName(fGpsTree);
+      if (name.EndsWith("/attitude.root")) name = TString::Format("%s/gpsFile%d.root", dir.Data(), currRun);
+      ok = skimTree(fGpsTree, gps_entries, name, "realTime", "realTimeNsecs");
+    }
+  }
+
+  // back to where we were
+  if (fDecimated) fHeadTree->ResetBranchAddresses();
+  if (cache_mode == kAccessSparse) setupCaches(kAccessSparse, cache_playlist);
+  header(true);
+  if (fEventTree)
+  {
+    loadEventEntry(eventEntry(), true);
+    if (!fHaveUsefulFile) fUsefulDirty = true;
+  }
+  if (fGpsTree)
+  {
+    if (fHaveGpsEvent) loadGpsEntry(fWantedEntry, true);
+    else fGpsDirty = true;
+  }
+  if (fTruthTree) fTruthTree->GetEntry(fWantedEntry);
+
+  return ok ? (int) entries.size() : -1;
+}
+
+// so skims of several runs can be used with locateEvent and playlists of bare event numbers
+static void skimCatalog(const char * outdir)
+{
+  TString catalog = TString::Format("%s/runcatalog.dat", outdir);
+  if (pueo::RunCatalog::build(outdir, catalog, pueo::version::get()) < 0 && verbose)
+  {
+    fprintf(stderr, "Couldn't build %s\n", catalog.Data());
+  }
+}
+
+int pueo::Dataset::skim(const char * outdir, const TCut & cut, const std::vector<int> & runs)
+{
+  int orig_run = currRun;
+  Long64_t orig_entry = current();
+  AccessMode cache_mode = fCacheMode;
+  bool cache_playlist = fCachePlaylist;
+  int nwritten = 0;
+
+  std::vector<int> todo = runs;
+  if (todo.empty()) todo.push_back(currRun);
+
+  for (int run : todo)
+  {
+    if (run != currRun && !loadRun(run, datadir, fDecimated))
+    {
+      nwritten = -1;
+      break;
+    }
+
+    TTree * t = fDecimated ? fDecimatedHeadTree : fHeadTree;
+    if (!t || usingRNTuple())
+    {
+      std::cerr << "skim() needs TTrees, it's not supported for RNTuples" << std::endl;
+      nwritten = -1;
+      break;
+    }
+
+    // like setCut, without replacing the cut
+    if (fCacheMode == kAccessSparse) setupCaches(kAccessInteractive);
+    TString name = TString::Format("pueoSkim%p", (void*) this);
+    TDirectory::TContext ctx;
+    if (fSummaryTree) t->AddFriend(fSummaryTree);
+    t->Draw(">>" + name, cut, "goff");
+    if (fSummaryTree) t->RemoveFriend(fSummaryTree);
+    fShmHeadEntry = -1;
+    std::unique_ptr<TEventList> list((TEventList*) gDirectory->Get(name));
+    if (list) list->SetDirectory(0);
+
+    std::vector<Long64_t> entries;
+    for (int i = 0; list && i < list->GetN(); i++)
+    {
+      Long64_t e = list->GetEntry(i);
+      if (fDecimated)
+      {
+        fDecimatedHeadTree->GetEntry(e);
+        e = headEntryWithEvent(fHeader->eventNumber);
+      }
+      entries.push_back(e);
+    }
+
+    int n = skimRun(outdir, std::move(entries));
+    if (n < 0)
+    {
+      nwritten = -1;
+      break;
+    }
+    nwritten += n;
+  }
+
+  if (currRun != orig_run) loadRun(orig_run, datadir, fDecimated);
+  else if (cache_mode == kAccessSparse) setupCaches(kAccessSparse, cache_playlist);
+  getEntry(orig_entry);
+
+  if (nwritten > 0 && todo.size() > 1) skimCatalog(outdir);
+  return nwritten;
+}
+
+int pueo::Dataset::skim(const char * outdir, const std::vector<bool> & selected)
+{
+  std::vector<Long64_t> entries;
+  for (size_t i = 0; i < selected.size(); i++)
+  {
+    if (!selected[i]) continue;
+    if (fDecimated)
+    {
+      if ((Long64_t) i >= fDecimatedHeadTree->GetEntries()) break;
+      fDecimatedHeadTree->GetEntry(i);
+      entries.push_back(headEntryWithEvent(fHeader->eventNumber));
+    }
+    else entries.push_back(i);
+  }
+
+  return skimRun(outdir, std::move(entries));
+}
+
+int pueo::Dataset::skimPlaylist(const char * outdir)
+{
+  if (fPlaylist.empty()) return -1;
+
+  std::vector<std::pair<int,int> > playlist = fPlaylist;
+  std::stable_sort(playlist.begin(), playlist.end(),
+                   [](const std::pair<int,int> & a, const std::pair<int,int> & b) { return a.first < b.first; });
+
+  int orig_run = currRun;
+  Long64_t orig_entry = current();
+  int nwritten = 0;
+  int nruns = 0;
+
+  for (size_t i = 0; i < playlist.size(); )
+  {
+    int run = playlist[i].first;
+    if (run != currRun && !loadRun(run, datadir, fDecimated))
+    {
+      // loadRun has said why, nthInPlaylist wouldn't get these either
+      while (i < playlist.size() && playlist[i].first == run) i++;
+      continue;
+    }
+
+    std::vector<Long64_t> entries;
+    for (; i < playlist.size() && playlist[i].first == run; i++)
+    {
+      Long64_t e = headEntryWithEvent(playlist[i].second);
+      if (e < 0) fprintf(stderr, "WARNING: event %d isn't in run %d, not skimmed\n", playlist[i].second, run);
+      else entries.push_back(e);
+    }
+
+    int n = skimRun(outdir, std::move(entries));
+    if (n < 0)
+    {
+      nwritten = -1;
+      break;
+    }
+    nwritten += n;
+    nruns += n > 0;
+  }
+
+  if (currRun != orig_run) loadRun(orig_run, datadir, fDecimated);
+  getEntry(orig_entry);
+
+  if (nwritten > 0 && nruns > 1) skimCatalog(outdir);
+  return nwritten;
+}
 
 
 pueo::TruthEvent * pueo::Dataset::truth(bool force_reload) 
@@ -926,6 +2135,21 @@ pueo::TruthEvent * pueo::Dataset::truth(bool force_reload)
   return fTruth; 
 }
 
+pueo::EventSummary * pueo::Dataset::summary(bool force_reload) 
+{
+  if (!fSummaryTree) return 0; 
+
+  // by event number, since the summary file needn't have every header (or be in the same order)
+  Long64_t entry = fSummaryTree->GetEntryNumberWithIndex(header()->eventNumber);
+  if (entry < 0) return 0;
+  if (fSummaryTree->GetReadEntry() != entry || force_reload) 
+  {
+    fSummaryTree->GetEntry(entry); 
+  }
+
+  return fSummary; 
+}
+
 #include "pueo1-runinfo.h"
 
 
@@ -934,6 +2158,12 @@ int pueo::Dataset::getRunAtTime(double t)
 
   int version = version::getVersionFromUnixTime(t); 
 
+  // the catalog has runs added since pueo1-runinfo.h was generated
+  if (const RunCatalog * catalog = RunCatalog::forFlight(version))
+  {
+    return catalog->runAtTime(t);
+  }
+
   if (version == 1)
   {
     return pueo1_find_run(t);
@@ -942,6 +2172,25 @@ int pueo::Dataset::getRunAtTime(double t)
   return -1;
 }
 
+int pueo::Dataset::getRunContainingEventNumber(UInt_t eventNumber, int flight)
+{
+  if (flight < 0) flight = version::get();
+  const RunCatalog * catalog = RunCatalog::forFlight(flight);
+  return catalog ? catalog->runWithEvent(eventNumber) : -1;
+}
+
+int pueo::Dataset::locateEvent(UInt_t eventNumber, Long64_t * entry, int flight)
+{
+  if (flight < 0) flight = version::get();
+  const RunCatalog * catalog = RunCatalog::forFlight(flight);
+
+  int run;
+  int64_t e;
+  if (!catalog || !catalog->locate(eventNumber, &run, &e)) return -1;
+  if (entry) *entry = e;
+  return run;
+}
+
 void pueo::Dataset::zeroBlindPointers(){
   loadedBlindTrees = false;
 
@@ -981,6 +2230,8 @@ TString pueo::Dataset::getDescription(BlindingStrategy strat){
 
 pueo::Dataset::BlindingStrategy pueo::Dataset::setStrategy(BlindingStrategy newStrat){
   theStrat = newStrat;
+  delete fFetcher;
+  fFetcher = 0;
   return theStrat;
 }
 
@@ -997,23 +2248,34 @@ void pueo::Dataset::loadBlindTrees() {
 
 
 void pueo::Dataset::loadHiCalGps(char which) {
-  if(!fHiCalGpsFile[which-'A']){
-
-    const TString theRootPwd = gDirectory->GetPath();    
+  std::call_once(fHiCalLoaded[which-'A'], [which]()
+  {
+    TDirectory::TContext ctx;
 
     TString fName = TString::Format("%s/share/pueoCalib/H1b_GPS_time_interp.root", getenv("PUEO_UTIL_INSTALL_DIR"));
-    fHiCalGpsFile[which-'A'] = TFile::Open(fName);
-    fHiCalGpsTree[which-'A'] = (TTree*) fHiCalGpsFile[which-'A']->Get("Tpos");
-
-    fHiCalGpsTree[which-'A']->BuildIndex("unixTime");
+    std::unique_ptr<TFile> f(TFile::Open(fName));
+    TTree * t = f ? f->Get<TTree>("Tpos") : nullptr;
+    if (!t)
+    {
+      std::cerr << "Couldn't load the HiCal GPS from " << fName << std::endl;
+      return;
+    }
 
-    fHiCalGpsTree[which-'A']->SetBranchAddress("longitude", &fHiCalLon[which-'A']);
-    fHiCalGpsTree[which-'A']->SetBranchAddress("latitude", &fHiCalLat[which-'A']);
-    fHiCalGpsTree[which-'A']->SetBranchAddress("altitude", &fHiCalAlt[which-'A']);
-    fHiCalGpsTree[which-'A']->SetBranchAddress("unixTime", &fHiCalUnixTime[which-'A']);
+    HiCalPoint p;
+    t->SetBranchAddress("longitude", &p.longitude);
+    t->SetBranchAddress("latitude", &p.latitude);
+    t->SetBranchAddress("altitude", &p.altitude);
+    t->SetBranchAddress("unixTime", &p.unixTime);
 
-    gDirectory->cd(theRootPwd);
-  }
+    std::vector<HiCalPoint> & track = fHiCalTrack[which-'A'];
+    track.reserve(t->GetEntries());
+    for (Long64_t i = 0; i < t->GetEntries(); i++)
+    {
+      t->GetEntry(i);
+      track.push_back(p);
+    }
+    std::stable_sort(track.begin(), track.end(), [](const HiCalPoint & l, const HiCalPoint & r) { return l.unixTime < r.unixTime; });
+  });
 }
 
 
@@ -1042,14 +2304,15 @@ void pueo::Dataset::hiCal(char which, Double_t& longitude, Double_t& latitude, D
  */
 void pueo::Dataset::hiCal(char which, UInt_t realTime, Double_t& longitude, Double_t& latitude, Double_t& altitude) {
   loadHiCalGps(which);
-  Long64_t entry = fHiCalGpsTree[which-'A']->GetEntryNumberWithIndex(realTime);
+  const std::vector<HiCalPoint> & track = fHiCalTrack[which-'A'];
+  auto it = std::lower_bound(track.begin(), track.end(), (Int_t) realTime,
+                             [](const HiCalPoint & p, Int_t t) { return p.unixTime < t; });
 
-  if(entry > 0){
-    fHiCalGpsTree[which-'A']->GetEntry(entry);
-    longitude = fHiCalLon[which-'A'];
-    latitude = fHiCalLat[which-'A'];
+  if(it != track.end() && it->unixTime == (Int_t) realTime){
+    longitude = it->longitude;
+    latitude = it->latitude;
     const double feetToMeters = 0.3048;
-    altitude = fHiCalAlt[which-'A']*feetToMeters;
+    altitude = it->altitude*feetToMeters;
   }
   else{
     longitude = -9999;
@@ -0,0 +1,103 @@
+/****************************************************************************************
+*  DatasetStats.cc            Implementation of the pueo::Dataset counters and memory accounting
+*
+*  (C) 2023-, The Payload for Ultrahigh Energy Observations (PUEO) Collaboration
+*
+*  This file is part of pueoEvent, the ROOT I/O library for PUEO.
+*
+*  pueoEvent is free software: you can redistribute it and/or modify it under the
+*  terms of the GNU General Public License as published by the Free Software
+*  Foundation, either version 2 of the License, or (at your option) any later
+*  version.
+*
+*  Foobar is distributed in the hope that it will be useful, but WITHOUT ANY
+*  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+*  A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+*
+*  You should have received a copy of the GNU General Public License along with
+*  Foobar. If not, see <https://www.gnu.org/licenses/
+*
+****************************************************************************************/
+
+#include "pueo/DatasetStats.h"
+
+#include <iomanip>
+#include <string>
+#include <algorithm>
+
+void pueo::DatasetStats::Timer::add(uint64_t ns)
+{
+  n++;
+  total_ns += ns;
+  max_ns = std::max(max_ns, ns);
+
+  int bin = 0;
+  while (bin < kNBins - 1 && (ns >> (bin + 1))) bin++;
+  hist[bin]++;
+}
+
+uint64_t pueo::DatasetStats::Timer::quantile(double q) const
+{
+  if (!n) return 0;
+  uint64_t want = q * n;
+  uint64_t seen = 0;
+  for (int i = 0; i < kNBins; i++)
+  {
+    seen += hist[i];
+    if (seen > want) return std::min(max_ns, (uint64_t(2) << i));
+  }
+  return max_ns;
+}
+
+const char * pueo::DatasetStats::treeName(Tree t)
+{
+  switch (t)
+  {
+    case kHead: return "header";
+    case kEvent: return "event";
+    case kGps: return "gps";
+    default: return "?";
+  }
+}
+
+static void printTimer(std::ostream & os, const char * what, const pueo::DatasetStats::Timer & t)
+{
+  os << "  " << std::setw(16) << std::left << what << std::right << std::setw(10) << t.n << " calls";
+  if (t.n)
+  {
+    os << std::fixed << std::setprecision(1)
+       << ", total " << t.total_ns * 1e-6 << " ms, mean " << t.mean() * 1e-3 << " us"
+       << ", p50 < " << t.quantile(0.5) * 1e-3 << " us, p99 < " << t.quantile(0.99) * 1e-3 << " us"
+       << ", max " << t.max_ns * 1e-3 << " us";
+    os.unsetf(std::ios::floatfield);
+  }
+  os << std::endl;
+}
+
+void pueo::DatasetStats::print(std::ostream & os) const
+{
+  os << "Dataset stats: " << files_opened << " files opened, " << run_switches << " run switches" << std::endl;
+  printTimer(os, "loadRun", load_run);
+  printTimer(os, "index build", index_build);
+  for (int i = 0; i < kNTrees; i++)
+  {
+    const TreeStats & t = trees[i];
+    if (!t.get_entry.n && !t.shm_hits) continue;
+    printTimer(os, (std::string(treeName((Tree) i)) + " GetEntry").c_str(), t.get_entry);
+    os << "  " << std::setw(16) << "" << std::setw(10) << t.bytes_read << " bytes read, " << t.bytes_unzipped << " unzipped";
+    if (t.bytes_read) os << " (x" << std::setprecision(3) << double(t.bytes_unzipped) / t.bytes_read << ")";
+    if (t.shm_hits) os << ", " << t.shm_hits << " from the shared event cache";
+    os << std::endl;
+  }
+  printTimer(os, "UsefulEvent", useful_build);
+}
+
+void pueo::DatasetMemory::print(std::ostream & os) const
+{
+  os << std::fixed << std::setprecision(1)
+     << "Dataset memory: " << total() / 1048576. << " MB ("
+     << baskets / 1048576. << " MB baskets, " << caches / 1048576. << " MB caches, "
+     << indices / 1048576. << " MB indices, " << events / 1048576. << " MB event objects, "
+     << cut_lists / 1048576. << " MB cut lists)" << std::endl;
+  os.unsetf(std::ios::floatfield);
+}
@@ -0,0 +1,158 @@
+/****************************************************************************************
+*  Decimation.cc            Writing the decimated ("10%") dataset
+*
+*  (C) 2023-, The Payload for Ultrahigh Energy Observations (PUEO) Collaboration
+*
+*  This file is part of pueoEvent, the ROOT I/O library for PUEO.
+*
+*  pueoEvent is free software: you can redistribute it and/or modify it under the
+*  terms of the GNU General Public License as published by the Free Software
+*  Foundation, either version 2 of the License, or (at your option) any later
+*  version.
+*
+*  Foobar is distributed in the hope that it will be useful, but WITHOUT ANY
+*  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+*  A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+*
+*  You should have received a copy of the GNU General Public License along with
+*  Foobar. If not, see <https://www.gnu.org/licenses/
+*
+****************************************************************************************/
+
+#include "pueo/Decimation.h"
+#include "pueo/RawHeader.h"
+#include "pueo/RawEvent.h"
+#include "pueo/RunFiles.h"
+
+#include "TFile.h"
+#include "TTree.h"
+#include "TDirectory.h"
+#include "TSystem.h"
+#include "TString.h"
+
+#include <memory>
+#include <unistd.h>
+
+bool pueo::decimation::selected(uint32_t eventNumber, double fraction, uint64_t seed)
+{
+  // splitmix64 of the event number, much cheaper than seeding a TRandom3 for every event
+  uint64_t z = eventNumber + (seed + 1) * 0x9e3779b97f4a7c15ULL;
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  z ^= z >> 31;
+  return (z >> 11) / 9007199254740992. < fraction;
+}
+
+// copies the entries of t to a file with the same compression, written atomically
+static bool writeEntries(TTree * t, const char * name, const std::vector<Long64_t> & entries, const TString & fname, bool index)
+{
+  return pueo::runfiles::writeAtomically(fname, [&](const char * tmp)
+  {
+    TDirectory::TContext ctx;
+    std::unique_ptr<TFile> out(TFile::Open(tmp, "RECREATE"));
+    if (!out || out->IsZombie())
+    {
+      std::cerr << "Couldn't create " << tmp << std::endl;
+      return false;
+    }
+    out->SetCompressionSettings(t->GetCurrentFile()->GetCompressionSettings());
+
+    TTree * copy = t->CloneTree(0);
+    copy->SetName(name);
+    for (Long64_t e : entries)
+    {
+      t->GetEntry(e);
+      copy->Fill();
+    }
+    if (index) copy->BuildIndex("eventNumber");
+    copy->Write();
+    out->Close();
+    return true;
+  });
+}
+
+int64_t pueo::decimation::writeRun(const char * data_dir, int run, const Config & cfg)
+{
+  const char * out_dir = cfg.out_dir ? cfg.out_dir : data_dir;
+
+  // the head files Dataset::loadRun looks for, in the same order
+  TString head_file;
+  for (const char * name : {"eventHeadFile", "timedHeadFile", "headFile", "SimulatedHeadFile", "SimulatedPueoHeadFile"})
+  {
+    TString f = TString::Format("%s/run%d/%s%d.root", data_dir, run, name, run);
+    if (!access(f, R_OK))
+    {
+      head_file = f;
+      break;
+    }
+  }
+  if (head_file == "")
+  {
+    std::cerr << "No head file for run " << run << " in " << data_dir << std::endl;
+    return -1;
+  }
+
+  TDirectory::TContext ctx;
+  std::unique_ptr<TFile> f(TFile::Open(head_file));
+  TTree * t = f ? f->Get<TTree>("headTree") : nullptr;
+  if (f && !t) t = f->Get<TTree>("headerTree");
+  if (!t)
+  {
+    std::cerr << "No header tree in " << head_file << std::endl;
+    return -1;
+  }
+
+  pueo::RawHeader * h = nullptr;
+  t->SetBranchAddress("header", &h);
+
+  // only the event numbers to pick the entries, if the tree is split
+  bool split = t->GetBranch("eventNumber");
+  if (split)
+  {
+    t->SetBranchStatus("*", 0);
+    for (const char * b : {"header", "eventNumber"}) t->SetBranchStatus(b, 1);
+  }
+
+  std::vector<Long64_t> entries;
+  for (Long64_t i = 0; i < t->GetEntries(); i++)
+  {
+    t->GetEntry(i);
+    if (selected(h->eventNumber, cfg.fraction, cfg.seed)) entries.push_back(i);
+  }
+  if (split) t->SetBranchStatus("*", 1);
+
+  TString dir = TString::Format("%s/run%d", out_dir, run);
+  bool ok = !gSystem->mkdir(dir, true) || !gSystem->AccessPathName(dir);
+  if (!ok) std::cerr << "Couldn't create " << dir << std::endl;
+
+  if (ok) ok = writeEntries(t, "headerTree", entries, TString::Format("%s/decimatedHeadFile%d.root", dir.Data(), run), true);
+  t->ResetBranchAddresses();
+  delete h;
+
+  if (ok && cfg.events)
+  {
+    TString event_file = TString::Format("%s/run%d/eventFile%d.root", data_dir, run, run);
+    std::unique_ptr<TFile> ef(access(event_file, R_OK) ? nullptr : TFile::Open(event_file));
+    TTree * et = ef ? ef->Get<TTree>("eventTree") : nullptr;
+    if (!et || et->GetEntries() != t->GetEntries())
+    {
+      std::cerr << "No eventTree matching the headers in " << event_file << ", no decimated events for run " << run << std::endl;
+      ok = false;
+    }
+    else
+    {
+      pueo::RawEvent * ev = nullptr;
+      et->SetBranchAddress("event", &ev);
+      ok = writeEntries(et, "eventTree", entries, TString::Format("%s/decimatedEventFile%d.root", dir.Data(), run), false);
+      et->ResetBranchAddresses();
+      delete ev;
+    }
+  }
+
+  return ok ? (int64_t) entries.size() : -1;
+}
+
+int pueo::decimation::write(const char * data_dir, const std::vector<int> & runs, const Config & cfg, int nthreads, std::ostream * log)
+{
+  return pueo::runfiles::forEachRun(data_dir, runs, nthreads, [&](int run) { return writeRun(data_dir, run, cfg); }, log);
+}
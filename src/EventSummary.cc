@@ -0,0 +1,221 @@
+/****************************************************************************************
+*  EventSummary.cc            Per-channel waveform features and the summary files
+*
+*  (C) 2023-, The Payload for Ultrahigh Energy Observations (PUEO) Collaboration
+*
+*  This file is part of pueoEvent, the ROOT I/O library for PUEO.
+*
+*  pueoEvent is free software: you can redistribute it and/or modify it under the
+*  terms of the GNU General Public License as published by the Free Software
+*  Foundation, either version 2 of the License, or (at your option) any later
+*  version.
+*
+*  Foobar is distributed in the hope that it will be useful, but WITHOUT ANY
+*  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+*  A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+*
+*  You should have received a copy of the GNU General Public License along with
+*  Foobar. If not, see <https://www.gnu.org/licenses/
+*
+****************************************************************************************/
+
+#include "pueo/EventSummary.h"
+#include "pueo/RawEvent.h"
+#include "pueo/RunFiles.h"
+
+#include "TFile.h"
+#include "TTree.h"
+#include "TDirectory.h"
+#include "TSystem.h"
+#include "TString.h"
+
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <memory>
+#include <unistd.h>
+
+namespace
+{
+  // the real FFT of NUM_SAMPLES samples, as a complex FFT of half as many (even samples real, odd imaginary)
+  constexpr int N = pueo::k::NUM_SAMPLES;
+  constexpr int M = N / 2;
+  static_assert((M & (M - 1)) == 0, "NUM_SAMPLES has to be a power of two");
+
+  // sample period as in UsefulEvent
+  constexpr double kDtNs = 1/3.;
+
+  struct Tables
+  {
+    std::complex<double> twiddle[M / 2];   // e^(-2 pi i k / M), for the half size FFT
+    std::complex<double> unpack[M + 1];    // e^(-2 pi i k / N), to get the real FFT back out of it
+    int band[M + 1];                       // band of each frequency bin
+    double weight[M + 1];                  // so the band powers are mean squares
+
+    Tables()
+    {
+      for (int k = 0; k < M / 2; k++) twiddle[k] = std::polar(1., -2 * M_PI * k / M);
+      for (int k = 0; k <= M; k++)
+      {
+        unpack[k] = std::polar(1., -2 * M_PI * k / N);
+        double f = k * 1e3 / (N * kDtNs);
+        int b = 0;
+        while (b < pueo::EventSummary::NUM_BANDS - 1 && f >= pueo::EventSummary::kBandEdgesMHz[b + 1]) b++;
+        band[k] = b;
+        weight[k] = (k == 0 || k == M ? 1. : 2.) / ((double) N * N);
+      }
+    }
+  };
+
+  const Tables & tables()
+  {
+    static const Tables t;
+    return t;
+  }
+
+  void fft(std::complex<double> * z, const Tables & t)
+  {
+    for (int i = 1, j = 0; i < M; i++)
+    {
+      int bit = M >> 1;
+      for (; j & bit; bit >>= 1) j ^= bit;
+      j ^= bit;
+      if (i < j) std::swap(z[i], z[j]);
+    }
+
+    for (int len = 2; len <= M; len <<= 1)
+    {
+      int step = M / len;
+      for (int i = 0; i < M; i += len)
+      {
+        for (int k = 0; k < len / 2; k++)
+        {
+          std::complex<double> a = z[i + k];
+          std::complex<double> b = z[i + k + len / 2] * t.twiddle[k * step];
+          z[i + k] = a + b;
+          z[i + k + len / 2] = a - b;
+        }
+      }
+    }
+  }
+}
+
+pueo::EventSummary::EventSummary(const RawEvent & event)
+  : eventNumber(event.eventNumber), run(event.runNumber)
+{
+  for (int i = 0; i < k::NUM_DIGITIZED_CHANNELS; i++) fill(i, event.data[i].data());
+}
+
+#ifdef HAVE_PUEORAWDATA
+pueo::EventSummary::EventSummary(const pueo_full_waveforms_t * raw)
+  : eventNumber(raw->event), run(raw->run)
+{
+  static_assert(PUEO_NCHAN == pueo::k::NUM_DIGITIZED_CHANNELS);
+  for (int i = 0; i < k::NUM_DIGITIZED_CHANNELS; i++) fill(i, raw->wfs[i].data);
+}
+#endif
+
+void pueo::EventSummary::fill(int chan, const Short_t * samples)
+{
+  const Tables & t = tables();
+
+  double sum = 0, sum2 = 0;
+  Short_t lo = samples[0], hi = samples[0];
+  int nsat = 0;
+  std::complex<double> z[M];
+  for (int i = 0; i < N; i++)
+  {
+    Short_t s = samples[i];
+    sum += s;
+    sum2 += (double) s * s;
+    lo = std::min(lo, s);
+    hi = std::max(hi, s);
+    if (s >= kSaturation || s <= -kSaturation) nsat++;
+    if (i & 1) z[i / 2].imag(s);
+    else z[i / 2].real(s);
+  }
+
+  double m = sum / N;
+  mean[chan] = m;
+  rms[chan] = std::sqrt(std::max(0., sum2 / N - m * m));
+  peakToPeak[chan] = hi - lo;
+  maxAbs[chan] = std::max(std::abs(lo), std::abs(hi));
+  nSaturated[chan] = nsat;
+
+  fft(z, t);
+
+  double power[NUM_BANDS] = {};
+  for (int k = 0; k <= M; k++)
+  {
+    std::complex<double> a = z[k % M];
+    std::complex<double> b = std::conj(z[(M - k) % M]);
+    std::complex<double> X = 0.5 * (a + b) - 0.5 * std::complex<double>(0, 1) * t.unpack[k] * (a - b);
+    power[t.band[k]] += t.weight[k] * std::norm(X);
+  }
+  for (int b = 0; b < NUM_BANDS; b++) bandPower[chan][b] = power[b];
+}
+
+
+int64_t pueo::summary::writeRun(const char * data_dir, int run, const Config & cfg)
+{
+  const char * out_dir = cfg.out_dir ? cfg.out_dir : data_dir;
+
+  TString event_file = TString::Format("%s/run%d/eventFile%d.root", data_dir, run, run);
+  TDirectory::TContext ctx;
+  std::unique_ptr<TFile> f(access(event_file, R_OK) ? nullptr : TFile::Open(event_file));
+  TTree * t = f ? f->Get<TTree>("eventTree") : nullptr;
+  if (!t)
+  {
+    std::cerr << "No eventTree in " << event_file << " (RNTuples aren't supported here)" << std::endl;
+    return -1;
+  }
+
+  TString dir = TString::Format("%s/run%d", out_dir, run);
+  if (gSystem->mkdir(dir, true) && gSystem->AccessPathName(dir))
+  {
+    std::cerr << "Couldn't create " << dir << std::endl;
+    return -1;
+  }
+
+  TString fname = TString::Format("%s/summaryFile%d.root", dir.Data(), run);
+  Long64_t n = t->GetEntries();
+  bool ok = pueo::runfiles::writeAtomically(fname, [&](const char * tmp)
+  {
+    std::unique_ptr<TFile> out(TFile::Open(tmp, "RECREATE"));
+    if (!out || out->IsZombie())
+    {
+      std::cerr << "Couldn't create " << tmp << std::endl;
+      return false;
+    }
+    out->SetCompressionSettings(f->GetCompressionSettings());
+
+    pueo::RawEvent * ev = nullptr;
+    t->SetBranchAddress("event", &ev);
+
+    pueo::EventSummary * s = new pueo::EventSummary;
+    TTree * st = new TTree("summaryTree", "Per-channel waveform features");
+    st->Branch("summary", &s);
+
+    for (Long64_t i = 0; i < n; i++)
+    {
+      t->GetEntry(i);
+      *s = pueo::EventSummary(*ev);
+      st->Fill();
+    }
+
+    st->BuildIndex("eventNumber");
+    st->Write();
+    out->Close();
+
+    t->ResetBranchAddresses();
+    delete ev;
+    delete s;
+    return true;
+  });
+  return ok ? n : -1;
+}
+
+int pueo::summary::write(const char * data_dir, const std::vector<int> & runs, const Config & cfg, int nthreads, std::ostream * log)
+{
+  return pueo::runfiles::forEachRun(data_dir, runs, nthreads, [&](int run) { return writeRun(data_dir, run, cfg); }, log);
+}
@@ -0,0 +1,168 @@
+/****************************************************************************************
+*  Hsk.cc            Implementation of the PUEO housekeeping classes
+*
+*  Cosmin Deaconu <cozzyd@kicp.uchicago.edu>
+*
+*  (C) 2023-, The Payload for Ultrahigh Energy Observations (PUEO) Collaboration
+*
+*  This file is part of pueoEvent, the ROOT I/O library for PUEO.
+*
+*  pueoEvent is free software: you can redistribute it and/or modify it under the
+*  terms of the GNU General Public License as published by the Free Software
+*  Foundation, either version 2 of the License, or (at your option) any later
+*  version.
+*
+*  Foobar is distributed in the hope that it will be useful, but WITHOUT ANY
+*  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+*  A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+*
+*  You should have received a copy of the GNU General Public License along with
+*  Foobar. If not, see <https://www.gnu.org/licenses/
+*
+****************************************************************************************/
+
+#include "pueo/Hsk.h"
+
+#include "TFile.h"
+#include "TTree.h"
+#include "TDirectory.h"
+
+#include <cstring>
+#include <iostream>
+
+
+Float_t pueo::hsk::Reading::fval() const
+{
+  Float_t f;
+  static_assert(sizeof(f) == sizeof(raw));
+  memcpy(&f, &raw, sizeof(f));
+  return f;
+}
+
+double pueo::hsk::Reading::value(char typetag) const
+{
+  switch (typetag)
+  {
+    case 'f':
+    case 'F':
+      return fval();
+    case 'i':
+    case 'I':
+      return ival();
+    default:
+      return uval();
+  }
+}
+
+
+pueo::hsk::SensorDictionary::SensorDictionary(TDirectory * dir)
+{
+  if (!dir) dir = gDirectory;
+  if (dir) fTree = (TTree*) dir->Get(tree_name);
+  if (!fTree)
+  {
+    std::cerr << "No " << tree_name << " found, is this a compact hsk file?" << std::endl;
+  }
+}
+
+pueo::hsk::SensorDictionary::SensorDictionary(const char * file)
+{
+  TDirectory::TContext ctx;
+  fFile = TFile::Open(file);
+  if (fFile) fTree = (TTree*) fFile->Get(tree_name);
+  if (!fTree)
+  {
+    std::cerr << "No " << tree_name << " found in " << file << std::endl;
+  }
+}
+
+pueo::hsk::SensorDictionary::~SensorDictionary()
+{
+  delete fFile;
+}
+
+void pueo::hsk::SensorDictionary::load() const
+{
+  if (fLoaded) return;
+  fLoaded = true;
+  if (!fTree) return;
+
+  SensorInfo * info = nullptr;
+  fTree->SetBranchAddress("sensor", &info);
+  fInfos.reserve(fTree->GetEntries());
+  for (Long64_t i = 0; i < fTree->GetEntries(); i++)
+  {
+    fTree->GetEntry(i);
+    fInfos.push_back(*info);
+    if (info->sensor_id >= fIndex.size()) fIndex.resize(info->sensor_id + 1, -1);
+    fIndex[info->sensor_id] = fInfos.size() - 1;
+  }
+  fTree->ResetBranchAddresses();
+  delete info;
+}
+
+const pueo::hsk::SensorInfo * pueo::hsk::SensorDictionary::get(UShort_t id) const
+{
+  load();
+  if (id >= fIndex.size() || fIndex[id] < 0) return nullptr;
+  return &fInfos[fIndex[id]];
+}
+
+const char * pueo::hsk::SensorDictionary::name(UShort_t id) const
+{
+  const SensorInfo * info = get(id);
+  return info ? info->sens_name.c_str() : nullptr;
+}
+
+const char * pueo::hsk::SensorDictionary::subsystem(UShort_t id) const
+{
+  const SensorInfo * info = get(id);
+  return info ? info->subsys.c_str() : nullptr;
+}
+
+char pueo::hsk::SensorDictionary::typetag(UShort_t id) const
+{
+  const SensorInfo * info = get(id);
+  return info ? info->typetag : 0;
+}
+
+int pueo::hsk::SensorDictionary::find(const char * subsys, const char * name) const
+{
+  if (!name) return -1;
+  load();
+  for (const auto & info : fInfos)
+  {
+    if ((!subsys || info.subsys == subsys) && info.sens_name == name) return info.sensor_id;
+  }
+  return -1;
+}
+
+double pueo::hsk::SensorDictionary::value(const Reading & r) const
+{
+  return r.value(typetag(r.sensor_id));
+}
+
+pueo::hsk::Sensor pueo::hsk::SensorDictionary::expand(const Reading & r) const
+{
+  Sensor s;
+  s.sensor_id = r.sensor_id;
+  s.time_ms = r.time_ms;
+  s.time_secs = r.time_secs;
+  s.fval = r.fval();
+  s.ival = r.ival();
+  s.uval = r.uval();
+  if (const SensorInfo * info = get(r.sensor_id))
+  {
+    s.subsys = info->subsys;
+    s.sens_name = info->sens_name;
+    s.typetag = info->typetag;
+    s.kind_unit = info->kind_unit;
+  }
+  return s;
+}
+
+size_t pueo::hsk::SensorDictionary::size() const
+{
+  load();
+  return fInfos.size();
+}
@@ -0,0 +1,364 @@
+/****************************************************************************************
+*  RunCatalog.cc            Implementation of the PUEO run catalog
+*
+*  (C) 2023-, The Payload for Ultrahigh Energy Observations (PUEO) Collaboration
+*
+*  This file is part of pueoEvent, the ROOT I/O library for PUEO.
+*
+*  pueoEvent is free software: you can redistribute it and/or modify it under the
+*  terms of the GNU General Public License as published by the Free Software
+*  Foundation, either version 2 of the License, or (at your option) any later
+*  version.
+*
+*  Foobar is distributed in the hope that it will be useful, but WITHOUT ANY
+*  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+*  A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+*
+*  You should have received a copy of the GNU General Public License along with
+*  Foobar. If not, see <https://www.gnu.org/licenses/
+*
+****************************************************************************************/
+
+#include "pueo/RunCatalog.h"
+#include "pueo/RawHeader.h"
+#include "pueo/Dataset.h"
+#include "pueo/RunFiles.h"
+
+#include "TFile.h"
+#include "TTree.h"
+#include "TDirectory.h"
+#include "TROOT.h"
+
+#include <iostream>
+#include <algorithm>
+#include <vector>
+#include <string>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <limits>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace
+{
+  struct CatalogHeader
+  {
+    char magic[8];
+    uint32_t version;
+    uint32_t flight;
+    uint32_t flags;
+    uint32_t reserved;
+    uint64_t nruns;
+    uint64_t nranges;
+  };
+  static_assert(sizeof(CatalogHeader) == 40, "CatalogHeader must be packed the same everywhere");
+
+  const char kMagic[8] = {'P','U','E','O','R','C','A','T'};
+  const uint32_t kNotMonotonic = 1; // runs aren't in time / event number order, no binary searches
+}
+
+
+pueo::RunCatalog::RunCatalog(const char * file)
+{
+  int fd = open(file, O_RDONLY);
+  if (fd < 0) return;
+
+  struct stat st;
+  if (fstat(fd, &st) || (size_t) st.st_size < sizeof(CatalogHeader))
+  {
+    std::cerr << file << " is too short to be a run catalog" << std::endl;
+    close(fd);
+    return;
+  }
+
+  void * map = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED)
+  {
+    std::cerr << "Couldn't map " << file << std::endl;
+    return;
+  }
+  fMap = map;
+  fMapSize = st.st_size;
+
+  const CatalogHeader * h = (const CatalogHeader *) map;
+  if (memcmp(h->magic, kMagic, sizeof(kMagic)) || h->version != kVersion ||
+      fMapSize != sizeof(CatalogHeader) + h->nruns * sizeof(RunCatalogEntry) +
+                  (h->nruns + 1) * sizeof(uint64_t) + h->nranges * sizeof(RunCatalogEventRange))
+  {
+    std::cerr << file << " isn't a version " << kVersion << " run catalog" << std::endl;
+    return;
+  }
+
+  fFlight = h->flight;
+  fMonotonic = !(h->flags & kNotMonotonic);
+  fN = h->nruns;
+  fNRanges = h->nranges;
+  const char * p = (const char *) map + sizeof(CatalogHeader);
+  const RunCatalogEntry * entries = (const RunCatalogEntry *) p;
+  p += fN * sizeof(RunCatalogEntry);
+  fOffsets = (const uint64_t *) p;
+  p += (fN + 1) * sizeof(uint64_t);
+  fRanges = (const RunCatalogEventRange *) p;
+
+  if (fOffsets[fN] != fNRanges)
+  {
+    std::cerr << file << " has a corrupt event index" << std::endl;
+    return;
+  }
+  fEntries = entries;
+}
+
+pueo::RunCatalog::~RunCatalog()
+{
+  if (fMap) munmap(fMap, fMapSize);
+}
+
+const pueo::RunCatalogEntry * pueo::RunCatalog::find(int run) const
+{
+  auto it = std::lower_bound(begin(), end(), run, [](const RunCatalogEntry & e, int r) { return e.run < r; });
+  return it != end() && it->run == run ? it : nullptr;
+}
+
+int pueo::RunCatalog::runAtTime(double t) const
+{
+  if (!fMonotonic)
+  {
+    for (const auto & e : *this)
+    {
+      if (t >= e.start_time && t < e.end_time) return e.run;
+    }
+    return -1;
+  }
+
+  // first run ending after t, like pueo1_find_run did
+  auto it = std::upper_bound(begin(), end(), t, [](double t, const RunCatalogEntry & e) { return t < e.end_time; });
+  if (it == end()) return -1;
+  if (it == begin() && t < it->start_time) return -1;
+  return it->run;
+}
+
+int pueo::RunCatalog::runWithEvent(uint32_t event_number) const
+{
+  if (!fMonotonic)
+  {
+    for (const auto & e : *this)
+    {
+      if (event_number >= e.first_event && event_number <= e.last_event) return e.run;
+    }
+    return -1;
+  }
+
+  auto it = std::lower_bound(begin(), end(), event_number, [](const RunCatalogEntry & e, uint32_t ev) { return e.last_event < ev; });
+  if (it == end() || event_number < it->first_event) return -1;
+  return it->run;
+}
+
+bool pueo::RunCatalog::locate(uint32_t event_number, int * run, int64_t * entry) const
+{
+  auto search = [&](size_t i)
+  {
+    // the last range starting at or before the event
+    auto it = std::upper_bound(rangesBegin(i), rangesEnd(i), event_number,
+                               [](uint32_t ev, const RunCatalogEventRange & r) { return ev < r.first_event; });
+    if (it == rangesBegin(i)) return false;
+    --it;
+    if (event_number - it->first_event >= it->n) return false;
+
+    if (run) *run = fEntries[i].run;
+    if (entry) *entry = it->first_entry + (event_number - it->first_event);
+    return true;
+  };
+
+  if (fMonotonic)
+  {
+    auto it = std::lower_bound(begin(), end(), event_number, [](const RunCatalogEntry & e, uint32_t ev) { return e.last_event < ev; });
+    return it != end() && event_number >= it->first_event && search(it - begin());
+  }
+
+  for (size_t i = 0; i < fN; i++)
+  {
+    if (event_number >= fEntries[i].first_event && event_number <= fEntries[i].last_event && search(i)) return true;
+  }
+  return false;
+}
+
+
+// reads one header file in a single pass, false if there's nothing in it
+static bool catalogRun(const char * file, int run, pueo::RunCatalogEntry * e, std::vector<pueo::RunCatalogEventRange> * ranges)
+{
+  TDirectory::TContext ctx;
+  std::unique_ptr<TFile> f(TFile::Open(file));
+  TTree * t = f ? f->Get<TTree>("headerTree") : nullptr;
+  if (!t || !t->GetEntries()) return false;
+
+  // only read what we need, if the tree is split
+  if (t->GetBranch("triggerTime"))
+  {
+    t->SetBranchStatus("*", 0);
+    for (const char * b : {"header", "eventNumber", "triggerTime", "readoutTime", "corrected_trigger_time*"}) t->SetBranchStatus(b, 1);
+  }
+
+  pueo::RawHeader * h = nullptr;
+  t->SetBranchAddress("header", &h);
+
+  // the same fallbacks as generate-runinfo-header.py: corrected time, trigger time, readout time
+  int64_t min[3], max[3];
+  std::fill(min, min + 3, std::numeric_limits<int64_t>::max());
+  std::fill(max, max + 3, std::numeric_limits<int64_t>::min());
+  uint32_t first_event = std::numeric_limits<uint32_t>::max();
+  uint32_t last_event = 0;
+  std::vector<std::pair<uint32_t, uint32_t>> by_event(t->GetEntries()); // (eventNumber, entry)
+
+  for (Long64_t i = 0; i < t->GetEntries(); i++)
+  {
+    t->GetEntry(i);
+    int64_t times[3] = { h->corrected_trigger_time.GetSec(), h->triggerTime, h->readoutTime };
+    for (int j = 0; j < 3; j++)
+    {
+      min[j] = std::min(min[j], times[j]);
+      max[j] = std::max(max[j], times[j]);
+    }
+    first_event = std::min(first_event, h->eventNumber);
+    last_event = std::max(last_event, h->eventNumber);
+    by_event[i] = std::make_pair(h->eventNumber, (uint32_t) i);
+  }
+  t->ResetBranchAddresses();
+  delete h;
+
+  // blocks of consecutive event numbers at consecutive entries become one range
+  std::sort(by_event.begin(), by_event.end());
+  ranges->clear();
+  for (const auto & ev : by_event)
+  {
+    if (ranges->size())
+    {
+      pueo::RunCatalogEventRange & r = ranges->back();
+      if (ev.first == r.first_event + r.n && ev.second == r.first_entry + r.n)
+      {
+        r.n++;
+        continue;
+      }
+    }
+    ranges->push_back(pueo::RunCatalogEventRange { ev.first, ev.second, 1 });
+  }
+
+  int which = min[0] ? 0 : min[1] ? 1 : 2;
+  e->run = run;
+  e->flags = 0;
+  e->start_time = min[which];
+  e->end_time = max[which] + 1;
+  e->first_event = first_event;
+  e->last_event = last_event;
+  e->nentries = t->GetEntries();
+  return true;
+}
+
+int pueo::RunCatalog::build(const char * data_dir, const char * outfile, int flight, int nthreads)
+{
+  std::vector<int> runs;
+  if (!runfiles::findRuns(data_dir, &runs)) return -1;
+
+  if (nthreads > 1) ROOT::EnableThreadSafety();
+
+  std::vector<RunCatalogEntry> entries(runs.size());
+  std::vector<std::vector<RunCatalogEventRange>> ranges(runs.size());
+  std::vector<char> found(runs.size());
+  std::atomic<size_t> next(0);
+  auto worker = [&]()
+  {
+    for (size_t i = next++; i < runs.size(); i = next++)
+    {
+      std::string file = std::string(data_dir) + "/run" + std::to_string(runs[i]) + "/headFile" + std::to_string(runs[i]) + ".root";
+      if (access(file.c_str(), R_OK)) continue;
+      found[i] = catalogRun(file.c_str(), runs[i], &entries[i], &ranges[i]);
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (int i = 1; i < nthreads; i++) threads.emplace_back(worker);
+  worker();
+  for (auto & t : threads) t.join();
+
+  std::vector<RunCatalogEntry> catalog;
+  std::vector<uint64_t> offsets(1, 0);
+  for (size_t i = 0; i < runs.size(); i++)
+  {
+    if (!found[i]) continue;
+    catalog.push_back(entries[i]);
+    offsets.push_back(offsets.back() + ranges[i].size());
+  }
+
+  CatalogHeader h;
+  memcpy(h.magic, kMagic, sizeof(kMagic));
+  h.version = kVersion;
+  h.flight = flight;
+  h.flags = 0;
+  h.reserved = 0;
+  h.nruns = catalog.size();
+  h.nranges = offsets.back();
+
+  for (size_t i = 1; i < catalog.size(); i++)
+  {
+    if (catalog[i].end_time < catalog[i-1].end_time || catalog[i].first_event <= catalog[i-1].last_event)
+    {
+      std::cerr << "Run " << catalog[i].run << " is out of order with run " << catalog[i-1].run << ", lookups will be linear" << std::endl;
+      h.flags |= kNotMonotonic;
+      break;
+    }
+  }
+
+  // written to the side and renamed, so anyone with the old one mapped keeps a consistent view
+  bool ok = runfiles::writeAtomically(outfile, [&](const char * tmp)
+  {
+    FILE * f = fopen(tmp, "w");
+    if (!f)
+    {
+      std::cerr << "Couldn't open " << tmp << std::endl;
+      return false;
+    }
+    bool ok = fwrite(&h, sizeof(h), 1, f) == 1 &&
+              fwrite(catalog.data(), sizeof(RunCatalogEntry), catalog.size(), f) == catalog.size() &&
+              fwrite(offsets.data(), sizeof(uint64_t), offsets.size(), f) == offsets.size();
+    for (size_t i = 0; ok && i < runs.size(); i++)
+    {
+      if (found[i]) ok = fwrite(ranges[i].data(), sizeof(RunCatalogEventRange), ranges[i].size(), f) == ranges[i].size();
+    }
+    return !fclose(f) && ok;
+  });
+  if (!ok)
+  {
+    std::cerr << "Couldn't write " << outfile << std::endl;
+    return -1;
+  }
+
+  return catalog.size();
+}
+
+const pueo::RunCatalog * pueo::RunCatalog::forFlight(int flight)
+{
+  static std::mutex m;
+  static std::map<int, std::unique_ptr<RunCatalog>> catalogs;
+
+  std::lock_guard<std::mutex> lock(m);
+  auto it = catalogs.find(flight);
+  if (it == catalogs.end())
+  {
+    std::string file;
+    if (const char * env = getenv("PUEO_RUN_CATALOG")) file = env;
+    else if (const char * dir = Dataset::getDataDir((Dataset::DataDirectory) flight)) file = std::string(dir) + "/runcatalog.dat";
+
+    std::unique_ptr<RunCatalog> cat(file.size() ? new RunCatalog(file.c_str()) : nullptr);
+    if (cat && (!cat->valid() || cat->flight() != flight)) cat.reset();
+    it = catalogs.emplace(flight, std::move(cat)).first;
+  }
+  return it->second.get();
+}
@@ -0,0 +1,170 @@
+/****************************************************************************************
+*  RunFiles.cc                   Going over the run<N> directories of a data directory
+*
+*  (C) 2023-, The Payload for Ultrahigh Energy Observations (PUEO) Collaboration
+*
+*  This file is part of pueoEvent, the ROOT I/O library for PUEO.
+*
+*  pueoEvent is free software: you can redistribute it and/or modify it under the
+*  terms of the GNU General Public License as published by the Free Software
+*  Foundation, either version 2 of the License, or (at your option) any later
+*  version.
+*
+*  Foobar is distributed in the hope that it will be useful, but WITHOUT ANY
+*  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+*  A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+*
+*  You should have received a copy of the GNU General Public License along with
+*  Foobar. If not, see <https://www.gnu.org/licenses/
+*
+****************************************************************************************/
+
+#include "pueo/RunFiles.h"
+
+#include "TROOT.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <cstdio>
+#include <string.h>
+#include <stdlib.h>
+#include <dirent.h>
+#include <unistd.h>
+
+bool pueo::runfiles::findRuns(const char * data_dir, std::vector<int> * runs)
+{
+  DIR * dir = opendir(data_dir);
+  if (!dir)
+  {
+    std::cerr << "Couldn't open " << data_dir << std::endl;
+    return false;
+  }
+
+  size_t first = runs->size();
+  while (struct dirent * d = readdir(dir))
+  {
+    int run;
+    char extra;
+    if (sscanf(d->d_name, "run%d%c", &run, &extra) == 1) runs->push_back(run);
+  }
+  closedir(dir);
+  std::sort(runs->begin() + first, runs->end());
+  return true;
+}
+
+int pueo::runfiles::forEachRun(const char * data_dir, const std::vector<int> & which, int nthreads,
+                               const std::function<int64_t(int)> & fn, std::ostream * log)
+{
+  std::vector<int> runs = which;
+  if (runs.empty() && !findRuns(data_dir, &runs)) return -1;
+
+  if (nthreads > 1) ROOT::EnableThreadSafety();
+
+  std::atomic<size_t> next(0);
+  std::atomic<int> ndone(0);
+  std::atomic<int> nfailed(0);
+  std::mutex log_mutex;
+  auto worker = [&]()
+  {
+    for (size_t i = next++; i < runs.size(); i = next++)
+    {
+      int64_t n = fn(runs[i]);
+      if (n < 0)
+      {
+        nfailed++;
+        continue;
+      }
+      ndone++;
+      if (log)
+      {
+        std::lock_guard<std::mutex> lock(log_mutex);
+        *log << "run " << runs[i] << ": " << n << " events" << std::endl;
+      }
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (int i = 1; i < nthreads; i++) threads.emplace_back(worker);
+  worker();
+  for (auto & t : threads) t.join();
+
+  return nfailed ? -1 : (int) ndone;
+}
+
+bool pueo::runfiles::writeAtomically(const char * fname, const std::function<bool(const char *)> & write)
+{
+  std::string tmp = std::string(fname) + ".tmp";
+  if (!write(tmp.c_str()))
+  {
+    unlink(tmp.c_str());
+    return false;
+  }
+  if (rename(tmp.c_str(), fname))
+  {
+    perror(fname);
+    unlink(tmp.c_str());
+    return false;
+  }
+  return true;
+}
+
+void pueo::runfiles::toolUsage(const char * name, const char * extra_opts, const char * extra_help)
+{
+  std::cout << "Usage: " << name << " [-j nthreads] [-d rootdata] [-o outdir] " << extra_opts << "[run|first-last ...]\n"
+               "   -j   number of runs to do at once (default: number of cores)\n"
+               "   -d   directory with the run<N> directories (default: $PUEO_ROOT_DATA)\n"
+               "   -o   where to write the run<N> directories (default: rootdata)\n"
+            << extra_help
+            << "   With no runs, every run in rootdata is done.\n"
+            << std::endl;
+}
+
+bool pueo::runfiles::parseToolArgs(int nargs, char ** args, ToolArgs * targs, void (*usage)(),
+                                   const std::function<bool(int &)> & extra)
+{
+  targs->data_dir = getenv("PUEO_ROOT_DATA");
+  targs->nthreads = std::thread::hardware_concurrency();
+
+  for (int i = 1; i < nargs; i++)
+  {
+    int first, last;
+    bool has_value = i < nargs - 1;
+    if (!strcmp(args[i],"-j") && has_value) targs->nthreads = atoi(args[++i]);
+    else if (!strcmp(args[i],"-d") && has_value) targs->data_dir = args[++i];
+    else if (!strcmp(args[i],"-o") && has_value) targs->out_dir = args[++i];
+    else if (args[i][0] == '-' && extra && extra(i)) continue;
+    else if (sscanf(args[i], "%d-%d", &first, &last) == 2 && first <= last)
+    {
+      for (int run = first; run <= last; run++) targs->runs.push_back(run);
+    }
+    else if (args[i][0] != '-' && sscanf(args[i], "%d", &first) == 1) targs->runs.push_back(first);
+    else
+    {
+      usage();
+      return false;
+    }
+  }
+
+  if (!targs->data_dir)
+  {
+    std::cerr << "PUEO_ROOT_DATA not defined and no -d given" << std::endl;
+    usage();
+    return false;
+  }
+  if (targs->nthreads < 1) targs->nthreads = 1;
+  return true;
+}
+
+int pueo::runfiles::reportRuns(const std::function<int()> & write)
+{
+  auto start = std::chrono::steady_clock::now();
+  int n = write();
+
+  std::cout << (n < 0 ? "Failed on some runs" : "Wrote " + std::to_string(n) + " runs") << " in "
+            << std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() << " s" << std::endl;
+  return n < 0 ? 1 : 0;
+}
@@ -0,0 +1,522 @@
+/****************************************************************************************
+*  SharedEventCache.cc            Implementation of the node-local shared event cache
+*
+*  (C) 2023-, The Payload for Ultrahigh Energy Observations (PUEO) Collaboration
+*
+*  This file is part of pueoEvent, the ROOT I/O library for PUEO.
+*
+*  pueoEvent is free software: you can redistribute it and/or modify it under the
+*  terms of the GNU General Public License as published by the Free Software
+*  Foundation, either version 2 of the License, or (at your option) any later
+*  version.
+*
+*  Foobar is distributed in the hope that it will be useful, but WITHOUT ANY
+*  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+*  A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+*
+*  You should have received a copy of the GNU General Public License along with
+*  Foobar. If not, see <https://www.gnu.org/licenses/
+*
+****************************************************************************************/
+
+#include "pueo/SharedEventCache.h"
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace
+{
+  const char kMagic[8] = {'P','U','E','O','S','H','M','C'};
+  const uint32_t kVersion = 2;
+  const uint64_t kUnit = 256;          // records are allocated in these
+  const uint64_t kBytesPerSlot = 4096; // the table has a slot per this much room
+  const int kMaxAttached = 1024;
+  const int kSample = 16;              // records looked at to choose one to evict
+  const uint64_t kMaxScan = 1 << 16;   // units looked through for room before making some instead
+
+  uint64_t mix(uint64_t z)
+  {
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+  }
+
+  uint64_t hashKey(uint64_t file, int64_t entry, int32_t run, int32_t kind)
+  {
+    return mix(file + mix(entry + ((uint64_t) (uint32_t) run << 32) + ((uint64_t) kind << 24)));
+  }
+
+  uint64_t align(uint64_t n) { return (n + 63) & ~63ULL; }
+}
+
+struct pueo::SharedEventCache::Slot
+{
+  uint64_t file;
+  int64_t entry;
+  int32_t run;
+  int32_t kind;       // of the key plus one, 0 if the slot is empty
+  uint32_t size;      // bytes
+  uint32_t units;
+  uint64_t first;     // unit
+  uint64_t last_used;
+};
+
+struct pueo::SharedEventCache::Segment
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t ready;     // set once the creator is done setting it up
+  uint64_t map_size;
+  uint64_t nslots;
+  uint64_t nunits;
+  uint64_t slots_offset;
+  uint64_t bitmap_offset;
+  uint64_t owners_offset;
+  uint64_t data_offset;
+  pthread_mutex_t mutex;
+
+  // the rest only under the mutex
+  uint64_t clock;
+  uint64_t cursor;
+  uint64_t rng;
+  uint64_t records;
+  uint64_t units_used;
+  uint64_t hits;
+  uint64_t misses;
+  uint64_t insertions;
+  uint64_t evictions;
+  int32_t nattached;
+  int32_t attached[kMaxAttached];
+};
+
+class pueo::SharedEventCache::Lock
+{
+  public:
+    Lock(const SharedEventCache * c) : fCache(const_cast<SharedEventCache*>(c))
+    {
+      int r = pthread_mutex_lock(&fCache->fSegment->mutex);
+#ifdef __linux__
+      if (r == EOWNERDEAD)
+      {
+        // whoever died holding it may have been halfway through anything
+        pthread_mutex_consistent(&fCache->fSegment->mutex);
+        fCache->reset();
+      }
+#endif
+      (void) r;
+    }
+    ~Lock() { pthread_mutex_unlock(&fCache->fSegment->mutex); }
+
+  private:
+    SharedEventCache * fCache;
+};
+
+
+pueo::SharedEventCache::SharedEventCache(const char * name, size_t bytes)
+  : fName(name)
+{
+  uint64_t nunits = std::max<uint64_t>(bytes / kUnit, 64);
+  nunits = (nunits + 63) & ~63ULL; // whole bitmap words
+  uint64_t nslots = 1024;
+  while (nslots < bytes / kBytesPerSlot) nslots <<= 1;
+  uint64_t slots_offset = align(sizeof(Segment));
+  uint64_t bitmap_offset = align(slots_offset + nslots * sizeof(Slot));
+  uint64_t owners_offset = align(bitmap_offset + nunits / 8);
+  uint64_t data_offset = align(owners_offset + nunits * sizeof(uint32_t));
+  uint64_t size = data_offset + nunits * kUnit;
+
+  bool created = true;
+  int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+  if (fd < 0 && errno == EEXIST)
+  {
+    created = false;
+    fd = shm_open(name, O_RDWR, 0600);
+  }
+  if (fd < 0)
+  {
+    std::cerr << "Couldn't open shared memory " << name << ": " << strerror(errno) << std::endl;
+    return;
+  }
+
+  if (created)
+  {
+    // the pages are zero until they're used, so the table and bitmap start out empty
+    if (ftruncate(fd, size))
+    {
+      std::cerr << "Couldn't size shared memory " << name << ": " << strerror(errno) << std::endl;
+      close(fd);
+      shm_unlink(name);
+      return;
+    }
+  }
+  else
+  {
+    // whatever size the creator gave it, once it has
+    struct stat st;
+    for (int i = 0; i < 1000 && !fstat(fd, &st) && !st.st_size; i++) usleep(1000);
+    if (fstat(fd, &st) || st.st_size < (off_t) sizeof(Segment))
+    {
+      std::cerr << "Shared memory " << name << " isn't an event cache, not using it" << std::endl;
+      close(fd);
+      return;
+    }
+    size = st.st_size;
+  }
+
+  void * map = mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED)
+  {
+    std::cerr << "Couldn't map shared memory " << name << ": " << strerror(errno) << std::endl;
+    if (created) shm_unlink(name);
+    return;
+  }
+  Segment * seg = (Segment*) map;
+
+  if (created)
+  {
+    memcpy(seg->magic, kMagic, sizeof(kMagic));
+    seg->version = kVersion;
+    seg->map_size = size;
+    seg->nslots = nslots;
+    seg->nunits = nunits;
+    seg->slots_offset = slots_offset;
+    seg->bitmap_offset = bitmap_offset;
+    seg->owners_offset = owners_offset;
+    seg->data_offset = data_offset;
+    seg->rng = mix(getpid() + std::chrono::steady_clock::now().time_since_epoch().count());
+
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+#ifdef __linux__
+    pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+#endif
+    pthread_mutex_init(&seg->mutex, &attr);
+    pthread_mutexattr_destroy(&attr);
+
+    __atomic_store_n(&seg->ready, 1, __ATOMIC_RELEASE);
+  }
+  else
+  {
+    for (int i = 0; i < 1000 && !__atomic_load_n(&seg->ready, __ATOMIC_ACQUIRE); i++) usleep(1000);
+    if (!__atomic_load_n(&seg->ready, __ATOMIC_ACQUIRE) || memcmp(seg->magic, kMagic, sizeof(kMagic))
+        || seg->version != kVersion || seg->map_size != size)
+    {
+      std::cerr << "Shared memory " << name << " isn't a compatible event cache, not using it" << std::endl;
+      munmap(map, size);
+      return;
+    }
+  }
+
+  fSegment = seg;
+  fMapSize = size;
+  fSlots = (Slot*) ((char*) map + seg->slots_offset);
+  fBitmap = (uint64_t*) ((char*) map + seg->bitmap_offset);
+  fOwners = (uint32_t*) ((char*) map + seg->owners_offset);
+  fData = (char*) map + seg->data_offset;
+  attach();
+}
+
+pueo::SharedEventCache::~SharedEventCache()
+{
+  if (fSegment) detach();
+}
+
+void pueo::SharedEventCache::attach()
+{
+  Lock lock(this);
+
+  // forget processes that died without detaching
+  int n = 0;
+  for (int i = 0; i < fSegment->nattached; i++)
+  {
+    if (!kill(fSegment->attached[i], 0) || errno != ESRCH) fSegment->attached[n++] = fSegment->attached[i];
+  }
+  fSegment->nattached = n;
+  if (n < kMaxAttached) fSegment->attached[fSegment->nattached++] = getpid();
+}
+
+void pueo::SharedEventCache::detach()
+{
+  {
+    Lock lock(this);
+    pid_t me = getpid();
+    int n = 0;
+    bool removed = false;
+    for (int i = 0; i < fSegment->nattached; i++)
+    {
+      pid_t pid = fSegment->attached[i];
+      if (pid == me && !removed) removed = true;
+      else if (pid == me || !kill(pid, 0) || errno != ESRCH) fSegment->attached[n++] = pid;
+    }
+    fSegment->nattached = n;
+
+    // a process attaching right now keeps a private copy, which is harmless
+    const char * keep = getenv("PUEO_SHM_CACHE_KEEP");
+    if (!n && !(keep && atoi(keep))) shm_unlink(fName.c_str());
+  }
+
+  munmap(fSegment, fMapSize);
+  fSegment = nullptr;
+}
+
+pueo::SharedEventCache::Slot * pueo::SharedEventCache::find(const Key & key) const
+{
+  uint64_t mask = fSegment->nslots - 1;
+  for (uint64_t i = hashKey(key.file, key.entry, key.run, key.kind) & mask; fSlots[i].kind; i = (i + 1) & mask)
+  {
+    const Slot & s = fSlots[i];
+    if (s.file == key.file && s.entry == key.entry && s.run == key.run && s.kind == key.kind + 1) return &fSlots[i];
+  }
+  return nullptr;
+}
+
+void pueo::SharedEventCache::erase(Slot * s)
+{
+  release(s->first, s->units);
+  fSegment->records--;
+  fSegment->units_used -= s->units;
+
+  // linear probing without tombstones: move back whatever would no longer be found past the hole
+  uint64_t mask = fSegment->nslots - 1;
+  uint64_t i = s - fSlots;
+  for (uint64_t j = (i + 1) & mask; fSlots[j].kind; j = (j + 1) & mask)
+  {
+    const Slot & t = fSlots[j];
+    uint64_t home = hashKey(t.file, t.entry, t.run, t.kind - 1) & mask;
+    bool reachable = i <= j ? (home > i && home <= j) : (home > i || home <= j);
+    if (!reachable)
+    {
+      fSlots[i] = fSlots[j];
+      setOwner(&fSlots[i]);
+      i = j;
+    }
+  }
+  fSlots[i].kind = 0;
+}
+
+void pueo::SharedEventCache::setOwner(const Slot * s)
+{
+  for (uint64_t u = s->first; u < s->first + s->units; u++) fOwners[u] = s - fSlots;
+}
+
+// the least recently used of a random sample, nullptr if there are no records
+pueo::SharedEventCache::Slot * pueo::SharedEventCache::sampleVictim()
+{
+  if (!fSegment->records) return nullptr;
+
+  uint64_t mask = fSegment->nslots - 1;
+  Slot * victim = nullptr;
+  int seen = 0;
+  for (int tries = 0; seen < kSample && tries < 16 * kSample; tries++)
+  {
+    Slot * s = &fSlots[mix(fSegment->rng += 0x9e3779b97f4a7c15ULL) & mask];
+    if (!s->kind) continue;
+    seen++;
+    if (!victim || s->last_used < victim->last_used) victim = s;
+  }
+  for (uint64_t i = 0; !victim && i <= mask; i++)
+  {
+    if (fSlots[i].kind) victim = &fSlots[i];
+  }
+  return victim;
+}
+
+bool pueo::SharedEventCache::evictOne()
+{
+  Slot * victim = sampleVictim();
+  if (!victim) return false;
+  erase(victim);
+  fSegment->evictions++;
+  return true;
+}
+
+// Makes room for units in one go, rather than evicting a record at a time and looking for room again
+// after each: the room is where the least recently used of a sample starts, and whatever overlaps it goes.
+int64_t pueo::SharedEventCache::evictRange(uint64_t units)
+{
+  Slot * victim = sampleVictim();
+  uint64_t first = victim ? std::min(victim->first, fSegment->nunits - units) : 0;
+  for (uint64_t u = first; u < first + units; )
+  {
+    if (!((fBitmap[u >> 6] >> (u & 63)) & 1))
+    {
+      u++;
+      continue;
+    }
+    Slot * s = &fSlots[fOwners[u]];
+    u = s->first + s->units;
+    erase(s);
+    fSegment->evictions++;
+  }
+
+  for (uint64_t u = first; u < first + units; u++) fBitmap[u >> 6] |= 1ULL << (u & 63);
+  fSegment->cursor = first + units;
+  return first;
+}
+
+// first fit from where the last allocation ended, looking through at most max_scan units, or -1
+int64_t pueo::SharedEventCache::allocate(uint64_t units, uint64_t max_scan)
+{
+  uint64_t n = fSegment->nunits;
+  uint64_t i = fSegment->cursor < n ? fSegment->cursor : 0;
+  uint64_t run = 0;
+  for (uint64_t scanned = 0; scanned < std::min(n, max_scan); )
+  {
+    if (i == n)
+    {
+      i = 0;
+      run = 0;
+    }
+
+    // skip full words
+    if (!(i & 63) && fBitmap[i >> 6] == ~0ULL)
+    {
+      run = 0;
+      i += 64;
+      scanned += 64;
+      continue;
+    }
+
+    if ((fBitmap[i >> 6] >> (i & 63)) & 1) run = 0;
+    else if (++run == units)
+    {
+      uint64_t first = i + 1 - units;
+      for (uint64_t u = first; u <= i; u++) fBitmap[u >> 6] |= 1ULL << (u & 63);
+      fSegment->cursor = i + 1;
+      return first;
+    }
+    i++;
+    scanned++;
+  }
+  return -1;
+}
+
+void pueo::SharedEventCache::release(uint64_t first, uint64_t units)
+{
+  for (uint64_t u = first; u < first + units; u++) fBitmap[u >> 6] &= ~(1ULL << (u & 63));
+}
+
+void pueo::SharedEventCache::reset()
+{
+  memset(fSlots, 0, fSegment->nslots * sizeof(Slot));
+  memset(fBitmap, 0, fSegment->nunits / 8);
+  fSegment->records = 0;
+  fSegment->units_used = 0;
+  fSegment->cursor = 0;
+}
+
+bool pueo::SharedEventCache::get(const Key & key, std::vector<char> & out)
+{
+  if (!fSegment) return false;
+  Lock lock(this);
+
+  Slot * s = find(key);
+  if (!s)
+  {
+    fSegment->misses++;
+    return false;
+  }
+  s->last_used = ++fSegment->clock;
+  fSegment->hits++;
+  const char * data = fData + s->first * kUnit;
+  out.assign(data, data + s->size);
+  return true;
+}
+
+bool pueo::SharedEventCache::put(const Key & key, const void * data, size_t n)
+{
+  if (!fSegment || !n) return false;
+  uint64_t units = (n + kUnit - 1) / kUnit;
+  if (units > fSegment->nunits / 8) return false;
+
+  Lock lock(this);
+  if (find(key)) return true; // someone else got there first
+
+  // keep the table at most 3/4 full so probing stays short
+  while (fSegment->records >= fSegment->nslots / 4 * 3) evictOne();
+
+  int64_t first = allocate(units, kMaxScan + units);
+  if (first < 0) first = evictRange(units);
+  memcpy(fData + first * kUnit, data, n);
+
+  uint64_t mask = fSegment->nslots - 1;
+  uint64_t i = hashKey(key.file, key.entry, key.run, key.kind) & mask;
+  while (fSlots[i].kind) i = (i + 1) & mask;
+  Slot & s = fSlots[i];
+  s.file = key.file;
+  s.entry = key.entry;
+  s.run = key.run;
+  s.kind = key.kind + 1;
+  s.size = n;
+  s.units = units;
+  s.first = first;
+  s.last_used = ++fSegment->clock;
+  setOwner(&s);
+
+  fSegment->records++;
+  fSegment->units_used += units;
+  fSegment->insertions++;
+  return true;
+}
+
+void pueo::SharedEventCache::clear()
+{
+  if (!fSegment) return;
+  Lock lock(this);
+  reset();
+}
+
+pueo::SharedEventCache::Stats pueo::SharedEventCache::stats() const
+{
+  Stats st;
+  if (!fSegment) return st;
+  Lock lock(this);
+  st.hits = fSegment->hits;
+  st.misses = fSegment->misses;
+  st.insertions = fSegment->insertions;
+  st.evictions = fSegment->evictions;
+  st.records = fSegment->records;
+  st.bytes_used = fSegment->units_used * kUnit;
+  st.capacity = fSegment->nunits * kUnit;
+  st.attached = fSegment->nattached;
+  return st;
+}
+
+void pueo::SharedEventCache::print(std::ostream & os) const
+{
+  Stats st = stats();
+  uint64_t lookups = st.hits + st.misses;
+  os << "Shared event cache " << fName << ": " << st.records << " records, " << (st.bytes_used >> 20) << " of "
+     << (st.capacity >> 20) << " MB, " << st.hits << " hits (" << (lookups ? 100. * st.hits / lookups : 0) << "%), "
+     << st.misses << " misses, " << st.insertions << " insertions, " << st.evictions << " evictions, "
+     << st.attached << " processes attached" << std::endl;
+}
+
+pueo::SharedEventCache * pueo::SharedEventCache::instance()
+{
+  static std::unique_ptr<SharedEventCache> cache;
+  static std::once_flag once;
+  std::call_once(once, []()
+  {
+    const char * mb = getenv("PUEO_SHM_CACHE_MB");
+    if (!mb || atol(mb) <= 0) return;
+    const char * name = getenv("PUEO_SHM_CACHE_NAME");
+    std::string def = "/pueo-event-cache-" + std::to_string(getuid());
+    cache.reset(new SharedEventCache(name ? name : def.c_str(), (size_t) atol(mb) << 20));
+    if (!cache->valid()) cache.reset();
+  });
+  return cache.get();
+}
@@ -0,0 +1,448 @@
+/****************************************************************************************
+*  SyntheticFlight.cc            Implementation of the synthetic flight generator
+*
+*  (C) 2023-, The Payload for Ultrahigh Energy Observations (PUEO) Collaboration
+*
+*  This file is part of pueoEvent, the ROOT I/O library for PUEO.
+*
+*  pueoEvent is free software: you can redistribute it and/or modify it under the
+*  terms of the GNU General Public License as published by the Free Software
+*  Foundation, either version 2 of the License, or (at your option) any later
+*  version.
+*
+*  Foobar is distributed in the hope that it will be useful, but WITHOUT ANY
+*  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+*  A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+*
+*  You should have received a copy of the GNU General Public License along with
+*  Foobar. If not, see <https://www.gnu.org/licenses/
+*
+****************************************************************************************/
+
+#include "pueo/SyntheticFlight.h"
+#include "pueo/RawHeader.h"
+#include "pueo/RawEvent.h"
+#include "pueo/Nav.h"
+#include "pueo/Hsk.h"
+#include "pueo/DaqHsk.h"
+#include "pueo/Timemark.h"
+#include "pueo/Conventions.h"
+
+#include "TFile.h"
+#include "TTree.h"
+#include "TMath.h"
+
+#include <vector>
+#include <string>
+#include <random>
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <system_error>
+#include <cstdio>
+#include <cstdlib>
+#include <sys/stat.h>
+
+namespace
+{
+  struct Trigger
+  {
+    double subsecond;
+    uint32_t type;
+  };
+
+  /* The state of the TURF clock, carried from run to run */
+  struct Clock
+  {
+    uint32_t counter;
+    double freq; // Hz off nominal
+  };
+
+  /* Where the payload is at t seconds after the start of the flight: circling the
+   * pole once every two weeks, with some wobble in latitude and a diurnal altitude cycle */
+  void position(double t, pueo::nav::Attitude * att)
+  {
+    const double day = 86400;
+    att->latitude = -79 + 2 * sin(2 * TMath::Pi() * t / (5 * day));
+    att->longitude = fmod(167.2 + 360 * t / (14 * day), 360);
+    if (att->longitude > 180) att->longitude -= 360;
+    att->altitude = 37000 + 500 * sin(2 * TMath::Pi() * t / day);
+    att->heading = fmod(360 * t / 3600, 360);
+  }
+
+  /* The ticks of the seconds in [0, nsec], i.e. pps[i] is the counter at the start of second i */
+  void tick(Clock * clock, size_t nsec, double offset, double walk, std::mt19937 & rng,
+            std::vector<uint32_t> * pps, std::vector<double> * freq)
+  {
+    std::normal_distribution<double> step(0, walk);
+    pps->resize(nsec + 1);
+    freq->resize(nsec);
+    for (size_t i = 0; i < nsec; i++)
+    {
+      (*pps)[i] = clock->counter;
+      (*freq)[i] = pueo::timing::NOMINAL_CLOCK_FREQ + clock->freq;
+      clock->counter += (uint32_t) std::lround((*freq)[i]);
+
+      // a random walk, pulled back towards the offset so it stays within the builder's tolerances
+      clock->freq += (walk > 0 ? step(rng) : 0) - 0.01 * (clock->freq - offset);
+    }
+    (*pps)[nsec] = clock->counter;
+  }
+}
+
+
+int pueo::synthetic::writeFlight(const char * data_dir, const FlightConfig & cfg, FlightSummary * summary, std::ostream * log)
+{
+  TDirectory::TContext ctx;
+  FlightSummary sum;
+
+  std::mt19937 rng(cfg.seed);
+  std::uniform_real_distribution<double> uniform(0, 1);
+  std::normal_distribution<float> noise(0, cfg.noise_rms);
+
+  mkdir(data_dir, 0755);
+  std::string dir = data_dir;
+
+  // the timemarks are a flight-wide file, open throughout
+  TFile tm_file((dir + "/timemark.root").c_str(), "RECREATE");
+  if (!tm_file.IsOpen())
+  {
+    std::cerr << "Couldn't open " << dir << "/timemark.root" << std::endl;
+    return -1;
+  }
+  TTree * tm_tree = new TTree("timemarkTree", "timemarkTree");
+  Timemark * tm = new Timemark;
+  tm_tree->Branch("timemark", &tm);
+
+  Clock clock { (uint32_t) rng(), cfg.clock_offset };
+  uint32_t event_number = cfg.first_event;
+  uint16_t rise_count = 0;
+  const size_t nsec = std::max(1., std::ceil(cfg.run_length));
+
+  RawHeader * h = new RawHeader;
+  RawEvent * ev = new RawEvent;
+  nav::Attitude * att = new nav::Attitude;
+  hsk::Sensor * sensor = new hsk::Sensor;
+  daqhsk::DaqHsk * daq = new daqhsk::DaqHsk;
+
+  int ret = 0;
+  for (int irun = 0; irun < cfg.nruns && !ret; irun++)
+  {
+    const int run = cfg.first_run + irun;
+    const int32_t run_start = cfg.start_time + (int32_t) std::lround(irun * (nsec + cfg.run_gap));
+    const bool year1970 = uniform(rng) < cfg.year1970_run_prob;
+
+    std::string rundir = dir + "/run" + std::to_string(run);
+    mkdir(rundir.c_str(), 0755);
+
+    std::vector<uint32_t> pps;
+    std::vector<double> freq;
+    uint32_t before_first = clock.counter - (uint32_t) std::lround(timing::NOMINAL_CLOCK_FREQ + clock.freq);
+    tick(&clock, nsec, cfg.clock_offset, cfg.clock_walk, rng, &pps, &freq);
+
+    uint64_t run_events = 0;
+    uint64_t run_timemarks = 0;
+    uint64_t run_missing = 0;
+
+    /* headers and events, second by second */
+    {
+      std::string fname = rundir + "/headFile" + std::to_string(run) + ".root";
+      TFile head_file(fname.c_str(), "RECREATE");
+      if (!head_file.IsOpen())
+      {
+        std::cerr << "Couldn't open " << fname << std::endl;
+        ret = -1;
+        break;
+      }
+      TTree * head_tree = new TTree("headerTree", "headerTree");
+      head_tree->Branch("header", &h);
+
+      fname = rundir + "/eventFile" + std::to_string(run) + ".root";
+      TFile event_file(fname.c_str(), "RECREATE");
+      if (!event_file.IsOpen())
+      {
+        std::cerr << "Couldn't open " << fname << std::endl;
+        ret = -1;
+        break;
+      }
+      TTree * event_tree = new TTree("eventTree", "eventTree");
+      event_tree->Branch("event", &ev);
+      if (!cfg.waveforms) for (auto & chan : ev->data) chan.fill(0);
+
+      // (the mean of a poisson_distribution has to be > 0)
+      std::poisson_distribution<int> nrf(std::max(cfg.rf_rate, 1e-9));
+      std::poisson_distribution<int> nsoft(std::max(cfg.soft_rate, 1e-9));
+      std::vector<Trigger> triggers;
+
+      for (size_t isec = 0; isec < nsec; isec++)
+      {
+        const int32_t sec = run_start + isec;
+        triggers.clear();
+
+        for (int i = nrf(rng); i > 0; i--)
+        {
+          uint32_t pol = uniform(rng) < 0.5 ? trigger::kVPol : trigger::kHPol;
+          triggers.push_back(Trigger { uniform(rng), trigger::kRFMI | pol });
+        }
+        for (int i = nsoft(rng); i > 0; i--) triggers.push_back(Trigger { uniform(rng), trigger::kSoft });
+        if (cfg.pps_trigger) triggers.push_back(Trigger { 1e-6, trigger::kPPS0 });
+
+        // the timemark is recorded by the GPS even if the DAQ then loses the second
+        if (cfg.timemark_interval > 0 && uniform(rng) < 1. / cfg.timemark_interval)
+        {
+          double subsecond = uniform(rng);
+          triggers.push_back(Trigger { subsecond, trigger::kExt });
+
+          tm->rising = TTimeStamp((time_t) sec, (Int_t) (subsecond * 1e9));
+          tm->falling = TTimeStamp((time_t) sec, (Int_t) (subsecond * 1e9) + 1000);
+          tm->readout_time = TTimeStamp((time_t) sec + 1, (Int_t) (uniform(rng) * 1e9));
+          tm->rise_count = rise_count++;
+          tm->channel = 0;
+          tm->flags = 0;
+          tm_tree->Fill();
+          run_timemarks++;
+        }
+
+        if (uniform(rng) < cfg.missing_second_prob)
+        {
+          run_missing++;
+          continue;
+        }
+
+        std::sort(triggers.begin(), triggers.end(), [](const Trigger & l, const Trigger & r) { return l.subsecond < r.subsecond; });
+        for (const Trigger & trig : triggers)
+        {
+          // the CPU gets to it a little later
+          double readout = sec + trig.subsecond + 0.05 + 0.3 * uniform(rng);
+
+          *h = RawHeader();
+          h->run = run;
+          h->eventNumber = event_number;
+          h->trigType = trig.type;
+          h->triggerTime = year1970 ? (int32_t) isec + 1 : sec;
+          h->readoutTime = (int32_t) readout;
+          h->readoutTimeNs = (uint32_t) ((readout - std::floor(readout)) * 1e9);
+          h->lastPPS = pps[isec];
+          h->lastLastPPS = isec ? pps[isec-1] : before_first;
+          h->trigTime = pps[isec] + (uint32_t) (trig.subsecond * freq[isec]);
+          h->clock_frequency = freq[isec];
+          h->corrected_pps = pps[isec];
+          h->corrected_trigger_time = TTimeStamp((time_t) sec, (Int_t) (trig.subsecond * 1e9));
+          head_tree->Fill();
+
+          ev->eventNumber = event_number;
+          ev->runNumber = run;
+          if (cfg.waveforms)
+          {
+            for (auto & chan : ev->data)
+            {
+              for (auto & s : chan) s = (Short_t) noise(rng);
+            }
+          }
+          event_tree->Fill();
+
+          event_number++;
+          run_events++;
+        }
+      }
+
+      head_file.cd();
+      head_tree->Write();
+      event_file.cd();
+      event_tree->Write();
+    }
+
+    /* attitude */
+    {
+      std::string fname = rundir + "/gpsFile" + std::to_string(run) + ".root";
+      TFile f(fname.c_str(), "RECREATE");
+      if (!f.IsOpen())
+      {
+        std::cerr << "Couldn't open " << fname << std::endl;
+        ret = -1;
+        break;
+      }
+      TTree * t = new TTree("attitudeTree", "attitudeTree");
+      t->Branch("attitude", &att);
+
+      size_t n = cfg.attitude_rate > 0 ? nsec * cfg.attitude_rate : 0;
+      for (size_t i = 0; i < n; i++)
+      {
+        double when = run_start + i / cfg.attitude_rate;
+        *att = nav::Attitude();
+        att->source = 0;
+        att->realTime = (ULong_t) when;
+        att->realTimeNsecs = (UInt_t) ((when - std::floor(when)) * 1e9);
+        att->readoutTime = att->realTime;
+        att->readoutTimeNsecs = att->realTimeNsecs;
+        att->nSats = 12;
+        att->antennaCurrents.fill(0);
+        position(when - cfg.start_time, att);
+        att->pitch = 0.1 * sin(when);
+        att->roll = 0.1 * cos(when);
+        t->Fill();
+      }
+      t->Write();
+    }
+
+    /* housekeeping, in the verbose (hsk) format */
+    {
+      std::string fname = rundir + "/hsk.root";
+      TFile f(fname.c_str(), "RECREATE");
+      if (!f.IsOpen())
+      {
+        std::cerr << "Couldn't open " << fname << std::endl;
+        ret = -1;
+        break;
+      }
+      TTree * t = new TTree("hskTree", "hskTree");
+      t->Branch("hsk", &sensor);
+
+      size_t n = cfg.hsk_interval > 0 ? nsec / cfg.hsk_interval : 0;
+      for (size_t i = 0; i < n; i++)
+      {
+        double when = run_start + i * cfg.hsk_interval;
+        for (int s = 0; s < cfg.nsensors; s++)
+        {
+          sensor->which_sensor = s;
+          sensor->sensor_id = s;
+          sensor->time_secs = (UInt_t) when;
+          sensor->time_ms = (UShort_t) ((when - std::floor(when)) * 1000);
+          sensor->fval = 20 + 10 * sin(2 * TMath::Pi() * (when / 86400 + s * 0.1)) + uniform(rng);
+          sensor->ival = (Int_t) sensor->fval;
+          sensor->uval = (UInt_t) sensor->ival;
+          sensor->subsys = "synthetic";
+          sensor->sens_name = "sensor" + std::to_string(s);
+          sensor->typetag = 'f';
+          sensor->kind_unit = 'T';
+          t->Fill();
+        }
+      }
+      t->Write();
+    }
+
+    /* DAQ housekeeping, with the same clock as the headers */
+    {
+      std::string fname = rundir + "/daqhsk.root";
+      TFile f(fname.c_str(), "RECREATE");
+      if (!f.IsOpen())
+      {
+        std::cerr << "Couldn't open " << fname << std::endl;
+        ret = -1;
+        break;
+      }
+      TTree * t = new TTree("daqhskTree", "daqhskTree");
+      t->Branch("daqhsk", &daq);
+
+      *daq = daqhsk::DaqHsk();
+      daq->turfio_L1_rate = {};
+      daq->turfio_words_recv = {};
+      for (auto & surf : daq->Surfs)
+      {
+        surf.agc_scale.fill(0);
+        surf.agc_offset.fill(0);
+      }
+
+      std::poisson_distribution<int> scaler(std::max(1., cfg.rf_rate * 100));
+      size_t n = cfg.daqhsk_interval > 0 ? nsec / cfg.daqhsk_interval : 0;
+      for (size_t i = 0; i < n; i++)
+      {
+        size_t isec = std::min(nsec - 1, (size_t) (i * cfg.daqhsk_interval));
+        UInt_t sec = run_start + isec;
+        daq->l2_readout_time = sec;
+        daq->scaler_readout_time = sec;
+        for (auto & s : daq->H_scalers) s = scaler(rng);
+        for (auto & s : daq->V_scalers) s = scaler(rng);
+        daq->soft_rate = (UInt_t) std::lround(cfg.soft_rate);
+        daq->pps_rate = cfg.pps_trigger;
+        daq->ext_rate = cfg.timemark_interval > 0 ? 1 : 0;
+        daq->trigger_count = event_number;
+        daq->current_second = sec;
+        daq->last_pps = pps[isec];
+        daq->llast_pps = isec ? pps[isec-1] : before_first;
+        for (auto & surf : daq->Surfs)
+        {
+          surf.readoutTime = sec;
+          surf.ms_elapsed = (UInt_t) (isec * 1000);
+        }
+        t->Fill();
+      }
+      t->Write();
+    }
+
+    sum.nruns++;
+    sum.nevents += run_events;
+    sum.ntimemarks += run_timemarks;
+    sum.missing_seconds += run_missing;
+    sum.year1970_runs += year1970;
+    if (log)
+    {
+      *log << "run " << run << ": " << run_events << " events, " << run_timemarks << " timemarks, "
+           << run_missing << " missing seconds" << (year1970 ? ", event seconds from 1970" : "") << std::endl;
+    }
+  }
+
+  tm_file.cd();
+  tm_tree->Write();
+
+  delete h;
+  delete ev;
+  delete att;
+  delete sensor;
+  delete daq;
+  delete tm;
+
+  if (summary) *summary = sum;
+  return ret;
+}
+
+pueo::synthetic::ScratchDir::ScratchDir(const char * prefix, const std::string & dir)
+{
+  if (dir.size())
+  {
+    std::error_code ec;
+    std::filesystem::create_directories(dir, ec);
+    if (ec && !std::filesystem::is_directory(dir))
+    {
+      std::cerr << "Couldn't create " << dir << ": " << ec.message() << std::endl;
+      return;
+    }
+    fPath = dir;
+    return;
+  }
+
+  const char * tmpdir = getenv("TMPDIR");
+  std::string t = std::string(tmpdir ? tmpdir : "/tmp") + "/" + prefix + ".XXXXXX";
+  std::vector<char> buf(t.begin(), t.end());
+  buf.push_back(0);
+  if (!mkdtemp(&buf[0]))
+  {
+    perror("mkdtemp");
+    return;
+  }
+  fPath = &buf[0];
+  fOwned = true;
+}
+
+pueo::synthetic::ScratchDir::~ScratchDir()
+{
+  if (!fOwned || fKeep) return;
+  std::error_code ec;
+  std::filesystem::remove_all(fPath, ec);
+  if (ec) std::cerr << "Couldn't remove " << fPath << ": " << ec.message() << std::endl;
+}
+
+pueo::synthetic::ScratchFlight::ScratchFlight(const char * prefix, const FlightConfig & cfg, std::ostream * log,
+                                              const std::string & dir)
+  : ScratchDir(prefix, dir)
+{
+  if (!ok()) return;
+  if (log) *log << "Writing a synthetic flight to " << path() << std::endl;
+  if (writeFlight(path().c_str(), cfg))
+  {
+    std::cerr << "Couldn't write the synthetic flight" << std::endl;
+    return;
+  }
+  setenv("PUEO_ROOT_DATA", path().c_str(), 1);
+  fWritten = true;
+}
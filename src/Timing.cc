@@ -0,0 +1,792 @@
+/****************************************************************************************
+*  Timing.cc            Implementation of the PUEO trigger time correction
+*
+*  (C) 2023-, The Payload for Ultrahigh Energy Observations (PUEO) Collaboration
+*
+*  This file is part of pueoEvent, the ROOT I/O library for PUEO.
+*
+*  pueoEvent is free software: you can redistribute it and/or modify it under the
+*  terms of the GNU General Public License as published by the Free Software
+*  Foundation, either version 2 of the License, or (at your option) any later
+*  version.
+*
+*  Foobar is distributed in the hope that it will be useful, but WITHOUT ANY
+*  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+*  A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+*
+*  You should have received a copy of the GNU General Public License along with
+*  Foobar. If not, see <https://www.gnu.org/licenses/
+*
+****************************************************************************************/
+
+#include "pueo/Timing.h"
+#include "pueo/RawHeader.h"
+
+#include "TFile.h"
+#include "TTree.h"
+#include "TDirectory.h"
+#include "TString.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <algorithm>
+#include <memory>
+#include <set>
+#include <sys/stat.h>
+
+
+bool pueo::timing::TimeTable::load(const char * file)
+{
+  fRows.clear();
+  fHave.clear();
+  fN = 0;
+  fValid = false;
+
+  TDirectory::TContext ctx;
+  std::unique_ptr<TFile> f(TFile::Open(file));
+  TTree * t = f ? f->Get<TTree>("time_table_tree") : nullptr;
+  if (!t || !t->GetEntries())
+  {
+    std::cerr << "No time_table_tree in " << file << std::endl;
+    return false;
+  }
+
+  int32_t event_second = 0;
+  TimeTableRow row;
+  t->SetBranchAddress("event_second", &event_second);
+  t->SetBranchAddress("corrected_event_second", &row.corrected_event_second);
+  t->SetBranchAddress("avg_relative_delta", &row.avg_relative_delta);
+  t->SetBranchAddress("corrected_pps", &row.corrected_pps);
+
+  std::map<int32_t, TimeTableRow> rows;
+  for (Long64_t i = 0; i < t->GetEntries(); i++)
+  {
+    t->GetEntry(i);
+    rows.emplace(event_second, row); // first one wins
+  }
+
+  fFirst = rows.begin()->first;
+  fRows.resize((int64_t) rows.rbegin()->first - fFirst + 1);
+  fHave.resize(fRows.size());
+  for (const auto & r : rows)
+  {
+    fRows[r.first - fFirst] = r.second;
+    fHave[r.first - fFirst] = 1;
+  }
+  fN = rows.size();
+  fValid = rows.begin()->second.corrected_event_second != 0;
+
+  return true;
+}
+
+bool pueo::timing::TimeTable::correct(RawHeader & h) const
+{
+  if (!valid()) return false;
+  const TimeTableRow * row = find(h.triggerTime);
+  if (!row) return false;
+
+  h.clock_frequency = row->avg_relative_delta + NOMINAL_CLOCK_FREQ;
+  h.corrected_pps = row->corrected_pps;
+
+  // subsecond [clock counts], taking care of the wraparound
+  double subsecond = std::fmod(static_cast<double>(h.trigTime) - h.corrected_pps + static_cast<double>(UINT32_MAX) + 1.,
+                               static_cast<double>(UINT32_MAX) + 1);
+
+  subsecond = subsecond * 1e9 / h.clock_frequency; // subsecond [nanosec]
+
+  h.corrected_trigger_time = TTimeStamp((time_t) row->corrected_event_second, subsecond);
+  return true;
+}
+
+
+/*************************************************************************
+ * Building time tables (ported from make_time_table.C)
+ *************************************************************************/
+
+static inline int64_t toNs(const TTimeStamp & t) { return (int64_t) t.GetSec() * 1000000000LL + t.GetNanoSec(); }
+
+pueo::timing::TimemarkIndex::TimemarkIndex(const char * file)
+{
+  TDirectory::TContext ctx;
+  std::unique_ptr<TFile> f(TFile::Open(file));
+  TTree * t = f ? f->Get<TTree>("timemarkTree") : nullptr;
+  if (!t)
+  {
+    std::cerr << "No timemarkTree in " << file << std::endl;
+    return;
+  }
+
+  std::vector<Timemark> marks;
+  Timemark * tm = nullptr;
+  t->SetBranchAddress("timemark", &tm);
+  marks.reserve(t->GetEntries());
+  for (Long64_t i = 0; i < t->GetEntries(); i++)
+  {
+    t->GetEntry(i);
+    marks.push_back(*tm);
+  }
+  t->ResetBranchAddresses();
+  delete tm;
+  build(marks);
+}
+
+void pueo::timing::TimemarkIndex::build(const std::vector<Timemark> & marks)
+{
+  std::vector<size_t> order(marks.size());
+  for (size_t i = 0; i < order.size(); i++) order[i] = i;
+  std::stable_sort(order.begin(), order.end(), [&](size_t l, size_t r) { return toNs(marks[l].rising) < toNs(marks[r].rising); });
+
+  fMarks.reserve(marks.size());
+  fRising.reserve(marks.size());
+  fByReadout.reserve(marks.size());
+  for (size_t i = 0; i < order.size(); i++)
+  {
+    const Timemark & m = marks[order[i]];
+    fMarks.push_back(m);
+    fRising.push_back(toNs(m.rising));
+    fByReadout.emplace_back(m.readout_time.GetSec(), order[i], i);
+  }
+  std::sort(fByReadout.begin(), fByReadout.end());
+}
+
+size_t pueo::timing::TimemarkIndex::lowerBound(const TTimeStamp & t) const
+{
+  return std::lower_bound(fRising.begin(), fRising.end(), toNs(t)) - fRising.begin();
+}
+
+const pueo::Timemark * pueo::timing::TimemarkIndex::nearestRising(const TTimeStamp & t, int64_t max_dist_ns) const
+{
+  int64_t ns = toNs(t);
+  size_t i = lowerBound(t);
+
+  const Timemark * best = nullptr;
+  int64_t best_dist = max_dist_ns;
+  if (i < fRising.size() && fRising[i] - ns <= best_dist)
+  {
+    best = &fMarks[i];
+    best_dist = fRising[i] - ns;
+  }
+  if (i > 0 && ns - fRising[i-1] <= best_dist) best = &fMarks[i-1];
+  return best;
+}
+
+std::pair<const pueo::Timemark *, const pueo::Timemark *> pueo::timing::TimemarkIndex::range(const TTimeStamp & from, const TTimeStamp & to) const
+{
+  const Timemark * first = fMarks.data() + lowerBound(from);
+  const Timemark * last = fMarks.data() + lowerBound(to);
+  return std::make_pair(first, std::max(first, last));
+}
+
+const pueo::Timemark * pueo::timing::TimemarkIndex::nearest(int32_t readout_sec, int32_t max_dist) const
+{
+  auto first = std::lower_bound(fByReadout.begin(), fByReadout.end(), std::make_tuple((int64_t) readout_sec - max_dist, (size_t) 0, (size_t) 0));
+
+  const Timemark * best = nullptr;
+  int64_t best_dist = 0;
+  size_t best_order = 0;
+  for (auto it = first; it != fByReadout.end() && std::get<0>(*it) <= (int64_t) readout_sec + max_dist; ++it)
+  {
+    // ties go to the later one in the file
+    int64_t dist = std::abs(std::get<0>(*it) - readout_sec);
+    if (!best || dist < best_dist || (dist == best_dist && std::get<1>(*it) > best_order))
+    {
+      best = &fMarks[std::get<2>(*it)];
+      best_dist = dist;
+      best_order = std::get<1>(*it);
+    }
+  }
+  return best;
+}
+
+size_t pueo::timing::TimemarkIndex::match(std::vector<EventTime> events, int64_t tolerance_ns)
+{
+  std::sort(events.begin(), events.end(), [](const EventTime & l, const EventTime & r) { return l.ns < r.ns; });
+
+  // both sorted by time, so the window of candidate events only moves forward
+  size_t nmatched = 0;
+  size_t j = 0;
+  for (size_t i = 0; i < fMarks.size(); i++)
+  {
+    while (j < events.size() && events[j].ns < fRising[i] - tolerance_ns) j++;
+
+    const EventTime * best = nullptr;
+    int64_t best_dist = 0;
+    for (size_t k = j; k < events.size() && events[k].ns <= fRising[i] + tolerance_ns; k++)
+    {
+      int64_t dist = std::abs(events[k].ns - fRising[i]);
+      if (!best || dist < best_dist)
+      {
+        best = &events[k];
+        best_dist = dist;
+      }
+    }
+
+    if (best)
+    {
+      fMarks[i].run = best->run;
+      fMarks[i].event_number = best->event_number;
+      nmatched++;
+    }
+  }
+  return nmatched;
+}
+
+bool pueo::timing::TimemarkIndex::save(const char * file) const
+{
+  TDirectory::TContext ctx;
+  TFile f(file, "RECREATE");
+  if (!f.IsOpen())
+  {
+    std::cerr << "Couldn't open " << file << std::endl;
+    return false;
+  }
+
+  TTree * t = new TTree("timemarkTree", "timemarkTree");
+  Timemark * tm = new Timemark;
+  t->Branch("timemark", &tm);
+  for (const auto & m : fMarks)
+  {
+    *tm = m;
+    t->Fill();
+  }
+  f.Write();
+  delete tm;
+  return true;
+}
+
+int32_t pueo::timing::loadEventTimes(const char * header_file, std::vector<EventTime> * events, const TimeTable * table)
+{
+  TDirectory::TContext ctx;
+  std::unique_ptr<TFile> f(TFile::Open(header_file));
+  TTree * t = f ? f->Get<TTree>("headerTree") : nullptr;
+  if (!t)
+  {
+    std::cerr << "No headerTree in " << header_file << std::endl;
+    return ERR_NoHeaders;
+  }
+
+  // only read what we need, if the tree is split
+  if (t->GetBranch("triggerTime"))
+  {
+    t->SetBranchStatus("*", 0);
+    for (const char * b : {"header", "run", "eventNumber", "triggerTime", "lastPPS", "trigTime", "corrected_trigger_time*"}) t->SetBranchStatus(b, 1);
+  }
+
+  RawHeader * h = nullptr;
+  t->SetBranchAddress("header", &h);
+  events->reserve(events->size() + t->GetEntries());
+  for (Long64_t i = 0; i < t->GetEntries(); i++)
+  {
+    t->GetEntry(i);
+    if (table) table->correct(*h);
+    events->push_back(EventTime{h->run, h->eventNumber, toNs(h->corrected_trigger_time)});
+  }
+  t->ResetBranchAddresses();
+  delete h;
+  return 0;
+}
+
+int32_t pueo::timing::loadHeaderTimes(const char * header_file, std::vector<HeaderTimes> * headers)
+{
+  TDirectory::TContext ctx;
+  std::unique_ptr<TFile> f(TFile::Open(header_file));
+  TTree * t = f ? f->Get<TTree>("headerTree") : nullptr;
+  if (!t)
+  {
+    std::cerr << "No headerTree in " << header_file << std::endl;
+    return ERR_NoHeaders;
+  }
+
+  // only read what we need, if the tree is split
+  if (t->GetBranch("triggerTime"))
+  {
+    t->SetBranchStatus("*", 0);
+    for (const char * b : {"header", "run", "triggerTime", "readoutTime", "lastPPS", "trigTime"}) t->SetBranchStatus(b, 1);
+  }
+
+  RawHeader * h = nullptr;
+  t->SetBranchAddress("header", &h);
+  headers->reserve(t->GetEntries());
+  for (Long64_t i = 0; i < t->GetEntries(); i++)
+  {
+    t->GetEntry(i);
+    headers->push_back(HeaderTimes{h->run, h->triggerTime, h->readoutTime, h->lastPPS, h->trigTime});
+  }
+  t->ResetBranchAddresses();
+  delete h;
+  return 0;
+}
+
+int32_t pueo::timing::prepareTable(const std::vector<HeaderTimes> & headers, uint32_t * run, BuildTable * table,
+                                   BuildTable * invalid_seconds, std::ostream & log)
+{
+  // start by filling a table of event second vs. last pps
+  bool more_than_one_run = false;
+  for (const auto & h : headers)
+  {
+    if (table->find(h.triggerTime) != table->end()) continue;
+    if (table->empty()) *run = h.run;
+    else if (h.run != *run) more_than_one_run = true;
+
+    // the lastPPS of any event is the "this_pps" of its event second
+    SecondRow row;
+    row.run = h.run;
+    row.readout_time_sec = h.readoutTime;
+    row.this_pps = h.lastPPS;
+    table->emplace(h.triggerTime, row);
+  }
+
+  if (more_than_one_run) return ERR_MoreThanOneRun;
+  if (*run < (uint32_t) FIRST_AMP_RUN) return ERR_PreAmpRun;
+
+  // we need at least one valid second, i.e. 3 consecutive event seconds, since the first and last seconds are invalid
+  if (table->size() < 3) return ERR_TimeTableTooShort;
+
+  if (table->size() < 20)
+  {
+    printTable(table, log, false);
+    log << "Warning: small table (run " << *run << ")." << std::endl;
+  }
+
+  int32_t warning_code = 0;
+
+  // if a second is missing, add it as invalid
+  for (auto current = table->begin(); current != std::prev(table->end()); ++current)
+  {
+    auto next = std::next(current);
+    int32_t actual_next_second = current->first + 1;
+
+    // neither this second's delta nor the missing second's can be computed
+    if (actual_next_second != next->first)
+    {
+      SecondRow & missing = (*table)[actual_next_second];
+      missing.run = *run;
+      missing.missing = true;
+      missing.invalid_delta = true;
+      current->second.invalid_delta = true;
+      warning_code |= ERR_MissingSecond;
+    }
+  }
+
+  // compute next_pps and the delta of each valid second, moving the invalid ones out since we average later
+
+  // the first second's this_pps is garbage
+  auto first_second = table->begin();
+  first_second->second.this_pps = 0;
+  first_second->second.invalid_delta = true;
+  invalid_seconds->insert(table->extract(first_second));
+
+  for (auto current = table->begin(); current != std::prev(table->end());)
+  {
+    if (current->second.invalid_delta)
+    {
+      invalid_seconds->insert(table->extract(current++));
+    }
+    else
+    {
+      auto next = std::next(current);
+      current->second.next_pps = next->second.this_pps;
+      // unsigned so the wraparound is automatic, then signed so values below nominal are negative
+      uint32_t delta = current->second.next_pps - current->second.this_pps;
+      int32_t rel_delta = static_cast<int32_t>(delta) - NOMINAL_CLOCK_FREQ;
+      current->second.relative_delta = rel_delta;
+
+      if (std::abs(rel_delta) > 100) warning_code |= ERR_LargeDelta;
+      ++current;
+    }
+  }
+
+  // the last second has no next second
+  auto final_second = std::prev(table->end());
+  final_second->second.invalid_delta = true;
+  invalid_seconds->insert(table->extract(final_second));
+
+  return warning_code;
+}
+
+int32_t pueo::timing::checkEventSeconds(const BuildTable * table)
+{
+  for (const auto & sec : *table)
+  {
+    if (sec.first < LAUNCH_SECOND) return ERR_Year1970;
+  }
+  return 0;
+}
+
+int32_t pueo::timing::simpleMovingAverage(BuildTable * table, size_t half_width)
+{
+  if (half_width == 0) half_width = 5;
+  if (2 * half_width + 1 > table->size()) return ERR_TimeTableTooShort;
+
+  auto start = std::next(table->begin(), half_width);
+  auto stop = std::prev(table->end(), half_width);
+
+  // a running sum over the window, rather than summing it again for each second
+  double sum = 0;
+  for (auto jt = table->begin(); jt != std::next(start, half_width + 1); ++jt) sum += jt->second.relative_delta;
+
+  auto lo = table->begin();
+  auto hi = std::next(start, half_width + 1);
+  for (auto it = start; it != stop; ++it)
+  {
+    it->second.avg_relative_delta = sum / (2. * half_width + 1.);
+    if (hi == table->end()) break;
+    sum += hi->second.relative_delta - lo->second.relative_delta;
+    ++hi;
+    ++lo;
+  }
+
+  // the first and last few rows just take the nearest average
+  for (auto it = table->begin(); it != start; ++it) it->second.avg_relative_delta = start->second.avg_relative_delta;
+  for (auto it = stop; it != table->end(); ++it) it->second.avg_relative_delta = std::prev(stop)->second.avg_relative_delta;
+
+  return 0;
+}
+
+int32_t pueo::timing::findStableRegionMidPoint(BuildTable * table, BuildTable::iterator * anchor_point)
+{
+  if (table->empty()) return ERR_EmptyTable;
+
+  // somewhat arbitrary length of the stable period
+  size_t stable_length = table->size() < 50 ? 10 : table->size() / 5;
+
+  *anchor_point = table->begin();
+
+  std::vector<BuildTable::iterator> stable_seconds;
+  stable_seconds.reserve(stable_length);
+
+  for (auto it = table->begin(); it != table->end(); ++it)
+  {
+    if (stable_seconds.size() == stable_length) break;
+
+    if (std::fabs(it->second.relative_delta - it->second.avg_relative_delta) <= 20) stable_seconds.emplace_back(it);
+    else stable_seconds.clear();
+  }
+
+  if (stable_seconds.size() != stable_length)
+  {
+    (*anchor_point)->second.is_anchor_row = true;
+    return ERR_NoStableRegion;
+  }
+
+  *anchor_point = stable_seconds.at(stable_length / 2);
+  (*anchor_point)->second.is_anchor_row = true;
+  return 0;
+}
+
+void pueo::timing::insertInvalidSecondsBack(BuildTable * table, BuildTable * invalid_seconds)
+{
+  for (auto it = invalid_seconds->begin(); it != invalid_seconds->end();)
+  {
+    auto current = table->insert(invalid_seconds->extract(it++)).position;
+    if (current == table->begin())
+      current->second.avg_relative_delta = std::next(current)->second.avg_relative_delta;
+    else if (current == std::prev(table->end()))
+      current->second.avg_relative_delta = std::prev(current)->second.avg_relative_delta;
+    else
+      current->second.avg_relative_delta = (std::prev(current)->second.avg_relative_delta + std::next(current)->second.avg_relative_delta) / 2;
+  }
+}
+
+void pueo::timing::extrapolatePPS(BuildTable * table, const BuildTable::iterator & anchor_point)
+{
+  const double wrap = static_cast<double>(UINT32_MAX) + 1;
+  anchor_point->second.corrected_pps = anchor_point->second.this_pps;
+
+  // backwards from the anchor point
+  for (auto rit = std::make_reverse_iterator(anchor_point); rit != table->rend(); ++rit)
+  {
+    auto future = std::prev(rit);
+    rit->second.corrected_pps = std::fmod(future->second.corrected_pps - (NOMINAL_CLOCK_FREQ + rit->second.avg_relative_delta) + wrap, wrap);
+  }
+
+  // and forwards
+  for (auto it = std::next(anchor_point); it != table->end(); ++it)
+  {
+    auto past = std::prev(it);
+    it->second.corrected_pps = std::fmod(past->second.corrected_pps + (NOMINAL_CLOCK_FREQ + past->second.avg_relative_delta) + wrap, wrap);
+  }
+}
+
+int32_t pueo::timing::correctOneEventSecond(BuildTable * table, BuildTable::iterator * row,
+                                            const std::vector<HeaderTimes> & headers, const TimemarkIndex & timemarks)
+{
+  const Timemark * best = timemarks.nearest((*row)->second.readout_time_sec, 5);
+  if (!best) return ERR_NoNearbyTimemark;
+
+  // look for the event whose subsecond matches the timemark's, among those read out within a second of it
+  int64_t tm_sec = best->readout_time.GetSec();
+  auto first = std::lower_bound(headers.begin(), headers.end(), tm_sec - 1,
+      [](const HeaderTimes & h, int64_t sec) { return h.readoutTime < sec; });
+
+  const double wrap = static_cast<double>(UINT32_MAX) + 1;
+  std::map<double, const HeaderTimes *> maybe_timemarked_events;
+  for (auto h = first; h != headers.end() && h->readoutTime <= tm_sec + 1; ++h)
+  {
+    auto sec = table->find(h->triggerTime);
+    if (sec == table->end()) continue;
+
+    double avg_delta = static_cast<double>(NOMINAL_CLOCK_FREQ) + sec->second.avg_relative_delta;
+    double subsecond = std::fmod(static_cast<double>(h->trigTime) - sec->second.corrected_pps + wrap, wrap) / avg_delta * 1e9;
+
+    double diff = std::fabs(subsecond - best->rising.GetNanoSec());
+    if (diff < 200) maybe_timemarked_events[diff] = &*h;
+  }
+
+  if (maybe_timemarked_events.size() != 1) return ERR_NoMatchingSubsecond;
+
+  // use the timemark's second to correct the event second of the timemarked event
+  *row = table->find(maybe_timemarked_events.begin()->second->triggerTime);
+  (*row)->second.corrected_sec = static_cast<int32_t>(best->rising.GetSec());
+  (*row)->second.has_timestamp = true;
+
+  return (*row)->second.corrected_sec != (*row)->first ? ERR_NotIdentical : 0;
+}
+
+void pueo::timing::correctAllEventSeconds(BuildTable * table, int32_t first_corrected)
+{
+  auto first_good_row = table->find(first_corrected);
+  for (auto it = std::make_reverse_iterator(first_good_row); it != table->rend(); ++it)
+  {
+    it->second.corrected_sec = std::prev(it)->second.corrected_sec - 1;
+  }
+  for (auto it = std::next(first_good_row); it != table->end(); ++it)
+  {
+    if (!it->second.corrected_sec) it->second.corrected_sec = std::prev(it)->second.corrected_sec + 1;
+  }
+}
+
+void pueo::timing::printTable(const BuildTable * table, std::ostream & stream, bool color)
+{
+  if (color) stream << "\nColor:\e[1;34m Has GPS Timestamp \e[1;32m Anchor Row \e[1;33m Invalid Delta"
+                       "\e[1;31m (Inserted) Missing Second and Invalid Delta\e[0m\n"
+                       "Anchor row is where corrected_this_pps equals this_pps exactly.\n";
+  stream << "Relative delta is defined to be (next_pps - this_pps) - 125000000\n";
+  stream << "----------------------------------------------------------------------------------------------------------------------\n"
+         << "run      | event_second | corrected    | readout     | this_pps  | next_pps  | relative | avg. rel. | corrected  \n"
+         << "number   | from DAQ     | event_second | time (sec)  |           |           | delta    | delta     | this_pps   \n"
+         << "uint32_t | int32_t      | int32_t      | int32_t     | uint32_t  | uint32_t  | int32_t  | double    | double     \n"
+         << "----------------------------------------------------------------------------------------------------------------------\n";
+
+  const char * ws = " ";
+  for (const auto & row : *table)
+  {
+    if (color)
+    {
+      if (row.second.has_timestamp) ws = "\033[1;34m ";  // blue
+      else if (row.second.missing && row.second.invalid_delta) ws = "\033[1;31m ";  // red
+      else if (row.second.invalid_delta) ws = "\033[1;33m "; // yellow
+      else if (row.second.is_anchor_row) ws = "\033[1;32m "; // green
+      else ws = "\033[0m ";
+    }
+
+    stream << ws << std::setw(9)  << std::left << row.second.run
+           << ws << std::setw(14) << std::left << row.first
+           << ws << std::setw(14) << std::left << row.second.corrected_sec
+           << ws << std::setw(13) << std::left << row.second.readout_time_sec
+           << ws << std::setw(11) << row.second.this_pps
+           << ws << std::setw(11) << row.second.next_pps
+           << ws << std::setw(10) << row.second.relative_delta
+           << ws << std::setw(9)  << std::fixed << std::setprecision(2) << row.second.avg_relative_delta
+           << ws << std::setw(15) << std::right << std::fixed << std::setprecision(2) << row.second.corrected_pps << "\n";
+  }
+
+  stream << ws << "----------------------------------------------------------------------------------------------------------------------\n";
+  if (color) stream << "\033[0m";
+}
+
+bool pueo::timing::saveTable(const BuildTable * table, const char * file)
+{
+  TDirectory::TContext ctx;
+  TFile f(file, "RECREATE");
+  if (!f.IsOpen())
+  {
+    std::cerr << "Couldn't open " << file << std::endl;
+    return false;
+  }
+
+  TTree * t = new TTree("time_table_tree", "time_table_tree");
+
+  int32_t key;
+  SecondRow row;
+  t->Branch("run"                   , &row.run               );
+  t->Branch("event_second"          , &key                   );
+  t->Branch("corrected_event_second", &row.corrected_sec     );
+  t->Branch("readout_time_sec"      , &row.readout_time_sec  );
+  t->Branch("this_pps"              , &row.this_pps          );
+  t->Branch("next_pps"              , &row.next_pps          );
+  t->Branch("relative_delta"        , &row.relative_delta    );
+  t->Branch("avg_relative_delta"    , &row.avg_relative_delta);
+  t->Branch("corrected_pps"         , &row.corrected_pps     );
+  t->Branch("missing"               , &row.missing           );
+  t->Branch("invalid_delta"         , &row.invalid_delta     );
+  t->Branch("is_anchor_row"         , &row.is_anchor_row     );
+  t->Branch("has_timestamp"         , &row.has_timestamp     );
+
+  for (const auto & r : *table)
+  {
+    key = r.first;
+    row = r.second;
+    t->Fill();
+  }
+
+  f.Write();
+  return true;
+}
+
+int32_t pueo::timing::buildTimeTable(const char * header_file, const TimemarkIndex & timemarks,
+                                     const char * output_dir, std::ostream & log)
+{
+  std::vector<HeaderTimes> headers;
+  if (loadHeaderTimes(header_file, &headers)) return ERR_NoHeaders;
+
+  BuildTable table;
+  BuildTable invalid_seconds;
+  uint32_t run = 0;
+
+  int32_t err = prepareTable(headers, &run, &table, &invalid_seconds, log);
+  if (err & ERR_MoreThanOneRun)
+  {
+    log << "Fatal Error: cannot process " << header_file << "; I can only handle a single run at a time but more than one is found." << std::endl;
+    return ERR_MoreThanOneRun;
+  }
+
+  if (err & ERR_PreAmpRun)
+  {
+    log << "Note: run " << run << " is a pre-amp run and will be ignored." << std::endl;
+    return ERR_PreAmpRun;
+  }
+
+  if (err & ERR_TimeTableTooShort)
+  {
+    printTable(&table, log, false);
+    log << "Fatal Error: time table too short (run " << run << ")." << std::endl;
+    return ERR_TimeTableTooShort;
+  }
+
+  if (err & ERR_MissingSecond) log << "Warning: missing seconds inserted (run " << run << ")." << std::endl;
+  if (err & ERR_LargeDelta) log << "Warning: large pps delta detected (run " << run << ")." << std::endl;
+
+  if (simpleMovingAverage(&table))
+  {
+    printTable(&table, log, false);
+    log << "Fatal Error: can't compute average delta; time table too short (run " << run << ")." << std::endl;
+    return ERR_TimeTableTooShort;
+  }
+
+  BuildTable::iterator anchor_point;
+  switch (findStableRegionMidPoint(&table, &anchor_point))
+  {
+    case ERR_EmptyTable:
+      log << "Fatal Error: empty table (run " << run << ")." << std::endl;
+      return ERR_EmptyTable;
+    case ERR_NoStableRegion:
+      printTable(&table, log, false);
+      log << "Warning: couldn't find a stable region where `next_pps` - `this_pps` ≈ 125 million.\n"
+             "Will use the first second as the anchor point (run " << run << ")." << std::endl;
+      break;
+    default:
+      break;
+  }
+
+  insertInvalidSecondsBack(&table, &invalid_seconds);
+  extrapolatePPS(&table, anchor_point);
+
+  int32_t evt_sec_err = checkEventSeconds(&table);
+  if (evt_sec_err & ERR_Year1970)
+  {
+    log << "Warning: `event_second` < launch second " << LAUNCH_SECOND << " (run " << run << ")." << std::endl;
+  }
+
+  // the timemark matching looks for headers by readout time
+  std::stable_sort(headers.begin(), headers.end(), [](const HeaderTimes & l, const HeaderTimes & r) { return l.readoutTime < r.readoutTime; });
+
+  std::set<int32_t> corrected_seconds;
+  std::set<int32_t> accidentals;
+  size_t no_timemark = 0;
+  size_t no_subsecond = 0;
+  for (auto it = table.begin(); it != table.end(); ++it)
+  {
+    auto row = it; // may be moved to the row actually corrected
+    int32_t evt_corr_err = correctOneEventSecond(&table, &row, headers, timemarks);
+
+    if (evt_corr_err == 0 || ((evt_corr_err & ERR_NotIdentical) && (evt_sec_err & ERR_Year1970)))
+    {
+      corrected_seconds.insert(row->first);
+    }
+    else if (evt_corr_err & ERR_NoNearbyTimemark) no_timemark++;
+    else if (evt_corr_err & ERR_NoMatchingSubsecond) no_subsecond++;
+    else if (evt_corr_err & ERR_NotIdentical)
+    {
+      log << "Warning: found a timestamp for event_second " << row->first
+          << ", but the timestamp and the event_second are not identical (run " << run << ")." << std::endl;
+      row->second.corrected_sec = 0;
+      accidentals.insert(row->first);
+    }
+  }
+
+  log << "Run " << run << ": corrected " << corrected_seconds.size() << " event seconds with timemarks, "
+      << no_timemark << " had no nearby timemark, " << no_subsecond << " no matching subsecond." << std::endl;
+
+  if (corrected_seconds.size() < accidentals.size())
+  {
+    log << "Fatal Error: event second correction failed -- too many accidental matches (run " << run << ")." << std::endl;
+    return ERR_NoTimemarkAtAll;
+  }
+
+  if (accidentals.size())
+  {
+    log << "Total Number of accidentals: " << accidentals.size() << " (run " << run << ")." << std::endl;
+  }
+
+  if (corrected_seconds.empty() && (evt_sec_err & ERR_Year1970))
+  {
+    log << "Fatal Error: The `event_second` are clearly wrong and I have failed to correct any of them (run " << run << ")." << std::endl;
+    return ERR_Year1970;
+  }
+  else if (corrected_seconds.empty())
+  {
+    // this does happen for early runs, the table is still written but without corrected seconds
+    log << "Fatal Error: The `event_second` seem okay, but none of them is corrected because I have failed to find "
+           "a single timestamped event in this run (run " << run << ")." << std::endl;
+    evt_sec_err |= ERR_NoTimemarkAtAll;
+  }
+  else
+  {
+    correctAllEventSeconds(&table, *corrected_seconds.begin());
+  }
+
+  if (!(evt_sec_err & ERR_NoTimemarkAtAll))
+  {
+    int32_t prev_second = table.begin()->second.corrected_sec;
+    for (auto it = std::next(table.begin()); it != table.end(); ++it)
+    {
+      if (it->second.corrected_sec != ++prev_second)
+      {
+        log << "Fatal Error: The corrected `event_second` are not contiguous for some reason (run " << run << ")." << std::endl;
+        break;
+      }
+    }
+  }
+
+  if (output_dir)
+  {
+    std::string dir = output_dir;
+    for (size_t pos = dir.find('/', 1); ; pos = dir.find('/', pos + 1))
+    {
+      mkdir(dir.substr(0, pos).c_str(), 0755);
+      if (pos == std::string::npos) break;
+    }
+
+    std::ofstream fout(dir + "/time_table.txt");
+    printTable(&table, fout, false);
+    std::ofstream fout_color(dir + "/time_table_color.txt");
+    printTable(&table, fout_color, true);
+    saveTable(&table, (dir + "/time_table.root").c_str());
+  }
+
+  return 0;
+}
@@ -29,6 +29,7 @@
 
 #include <stdio.h>
 #include <iostream>
+#include <atomic>
 
 
 
@@ -39,7 +40,8 @@
 #ifdef THREADSAFE_PUEO_VERSION
   static __thread volatile int pueo_version = DEFAULT_PUEO_VERSION;
 #else 
-  static int volatile pueo_version = DEFAULT_PUEO_VERSION; 
+  /* otherwise it's shared, but at least reading and writing it from different threads is safe */
+  static std::atomic<int> pueo_version(DEFAULT_PUEO_VERSION); 
 #endif 
  
 
@@ -50,23 +52,22 @@ static const unsigned version_cutoffs[] =
   INT_MAX // hopefully PUEO will fly by 2038 
 }; 
 
-static bool firstTime = true;
+static std::atomic<bool> firstTime(true);
 
 void pueo::version::set(int v) 
 { 
 
-  if(firstTime || pueo_version!=v){
+  // don't print warning on AnitaVersion::get() if we called AnitaVersion::set(v)
+  if(firstTime.exchange(false) || pueo_version!=v){
     std::cerr << "pueoVersion=" << v << std::endl;
   }
   pueo_version = v;
-  firstTime = false; // don't print warning on AnitaVersion::get() if we called AnitaVersion::set(v)
 } 
 
 int pueo::version::get() 
 {
-  if(firstTime==true){
+  if(firstTime.exchange(false)){
     std::cerr << "pueoVersion=" << pueo_version << std::endl;
-    firstTime = false;
   }
 
   return pueo_version;
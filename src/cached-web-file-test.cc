@@ -0,0 +1,339 @@
+// cached-web-file-test: checks CachedWebFile against a local HTTP server
+//
+// Serves a synthetic run (see pueo/SyntheticFlight.h) with a minimal,
+// range-capable HTTP server on 127.0.0.1 in a thread, and reads it through
+// CachedWebFile twice: reads are rounded out to blocks, adjacent missing
+// blocks go out as one range, a null buffer only prefetches, the second
+// reader gets everything from the cache without asking the server, and what
+// comes back is byte for byte the local file. Then trim() has to bring the
+// cache back under a small limit. Fails if anything is off ("make web-cache-test").
+
+#include "pueo/CachedWebFile.h"
+#include "pueo/SyntheticFlight.h"
+#include "pueo/RawEvent.h"
+
+#include "TFile.h"
+#include "TTree.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <algorithm>
+#include <filesystem>
+#include <system_error>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+void usage()
+{
+  std::cout << "Usage: cached-web-file-test [-k]\n"
+               "   -k   keep the synthetic run and the cache afterwards\n"
+    << std::endl;
+}
+
+static int errors = 0;
+
+#define EXPECT(what, ...) if (!(what)) { fprintf(stderr, __VA_ARGS__); errors++; }
+
+/* Serves the files under root over HTTP/1.0, one request per connection, with single
+ * and multiple (multipart/byteranges) ranges. Counts the range requests it gets. */
+class RangeServer
+{
+  public:
+    RangeServer(const std::string & root) : fRoot(root)
+    {
+      fListen = socket(AF_INET, SOCK_STREAM, 0);
+      struct sockaddr_in addr = {};
+      addr.sin_family = AF_INET;
+      addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+      addr.sin_port = 0;
+      socklen_t addrlen = sizeof(addr);
+      if (fListen < 0 || bind(fListen, (struct sockaddr*) &addr, sizeof(addr)) || listen(fListen, 16)
+          || getsockname(fListen, (struct sockaddr*) &addr, &addrlen))
+      {
+        perror("web-cache-test server");
+        return;
+      }
+      fPort = ntohs(addr.sin_port);
+      fThread = std::thread(&RangeServer::serve, this);
+    }
+
+    ~RangeServer()
+    {
+      fStop = true;
+      if (fListen >= 0)
+      {
+        shutdown(fListen, SHUT_RDWR);
+        close(fListen);
+      }
+      if (fThread.joinable()) fThread.join();
+    }
+
+    int port() const { return fPort; }
+    int requests() const { return fRequests; }
+    int ranges() const { return fRanges; }
+
+  private:
+    void serve()
+    {
+      while (!fStop)
+      {
+        int fd = accept(fListen, nullptr, nullptr);
+        if (fd < 0) continue;
+        handle(fd);
+        close(fd);
+      }
+    }
+
+    static void sendAll(int fd, const std::string & s)
+    {
+      size_t sent = 0;
+      while (sent < s.size())
+      {
+        ssize_t n = send(fd, s.data() + sent, s.size() - sent, MSG_NOSIGNAL);
+        if (n <= 0) return;
+        sent += n;
+      }
+    }
+
+    void handle(int fd)
+    {
+      std::string req;
+      char buf[4096];
+      while (req.find("\r\n\r\n") == std::string::npos && req.size() < 65536)
+      {
+        ssize_t n = recv(fd, buf, sizeof(buf), 0);
+        if (n <= 0) return;
+        req.append(buf, n);
+      }
+
+      std::istringstream lines(req);
+      std::string method, target, line;
+      lines >> method >> target;
+      target = target.substr(0, target.find('?'));
+      std::vector<std::pair<long long, long long>> ranges;
+      while (std::getline(lines, line))
+      {
+        if (strncasecmp(line.c_str(), "Range: bytes=", 13)) continue;
+        std::istringstream spec(line.substr(13));
+        std::string r;
+        while (std::getline(spec, r, ','))
+        {
+          long long first, last;
+          if (sscanf(r.c_str(), "%lld-%lld", &first, &last) == 2) ranges.emplace_back(first, last);
+        }
+      }
+
+      std::ifstream f(fRoot + target, std::ios::binary);
+      if (target.find("..") != std::string::npos || !f)
+      {
+        sendAll(fd, "HTTP/1.0 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+        return;
+      }
+      std::string data((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+      long long size = data.size();
+      bool head = method == "HEAD";
+
+      if (ranges.empty())
+      {
+        sendAll(fd, "HTTP/1.0 200 OK\r\nContent-Length: " + std::to_string(size) + "\r\nConnection: close\r\n\r\n");
+        if (!head) sendAll(fd, data);
+        return;
+      }
+
+      fRequests++;
+      fRanges += ranges.size();
+      for (auto & r : ranges) r.second = std::min(r.second, size - 1);
+
+      auto contentRange = [size](const std::pair<long long, long long> & r)
+      {
+        return "Content-Range: bytes " + std::to_string(r.first) + "-" + std::to_string(r.second) + "/" + std::to_string(size) + "\r\n";
+      };
+
+      std::string body;
+      std::string type = "application/octet-stream";
+      if (ranges.size() == 1)
+      {
+        body = data.substr(ranges[0].first, ranges[0].second - ranges[0].first + 1);
+      }
+      else
+      {
+        const std::string boundary = "PUEOWEBCACHETEST";
+        for (const auto & r : ranges)
+        {
+          body += "\r\n--" + boundary + "\r\nContent-Type: application/octet-stream\r\n" + contentRange(r) + "\r\n";
+          body += data.substr(r.first, r.second - r.first + 1);
+        }
+        body += "\r\n--" + boundary + "--\r\n";
+        type = "multipart/byteranges; boundary=" + boundary;
+      }
+
+      std::string header = "HTTP/1.0 206 Partial Content\r\nContent-Type: " + type + "\r\n";
+      if (ranges.size() == 1) header += contentRange(ranges[0]);
+      header += "Content-Length: " + std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n";
+      sendAll(fd, header);
+      if (!head) sendAll(fd, body);
+    }
+
+    std::string fRoot;
+    int fListen = -1;
+    int fPort = 0;
+    std::atomic<bool> fStop{false};
+    std::atomic<int> fRequests{0};
+    std::atomic<int> fRanges{0};
+    std::thread fThread;
+};
+
+// the reads of the first pass: a bit of block 0, across the edge of blocks 0 and 1, and a bit of block 3
+static const Long64_t B = pueo::CachedWebFile::kBlockSize;
+static Long64_t read_pos[3] = { 100, B - 50, 3 * B + 10 };
+static Int_t read_len[3] = { 100, 100, 20 };
+
+static void checkReads(pueo::CachedWebFile & f, const std::string & local, const char * pass)
+{
+  std::vector<char> buf(220);
+  EXPECT(!f.ReadBuffers(buf.data(), read_pos, read_len, 3), "%s: ReadBuffers failed\n", pass);
+  size_t offset = 0;
+  for (int i = 0; i < 3; i++)
+  {
+    EXPECT(!memcmp(buf.data() + offset, local.data() + read_pos[i], read_len[i]),
+           "%s: bytes at %lld differ from the file\n", pass, (long long) read_pos[i]);
+    offset += read_len[i];
+  }
+}
+
+// every event of the served eventTree against the local one
+static void checkTree(TFile * web, const std::string & local_file, const char * pass)
+{
+  std::unique_ptr<TFile> local(TFile::Open(local_file.c_str()));
+  TTree * a = local ? local->Get<TTree>("eventTree") : nullptr;
+  TTree * b = web->Get<TTree>("eventTree");
+  EXPECT(a && b, "%s: no eventTree\n", pass);
+  if (!a || !b) return;
+  EXPECT(a->GetEntries() == b->GetEntries(), "%s: %lld entries instead of %lld\n", pass, b->GetEntries(), a->GetEntries());
+
+  pueo::RawEvent * ea = nullptr;
+  pueo::RawEvent * eb = nullptr;
+  a->SetBranchAddress("event", &ea);
+  b->SetBranchAddress("event", &eb);
+  for (Long64_t i = 0; i < std::min(a->GetEntries(), b->GetEntries()); i++)
+  {
+    a->GetEntry(i);
+    b->GetEntry(i);
+    bool same = ea->eventNumber == eb->eventNumber;
+    for (int c = 0; same && c < pueo::k::NUM_DIGITIZED_CHANNELS; c++) same = ea->data[c] == eb->data[c];
+    EXPECT(same, "%s: entry %lld differs from the file\n", pass, i);
+  }
+  a->ResetBranchAddresses();
+  b->ResetBranchAddresses();
+  delete ea;
+  delete eb;
+}
+
+static size_t cacheBytes(const std::string & dir)
+{
+  size_t total = 0;
+  std::error_code ec;
+  for (const auto & f : std::filesystem::recursive_directory_iterator(dir, ec))
+  {
+    if (f.is_regular_file(ec) && f.path().filename() != ".lock") total += f.file_size(ec);
+  }
+  return total;
+}
+
+int main(int nargs, char ** args)
+{
+  bool keep = false;
+  for (int i = 1; i < nargs; i++)
+  {
+    if (!strcmp(args[i],"-k")) keep = true;
+    else
+    {
+      usage();
+      return 1;
+    }
+  }
+
+  pueo::synthetic::FlightConfig cfg;
+  cfg.nruns = 1;
+  cfg.run_length = 20;
+  cfg.year1970_run_prob = 0;
+  pueo::synthetic::ScratchFlight flight("web-cache-test", cfg);
+  if (!flight.written()) return 1;
+  flight.keep(keep);
+
+  pueo::synthetic::ScratchDir cache("web-cache-test-cache");
+  if (!cache.ok()) return 1;
+  cache.keep(keep);
+  pueo::CachedWebFile::setCache(cache.path().c_str(), 10240);
+
+  RangeServer server(flight.path());
+  if (!server.port()) return 1;
+
+  std::string rel = "/run" + std::to_string(cfg.first_run) + "/eventFile" + std::to_string(cfg.first_run) + ".root";
+  std::string url = "http://127.0.0.1:" + std::to_string(server.port()) + rel;
+  std::ifstream in(flight.path() + rel, std::ios::binary);
+  std::string local((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+  EXPECT((Long64_t) local.size() > 4 * B, "the synthetic event file is only %zu bytes, too small to test with\n", local.size());
+  Long64_t last_block = (local.size() - 1) / B;
+
+  // first reader: everything comes from the server
+  {
+    pueo::CachedWebFile f(url.c_str());
+    EXPECT(!f.IsZombie(), "couldn't open %s\n", url.c_str());
+    if (f.IsZombie()) return 1;
+
+    int requests = server.requests();
+    int ranges = server.ranges();
+    checkReads(f, local, "first pass");
+    EXPECT(f.blocksFetched() == 3 && f.blocksFromCache() == 0,
+           "first pass: %lld blocks fetched and %lld from the cache, expected 3 and 0\n", f.blocksFetched(), f.blocksFromCache());
+    EXPECT(server.requests() - requests == 1 && server.ranges() - ranges == 2,
+           "first pass: %d requests for %d ranges, expected blocks 0-1 and 3 in one request\n",
+           server.requests() - requests, server.ranges() - ranges);
+
+    // a null buffer only prefetches
+    Long64_t pos = last_block * B;
+    Int_t len = 10;
+    EXPECT(!f.ReadBuffers(nullptr, &pos, &len, 1), "first pass: prefetch failed\n");
+    EXPECT(f.blocksFetched() == 4, "first pass: prefetch fetched %lld blocks in all, expected 4\n", f.blocksFetched());
+
+    checkTree(&f, flight.path() + rel, "first pass");
+  }
+
+  // second reader: nothing from the server
+  {
+    pueo::CachedWebFile f(url.c_str());
+    int requests = server.requests();
+    checkReads(f, local, "second pass");
+    Long64_t pos = last_block * B;
+    Int_t len = 10;
+    std::vector<char> buf(len);
+    EXPECT(!f.ReadBuffers(buf.data(), &pos, &len, 1) && !memcmp(buf.data(), local.data() + pos, len), "second pass: prefetched block differs\n");
+    EXPECT(f.blocksFromCache() == 4 && f.blocksFetched() == 0,
+           "second pass: %lld blocks from the cache and %lld fetched, expected 4 and 0\n", f.blocksFromCache(), f.blocksFetched());
+
+    checkTree(&f, flight.path() + rel, "second pass");
+    EXPECT(f.blocksFetched() == 0, "second pass: %lld blocks fetched reading the tree\n", f.blocksFetched());
+    EXPECT(server.requests() == requests, "second pass: %d range requests to the server\n", server.requests() - requests);
+  }
+
+  // trim back under 1 MB, least recently used first
+  pueo::CachedWebFile::setCache(cache.path().c_str(), 1);
+  pueo::CachedWebFile::trim();
+  EXPECT(cacheBytes(cache.path()) <= size_t(1 << 20) / 10 * 9, "trim left %zu bytes in the cache\n", cacheBytes(cache.path()));
+
+  std::cout << (errors ? "FAILED" : "OK") << " (" << errors << " errors)" << std::endl;
+  return errors ? 1 : 0;
+}
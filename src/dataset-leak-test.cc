@@ -1,35 +1,169 @@
+// dataset-leak-test: checks Dataset for leaks and for its memory footprint per run
+//
+// Constructs and destroys Datasets over and over (loading a run, reading
+// through it, switching to the next run, setting a cut) and fails if the
+// resident size keeps growing once it has warmed up, or if
+// Dataset::memoryUsage() ever goes over the limit. With a memory budget (-B),
+// it also fails if the caches don't keep within it.
+//
+// Without -r, it writes a small synthetic flight (see pueo/SyntheticFlight.h)
+// to a temporary directory and uses that, so it runs anywhere ("make leak-test").
+
 #include "pueo/Dataset.h"
-#include <time.h>
-#include <stdlib.h>
-#include <stdio.h>
+#include "pueo/DatasetStats.h"
+#include "pueo/SyntheticFlight.h"
+#include "pueo/RawHeader.h"
 
+#include "TCut.h"
 
-#include <sys/resource.h>
+#include <iostream>
+#include <string>
+#include <memory>
+#include <vector>
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
-void print_mem_usage() {
-    struct rusage usage;
-    if (getrusage(RUSAGE_SELF, &usage) == 0) {
-        // ru_maxrss is typically in kilobytes on Linux
-        printf("Memory usage: %ld KB\n", usage.ru_maxrss);
-    }
+void usage()
+{
+  std::cout << "Usage: dataset-leak-test [-r run] [-n rounds] [-w warmup] [-e events] [-L kb] [-F mb] [-B mb] [-k]\n"
+               "   -r   run to use, from PUEO_ROOT_DATA, along with the next one (default: a synthetic flight)\n"
+               "   -n   rounds of constructing and destroying a Dataset (default: 30)\n"
+               "   -w   rounds before the resident size is expected to stay flat (default: 5)\n"
+               "   -e   events to read per run per round (default: 100)\n"
+               "   -L   fail if the resident size grows by more than this many KB per round after warmup (default: 64)\n"
+               "   -F   fail if memoryUsage() of a Dataset goes over this many MB (default: 512)\n"
+               "   -B   set this memory budget in MB, and fail if the caches don't keep within it\n"
+               "   -k   keep the synthetic flight afterwards\n"
+    << std::endl;
+}
+
+// current, not peak, resident size
+static long rssKb()
+{
+  long pages = 0;
+  FILE * f = fopen("/proc/self/statm", "r");
+  if (f)
+  {
+    if (fscanf(f, "%*ld %ld", &pages) != 1) pages = 0;
+    fclose(f);
+  }
+  return pages * (sysconf(_SC_PAGESIZE) / 1024);
 }
 
 int main(int nargs, char ** args)
 {
-  int run = nargs > 1 ? atoi(args[1]) : 903;
+  int run = -1;
+  int rounds = 30;
+  int warmup = 5;
+  int nevents = 100;
+  double max_growth_kb = 64;
+  double max_footprint_mb = 512;
+  size_t budget_mb = 0;
+  bool keep = false;
 
-  int num = 0;
-  while (true)
+#define CHECK_NOT_LAST if (i == nargs -1) { usage(); return 1; }
+  for (int i = 1; i < nargs; i++)
   {
-    print_mem_usage();
-    printf("Instantiating Dataset round %d\n", num++);
-    pueo::Dataset d(run);
-    sleep(1);
+    if (!strcmp(args[i],"-r")) { CHECK_NOT_LAST run = atoi(args[++i]); }
+    else if (!strcmp(args[i],"-n")) { CHECK_NOT_LAST rounds = std::max(2, atoi(args[++i])); }
+    else if (!strcmp(args[i],"-w")) { CHECK_NOT_LAST warmup = std::max(0, atoi(args[++i])); }
+    else if (!strcmp(args[i],"-e")) { CHECK_NOT_LAST nevents = std::max(1, atoi(args[++i])); }
+    else if (!strcmp(args[i],"-L")) { CHECK_NOT_LAST max_growth_kb = atof(args[++i]); }
+    else if (!strcmp(args[i],"-F")) { CHECK_NOT_LAST max_footprint_mb = atof(args[++i]); }
+    else if (!strcmp(args[i],"-B")) { CHECK_NOT_LAST budget_mb = atol(args[++i]); }
+    else if (!strcmp(args[i],"-k")) keep = true;
+    else
+    {
+      usage();
+      return 1;
+    }
   }
 
-}
+  if (warmup >= rounds - 1) warmup = rounds - 2;
 
+  // declared out here so the flight is only removed at the end
+  std::unique_ptr<pueo::synthetic::ScratchFlight> flight;
+  if (run < 0)
+  {
+    pueo::synthetic::FlightConfig cfg;
+    cfg.nruns = 2;
+    cfg.run_length = 60;
+    cfg.year1970_run_prob = 0;
+    flight.reset(new pueo::synthetic::ScratchFlight("dataset-leak-test", cfg));
+    if (!flight->written()) return 1;
+    flight->keep(keep);
+    run = cfg.first_run;
+  }
+
+  int failures = 0;
+  uint64_t max_footprint = 0;
+  long rss_after_warmup = 0;
+
+  for (int round = 0; round < rounds; round++)
+  {
+    {
+      pueo::Dataset d(run);
+      if (!d.fRunLoaded)
+      {
+        std::cerr << "Couldn't load run " << run << std::endl;
+        failures++;
+        break;
+      }
+      if (budget_mb) d.setMemoryBudget(budget_mb << 20);
+
+      for (int r = run; r <= run + 1; r++)
+      {
+        if (r != run && !d.loadRun(r)) break;
+
+        int n = std::min(nevents, d.N());
+        for (int i = 0; i < n; i++)
+        {
+          if (i) d.next();
+          else d.first();
+          d.useful();
+        }
+        d.setCut(TCut("eventNumber % 3 == 0"));
+        for (int i = 0; i < std::min(10, d.NInCut()); i++) d.nthInCut(i);
 
+        pueo::DatasetMemory mem = d.memoryUsage();
+        max_footprint = std::max(max_footprint, mem.total());
+        if (round == 0) mem.print(std::cout);
 
+        if (mem.total() > max_footprint_mb * 1048576)
+        {
+          std::cerr << "Run " << r << ": memory usage over " << max_footprint_mb << " MB" << std::endl;
+          mem.print(std::cerr);
+          failures++;
+        }
 
+        // the caches can only shrink down to nothing, the rest isn't up to the budget
+        if (budget_mb && mem.caches && mem.total() > budget_mb << 20)
+        {
+          std::cerr << "Run " << r << ": caches over the " << budget_mb << " MB budget" << std::endl;
+          mem.print(std::cerr);
+          failures++;
+        }
+      }
+    }
+
+    long rss = rssKb();
+    printf("Round %d: resident %ld KB\n", round, rss);
+    if (round == warmup) rss_after_warmup = rss;
+    if (failures) break;
+  }
 
+  long rss_end = rssKb();
+  double growth = rounds - 1 > warmup ? double(rss_end - rss_after_warmup) / (rounds - 1 - warmup) : 0;
+  printf("Max memoryUsage(): %.1f MB, resident size growth after warmup: %.1f KB per round\n", max_footprint / 1048576., growth);
+  if (growth > max_growth_kb)
+  {
+    std::cerr << "Resident size grows by more than " << max_growth_kb << " KB per round" << std::endl;
+    failures++;
+  }
+
+  std::cout << (failures ? "FAILED" : "OK") << std::endl;
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,165 @@
+// dataset-thread-test: stress test of Datasets used from many threads at once
+//
+// Each thread has its own Dataset and goes through the runs of a flight,
+// reading every event in order, jumping to random events, setting cuts and
+// switching runs, checking that everything it reads is consistent (the
+// header and event belong together and to the run, event numbers are where
+// they should be, the cut selects what it should). Fails if anything is off,
+// or crashes, which is rather the point.
+//
+// Without -r, it writes a synthetic flight (see pueo/SyntheticFlight.h) to a
+// temporary directory and uses that, so it runs anywhere ("make thread-test").
+
+#include "pueo/Dataset.h"
+#include "pueo/SyntheticFlight.h"
+#include "pueo/RawHeader.h"
+#include "pueo/RawEvent.h"
+#include "pueo/UsefulEvent.h"
+
+#include "TCut.h"
+#include "TROOT.h"
+
+#include <iostream>
+#include <string>
+#include <memory>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <random>
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+void usage()
+{
+  std::cout << "Usage: dataset-thread-test [-j nthreads] [-n rounds] [-r first,n] [-k]\n"
+               "   -j   number of threads, each with its own Dataset (default: 8)\n"
+               "   -n   times each thread goes through the runs (default: 3)\n"
+               "   -r   runs to use from PUEO_ROOT_DATA (default: a synthetic flight of 4 runs)\n"
+               "   -k   keep the synthetic flight afterwards\n"
+    << std::endl;
+}
+
+static std::atomic<int> errors(0);
+
+#define EXPECT(what, ...) if (!(what)) { fprintf(stderr, __VA_ARGS__); errors++; }
+
+static void work(int ithread, int first_run, int nruns, int rounds)
+{
+  std::mt19937 rng(ithread);
+  pueo::Dataset d(first_run + ithread % nruns);
+  EXPECT(d.fRunLoaded, "thread %d: couldn't load run %d\n", ithread, first_run + ithread % nruns);
+  if (!d.fRunLoaded) return;
+
+  for (int round = 0; round < rounds; round++)
+  {
+    for (int i = 0; i < nruns; i++)
+    {
+      // each thread starts on a different run, so they're not all reading the same files
+      int run = first_run + (i + ithread) % nruns;
+      if (!d.loadRun(run))
+      {
+        EXPECT(false, "thread %d: couldn't load run %d\n", ithread, run);
+        continue;
+      }
+
+      UInt_t prev = 0;
+      for (int entry = 0; entry < d.N(); entry++)
+      {
+        d.getEntry(entry);
+        const pueo::RawHeader * h = d.header();
+        EXPECT((int) h->run == run, "thread %d: header of run %u in run %d\n", ithread, h->run, run);
+        EXPECT(!entry || h->eventNumber > prev, "thread %d: event %u after %u in run %d\n", ithread, h->eventNumber, prev, run);
+        prev = h->eventNumber;
+
+        // the waveforms are the expensive part, so not every time
+        if (entry % 8 == 0)
+        {
+          const pueo::RawEvent * ev = d.raw();
+          EXPECT(ev && ev->eventNumber == h->eventNumber, "thread %d: event %lu with header %u in run %d\n",
+                 ithread, ev ? ev->eventNumber : 0, h->eventNumber, run);
+          EXPECT(d.useful(), "thread %d: no UsefulEvent for event %u\n", ithread, h->eventNumber);
+        }
+      }
+
+      std::vector<UInt_t> events;
+      for (int entry = 0; entry < d.N(); entry++)
+      {
+        d.getEntry(entry);
+        events.push_back(d.header()->eventNumber);
+      }
+
+      if (events.size())
+      {
+        std::uniform_int_distribution<size_t> pick(0, events.size() - 1);
+        for (int j = 0; j < 50; j++)
+        {
+          UInt_t want = events[pick(rng)];
+          d.getEvent(want, true);
+          EXPECT(d.header()->eventNumber == want, "thread %d: asked for event %u, got %u\n", ithread, want, d.header()->eventNumber);
+        }
+      }
+
+      int nexpected = std::count_if(events.begin(), events.end(), [](UInt_t ev) { return ev % 3 == 0; });
+      int ncut = d.setCut(TCut("eventNumber % 3 == 0"));
+      EXPECT(ncut == nexpected, "thread %d: cut selected %d of run %d, expected %d\n", ithread, ncut, run, nexpected);
+      for (int j = 0; j < d.NInCut(); j++)
+      {
+        d.nthInCut(j);
+        EXPECT(d.header()->eventNumber % 3 == 0, "thread %d: event %u in the cut\n", ithread, d.header()->eventNumber);
+      }
+    }
+  }
+}
+
+int main(int nargs, char ** args)
+{
+  int nthreads = 8;
+  int rounds = 3;
+  int first_run = -1;
+  int nruns = 4;
+  bool keep = false;
+
+#define CHECK_NOT_LAST if (i == nargs -1) { usage(); return 1; }
+  for (int i = 1; i < nargs; i++)
+  {
+    if (!strcmp(args[i],"-j")) { CHECK_NOT_LAST nthreads = std::max(1, atoi(args[++i])); }
+    else if (!strcmp(args[i],"-n")) { CHECK_NOT_LAST rounds = std::max(1, atoi(args[++i])); }
+    else if (!strcmp(args[i],"-r"))
+    {
+      CHECK_NOT_LAST
+      if (sscanf(args[++i], "%d,%d", &first_run, &nruns) != 2 || nruns < 1) { usage(); return 1; }
+    }
+    else if (!strcmp(args[i],"-k")) keep = true;
+    else
+    {
+      usage();
+      return 1;
+    }
+  }
+
+  std::unique_ptr<pueo::synthetic::ScratchFlight> flight;
+  if (first_run < 0)
+  {
+    pueo::synthetic::FlightConfig cfg;
+    cfg.nruns = nruns;
+    cfg.run_length = 30;
+    cfg.year1970_run_prob = 0;
+    flight.reset(new pueo::synthetic::ScratchFlight("dataset-thread-test", cfg));
+    if (!flight->written()) return 1;
+    flight->keep(keep);
+    first_run = cfg.first_run;
+  }
+
+  ROOT::EnableThreadSafety();
+
+  std::cout << "Running " << nthreads << " threads" << std::endl;
+  std::vector<std::thread> threads;
+  for (int i = 0; i < nthreads; i++) threads.emplace_back(work, i, first_run, nruns, rounds);
+  for (auto & t : threads) t.join();
+
+  std::cout << (errors ? "FAILED" : "OK") << " (" << errors << " errors)" << std::endl;
+  return errors ? 1 : 0;
+}
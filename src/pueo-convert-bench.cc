@@ -0,0 +1,575 @@
+// pueo-convert-bench: conversion throughput benchmark
+//
+// Generates synthetic raw files for every raw type in PUEO_CONVERTIBLE_TYPES
+// (with realistic-ish sizes and some sort disorder), then runs the converter
+// on them for each requested codec/level and reports events/s, MB/s, peak RSS
+// and the compression ratio of the output tree.
+//
+// Each conversion runs in a forked child so that the peak RSS reported is
+// that of the conversion alone.
+
+#include "pueo/Converter.h"
+#include "pueo/Conventions.h"
+#include "pueo/SyntheticFlight.h"
+
+#include "TFile.h"
+#include "TTree.h"
+#include "TSystem.h"
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <random>
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <system_error>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+#include "pueo/rawdata.h"
+#include "pueo/rawio.h"
+#include "pueo/sensor_ids.h"
+
+typedef ROOT::RCompressionSetting::EAlgorithm::EValues algo_t;
+
+struct BenchOpts
+{
+  std::string workdir = "";
+  std::vector<std::string> tags;
+  std::vector<std::pair<algo_t,int>> codecs;
+  int nfiles = 4;
+  double scale = 1;
+  int disorder = 32; // packets are shuffled within windows of this size
+  unsigned seed = 1234;
+  bool keep = false;
+  const char * csv = nullptr;
+};
+
+void usage()
+{
+  std::cout << "Usage: pueo-convert-bench [-w workdir] [-t tag[,tag...]] [-c codec:level[,codec:level...]] [-n nfiles] [-x scale] [-d disorder] [-S seed] [-k] [-o out.csv]\n"
+               "   -w   working directory for synthetic raw and output files (default: a fresh directory under $TMPDIR)         \n"
+               "   -t   comma separated typetags to benchmark (default: all convertible types)                                \n"
+               "   -c   comma separated codec:level pairs, codec one of zlib, lzma, lz4, zstd (default: zlib:1,lz4:4,zstd:1,zstd:3,zstd:9,lzma:1)\n"
+               "   -n   number of raw files to split each type into (default: 4)                                              \n"
+               "   -x   scale factor on the default number of packets per type (default: 1)                                   \n"
+               "   -d   sort disorder: packets are shuffled within windows of this size, 0 disables (default: 32)            \n"
+               "   -S   random seed (default: 1234)                                                                           \n"
+               "   -k   keep the working directory afterwards (with -w, the raw files written to it)                          \n"
+               "   -o   also write results as CSV to this file                                                                \n"
+    << std::endl;
+}
+
+static bool parseCodec(const char * s, std::pair<algo_t,int> * codec)
+{
+  char name[16] = {0};
+  int level = 0;
+  if (sscanf(s, "%15[^:]:%d", name, &level) != 2) return false;
+
+  if (!strcasecmp(name,"zlib")) codec->first = ROOT::RCompressionSetting::EAlgorithm::kZLIB;
+  else if (!strcasecmp(name,"lzma")) codec->first = ROOT::RCompressionSetting::EAlgorithm::kLZMA;
+  else if (!strcasecmp(name,"lz4")) codec->first = ROOT::RCompressionSetting::EAlgorithm::kLZ4;
+  else if (!strcasecmp(name,"zstd")) codec->first = ROOT::RCompressionSetting::EAlgorithm::kZSTD;
+  else return false;
+
+  codec->second = level;
+  return true;
+}
+
+static const char * codecName(algo_t algo)
+{
+  switch (algo)
+  {
+    case ROOT::RCompressionSetting::EAlgorithm::kZLIB: return "zlib";
+    case ROOT::RCompressionSetting::EAlgorithm::kLZMA: return "lzma";
+    case ROOT::RCompressionSetting::EAlgorithm::kLZ4: return "lz4";
+    case ROOT::RCompressionSetting::EAlgorithm::kZSTD: return "zstd";
+    default: return "other";
+  }
+}
+
+static std::vector<std::string> split(const char * s)
+{
+  std::vector<std::string> v;
+  std::string cur;
+  for (const char * c = s; ; c++)
+  {
+    if (!*c || *c == ',')
+    {
+      if (cur.size()) v.push_back(cur);
+      cur.clear();
+      if (!*c) break;
+    }
+    else cur += *c;
+  }
+  return v;
+}
+
+
+/* Synthetic packet fillers.
+ *
+ * i is the (time-ordered) packet index, t0 the start of the fake run. The
+ * contents only need to look plausible enough that compression ratios mean
+ * something, so waveforms are gaussian noise, times increase and slowly varying
+ * quantities wander a bit.
+ */
+
+static const int32_t t0 = 1766163240;
+
+static void fill(pueo_full_waveforms_t * wf, size_t i, std::mt19937 & rng)
+{
+  std::normal_distribution<float> noise(0, 20);
+  wf->run = 1000;
+  wf->event = 100000 + i;
+  // roughly 100 Hz
+  wf->event_second = t0 + i / 100;
+  wf->last_pps = (uint32_t) (wf->event_second - t0) * 125000000u;
+  wf->llast_pps = wf->last_pps - 125000000u;
+  wf->event_time = wf->last_pps + (i % 100) * 1250000u;
+  wf->deadtime_counter = i * 10;
+  wf->deadtime_counter_last_pps = wf->deadtime_counter;
+  wf->deadtime_counter_llast_pps = wf->deadtime_counter;
+  wf->L2_mask = (i % 10) ? 1 : 0;
+  wf->soft_trigger = !wf->L2_mask;
+  wf->readout_time.utc_secs = wf->event_second + 1;
+  wf->readout_time.utc_nsecs = (i % 100) * 10000000;
+
+  for (int ichan = 0; ichan < PUEO_NCHAN; ichan++)
+  {
+    for (int isamp = 0; isamp < pueo::k::NUM_SAMPLES; isamp++)
+    {
+      wf->wfs[ichan].data[isamp] = (int16_t) noise(rng);
+    }
+  }
+}
+
+static void fill(pueo_nav_att_t * att, size_t i, std::mt19937 & rng)
+{
+  std::normal_distribution<float> jitter(0, 0.01);
+  att->source = i % 3;
+  att->gps_time.utc_secs = t0 + i / 5;
+  att->gps_time.utc_nsecs = (i % 5) * 200000000;
+  att->readout_time.utc_secs = att->gps_time.utc_secs;
+  att->readout_time.utc_nsecs = att->gps_time.utc_nsecs + 1000000;
+  att->nsats = 12;
+  att->lat = -77.86 + i * 1e-6 + jitter(rng);
+  att->lon = 167.2 + i * 1e-5 + jitter(rng);
+  att->alt = 37000 + 100*jitter(rng);
+  att->heading = fmod(i * 0.01, 360);
+  att->pitch = jitter(rng);
+  att->roll = jitter(rng);
+  att->heading_sigma = 0.1;
+  att->pitch_sigma = 0.1;
+  att->roll_sigma = 0.1;
+  att->vdop = 1.2;
+  att->hdop = 0.9;
+  att->flags = 0;
+  att->temperature = 20;
+  for (int j = 0; j < 3; j++) att->antenna_currents[j] = 100 + j;
+}
+
+static void fill(pueo_ss_t * ss, size_t i, std::mt19937 & rng)
+{
+  std::uniform_int_distribution<unsigned> adc(1000,1100);
+  ss->readout_time.utc_secs = t0 + i / 10;
+  ss->readout_time.utc_nsecs = (i % 10) * 100000000;
+  ss->sequence_number = i;
+  ss->flags = 0;
+  for (int j = 0; j < 8; j++)
+  {
+    ss->ss[j].x1 = adc(rng);
+    ss->ss[j].x2 = adc(rng);
+    ss->ss[j].y1 = adc(rng);
+    ss->ss[j].y2 = adc(rng);
+    ss->ss[j].tempADS1220 = 300;
+    ss->ss[j].tempSS = 290;
+  }
+}
+
+static void fill(pueo_sensors_disk_t * disk, size_t i, std::mt19937 & rng)
+{
+  // only use sensor ids that actually have a name, otherwise the converter rightfully complains
+  static std::vector<uint16_t> valid_ids;
+  if (!valid_ids.size())
+  {
+    for (int id = 0; id < PUEO_MAX_SENSORS; id++)
+    {
+      const char * name = pueo_sensor_id_get_name(id);
+      if (name && *name) valid_ids.push_back(id);
+    }
+  }
+
+  std::normal_distribution<float> value(25, 2);
+  const int capacity = sizeof(disk->sensors) / sizeof(disk->sensors[0]);
+  disk->num_packets = capacity;
+  for (int j = 0; j < capacity; j++)
+  {
+    disk->sensors[j].sensor_id = valid_ids.size() ? valid_ids[(i * capacity + j) % valid_ids.size()] : 0;
+    disk->sensors[j].time_secs = t0 + i;
+    disk->sensors[j].time_ms = j;
+    disk->sensors[j].val.fval = value(rng);
+  }
+}
+
+static void fill(pueo_daq_hsk_t * hsk, size_t i, std::mt19937 & rng)
+{
+  std::poisson_distribution<unsigned> rate(100);
+  hsk->l2_readout_time.utc_secs = t0 + i;
+  hsk->scaler_readout_time.utc_secs = t0 + i;
+  hsk->soft_rate = 1;
+  hsk->pps_rate = 1;
+  hsk->current_second = t0 + i;
+  for (size_t j = 0; j < sizeof(hsk->Hscalers) / sizeof(hsk->Hscalers[0]); j++)
+  {
+    hsk->Hscalers[j] = rate(rng);
+    hsk->Vscalers[j] = rate(rng);
+  }
+  for (size_t s = 0; s < sizeof(hsk->surfs) / sizeof(hsk->surfs[0]); s++)
+  {
+    hsk->surfs[s].readout_time_start.utc_secs = t0 + i;
+    hsk->surfs[s].surf_slot = s;
+    for (size_t b = 0; b < sizeof(hsk->surfs[s].beams) / sizeof(hsk->surfs[s].beams[0]); b++)
+    {
+      hsk->surfs[s].beams[b].threshold = 5000 + b;
+      hsk->surfs[s].beams[b].scaler = rate(rng);
+    }
+  }
+}
+
+static void fill(pueo_timemark_t * tm, size_t i, std::mt19937 & rng)
+{
+  std::uniform_int_distribution<unsigned> ns(0, 999999999);
+  tm->rising.utc_secs = t0 + i;
+  tm->rising.utc_nsecs = ns(rng);
+  tm->falling.utc_secs = tm->rising.utc_secs;
+  tm->falling.utc_nsecs = tm->rising.utc_nsecs;
+  tm->readout_time.utc_secs = tm->rising.utc_secs + 1;
+  tm->readout_time.utc_nsecs = 0;
+  tm->rise_count = i;
+  tm->channel = i % 2;
+  tm->flags = 0;
+}
+
+/* default number of packets per raw type, before scaling */
+template <typename RawType> size_t defaultCount() { return 10000; }
+template <> size_t defaultCount<pueo_full_waveforms_t>() { return 500; }
+template <> size_t defaultCount<pueo_sensors_disk_t>() { return 2000; }
+template <> size_t defaultCount<pueo_daq_hsk_t>() { return 2000; }
+
+/** Writes N packets of RawType into nfiles files under dir, returning the total number of bytes written */
+template <typename RawType, auto WriterFn>
+static long long generate(const std::string & dir, const char * rawname, const BenchOpts & opts)
+{
+  size_t N = defaultCount<RawType>() * opts.scale;
+  if (!N) N = 1;
+
+  // Packets are generated in time order but written locally shuffled, like what you get from telemetry
+  std::vector<size_t> order(N);
+  for (size_t i = 0; i < N; i++) order[i] = i;
+  std::mt19937 rng(opts.seed);
+  if (opts.disorder > 1)
+  {
+    for (size_t start = 0; start < N; start += opts.disorder)
+    {
+      std::shuffle(order.begin() + start, order.begin() + std::min(N, start + opts.disorder), rng);
+    }
+  }
+
+  // some of these are big, keep them off the stack
+  RawType * r = (RawType*) calloc(1, sizeof(RawType));
+  long long nbytes = 0;
+  size_t per_file = (N + opts.nfiles - 1) / opts.nfiles;
+
+  for (int ifile = 0; ifile < opts.nfiles; ifile++)
+  {
+    std::string fname = dir + "/" + rawname + "." + std::to_string(ifile) + ".dat";
+    pueo_handle_t h;
+    if (pueo_handle_init(&h, fname.c_str(), "w"))
+    {
+      std::cerr << "Could not open " << fname << " for writing" << std::endl;
+      free(r);
+      return -1;
+    }
+
+    for (size_t i = ifile * per_file; i < std::min(N, (ifile+1) * per_file); i++)
+    {
+      memset(r, 0, sizeof(RawType));
+      fill(r, order[i], rng);
+      WriterFn(&h, r);
+    }
+    pueo_handle_close(&h);
+
+    struct stat st;
+    if (!stat(fname.c_str(), &st)) nbytes += st.st_size;
+  }
+
+  free(r);
+  return nbytes;
+}
+
+// what the raw files of a type are generated from, kept in their .done marker so a -w directory
+// is only reused for the same workload
+static std::string rawParams(const BenchOpts & opts)
+{
+  return "nfiles " + std::to_string(opts.nfiles) + " scale " + std::to_string(opts.scale) +
+         " disorder " + std::to_string(opts.disorder) + " seed " + std::to_string(opts.seed);
+}
+
+/** The bytes of raw files already in dir for these options, or -1 if they have to be generated */
+static long long existingRaw(const std::string & dir, const BenchOpts & opts)
+{
+  std::ifstream done(dir + "/.done");
+  std::string params;
+  long long nbytes = -1;
+  if (!std::getline(done, params) || params != rawParams(opts) || !(done >> nbytes)) return -1;
+  return nbytes;
+}
+
+/** Removes the .done marker and the raw files of rawname in dir, before generating them again */
+static void removeRaw(const std::string & dir, const char * rawname)
+{
+  std::error_code ec;
+  std::filesystem::remove(dir + "/.done", ec);
+  std::string prefix = std::string(rawname) + ".";
+  for (const auto & f : std::filesystem::directory_iterator(dir, ec))
+  {
+    std::string name = f.path().filename().string();
+    if (!name.compare(0, prefix.size(), prefix) && name.size() > 4 && !name.compare(name.size() - 4, 4, ".dat"))
+    {
+      std::filesystem::remove(f.path(), ec);
+    }
+  }
+}
+
+struct BenchResult
+{
+  int nprocessed = -1;
+  double seconds = 0;
+  long maxrss_kb = 0;
+  long long in_bytes = 0;
+  long long out_bytes = 0;
+  double ratio = 0;
+};
+
+/** Run one conversion in a child process. */
+static BenchResult runOne(const char * tag, const std::string & rawdir, const std::string & outfile, long long in_bytes,
+                          algo_t algo, int level)
+{
+  BenchResult res;
+  res.in_bytes = in_bytes;
+
+  std::vector<std::string> files;
+  void * dirp = gSystem->OpenDirectory(rawdir.c_str());
+  while (const char * f = gSystem->GetDirEntry(dirp))
+  {
+    if (f[0] == '.') continue;
+    files.push_back(rawdir + "/" + f);
+  }
+  gSystem->FreeDirectory(dirp);
+  std::sort(files.begin(), files.end());
+  std::vector<const char *> cfiles;
+  for (auto & f : files) cfiles.push_back(f.c_str());
+
+  int fds[2];
+  if (pipe(fds))
+  {
+    perror("pipe");
+    return res;
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  pid_t pid = fork();
+  if (pid == 0)
+  {
+    close(fds[0]);
+    // the converter is chatty, we only care about the numbers
+    if (!freopen("/dev/null","w",stdout)) { ; }
+    pueo::convert::ConvertOpts copts;
+    copts.clobber = true;
+    copts.compression_algo = algo;
+    copts.compression_level = level;
+    int n = pueo::convert::convertFiles(tag, cfiles.size(), &cfiles[0], outfile.c_str(), copts);
+    if (write(fds[1], &n, sizeof(n)) != sizeof(n)) { ; }
+    close(fds[1]);
+    _exit(n < 0 ? 1 : 0);
+  }
+  close(fds[1]);
+
+  int status = 0;
+  struct rusage usage;
+  if (read(fds[0], &res.nprocessed, sizeof(res.nprocessed)) != sizeof(res.nprocessed)) res.nprocessed = -1;
+  close(fds[0]);
+  wait4(pid, &status, 0, &usage);
+  res.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  res.maxrss_kb = usage.ru_maxrss;
+
+  struct stat st;
+  if (!stat(outfile.c_str(), &st)) res.out_bytes = st.st_size;
+
+  TFile f(outfile.c_str());
+  if (f.IsOpen())
+  {
+    TTree * t = (TTree*) f.Get((std::string(tag) + "Tree").c_str());
+    if (t && t->GetZipBytes() > 0) res.ratio = double(t->GetTotBytes()) / t->GetZipBytes();
+  }
+
+  return res;
+}
+
+int main(int nargs, char ** args)
+{
+  BenchOpts opts;
+
+#define CHECK_NOT_LAST if (i == nargs -1) { usage(); return 1; }
+  for (int i = 1; i < nargs; i++)
+  {
+    if (!strcmp(args[i],"-k")) opts.keep = true;
+    else if (!strcmp(args[i],"-w")) { CHECK_NOT_LAST opts.workdir = args[++i]; }
+    else if (!strcmp(args[i],"-t")) { CHECK_NOT_LAST opts.tags = split(args[++i]); }
+    else if (!strcmp(args[i],"-n")) { CHECK_NOT_LAST opts.nfiles = std::max(1, atoi(args[++i])); }
+    else if (!strcmp(args[i],"-x")) { CHECK_NOT_LAST opts.scale = atof(args[++i]); }
+    else if (!strcmp(args[i],"-d")) { CHECK_NOT_LAST opts.disorder = atoi(args[++i]); }
+    else if (!strcmp(args[i],"-S")) { CHECK_NOT_LAST opts.seed = atoi(args[++i]); }
+    else if (!strcmp(args[i],"-o")) { CHECK_NOT_LAST opts.csv = args[++i]; }
+    else if (!strcmp(args[i],"-c"))
+    {
+      CHECK_NOT_LAST
+      for (auto & s : split(args[++i]))
+      {
+        std::pair<algo_t,int> codec;
+        if (!parseCodec(s.c_str(), &codec))
+        {
+          std::cerr << "Can't parse codec " << s << std::endl;
+          usage();
+          return 1;
+        }
+        opts.codecs.push_back(codec);
+      }
+    }
+    else
+    {
+      usage();
+      return 1;
+    }
+  }
+
+  if (!opts.codecs.size())
+  {
+    for (const char * c : {"zlib:1","lz4:4","zstd:1","zstd:3","zstd:9","lzma:1"})
+    {
+      std::pair<algo_t,int> codec;
+      parseCodec(c, &codec);
+      opts.codecs.push_back(codec);
+    }
+  }
+
+  if (!opts.tags.size())
+  {
+#define ADD_TAG(TAG, RAW, ROOT, POST, ARITY) opts.tags.push_back(#TAG);
+    PUEO_CONVERTIBLE_TYPES(ADD_TAG)
+  }
+
+  // only removed afterwards if it's a temporary one made here, otherwise just what we wrote in it is
+  pueo::synthetic::ScratchDir workdir("pueo-convert-bench", opts.workdir);
+  if (!workdir.ok()) return 1;
+  workdir.keep(opts.keep);
+  opts.workdir = workdir.path();
+  std::vector<std::string> rawdirs_made;
+
+  std::cout << "Working directory: " << opts.workdir << std::endl;
+
+  std::ofstream csv;
+  if (opts.csv)
+  {
+    csv.open(opts.csv);
+    csv << "tag,codec,level,entries,seconds,entries_per_s,in_MB,MB_per_s,maxrss_MB,out_MB,compression_ratio\n";
+  }
+
+  std::cout << std::left << std::setw(12) << "tag" << std::setw(8) << "codec" << std::setw(7) << "level"
+            << std::right << std::setw(10) << "entries" << std::setw(10) << "sec" << std::setw(12) << "entries/s"
+            << std::setw(10) << "in MB" << std::setw(10) << "MB/s" << std::setw(12) << "maxrss MB"
+            << std::setw(10) << "out MB" << std::setw(8) << "ratio" << std::endl;
+
+  for (const auto & tag : opts.tags)
+  {
+    std::string rawdir;
+    long long in_bytes = -1;
+
+    // generate the raw files for this tag's raw type (only once, several tags may share a raw type)
+#define GENERATE(TAG, RAW, ROOT, POST, ARITY)\
+    else if (tag == #TAG)\
+    {\
+      rawdir = opts.workdir + "/raw_" #RAW;\
+      struct stat st;\
+      if (stat(rawdir.c_str(), &st)) rawdirs_made.push_back(rawdir);\
+      gSystem->mkdir(rawdir.c_str(), true);\
+      in_bytes = existingRaw(rawdir, opts);\
+      if (in_bytes < 0)\
+      {\
+        std::cout << "Generating synthetic " #RAW " packets..." << std::endl;\
+        removeRaw(rawdir, #RAW);\
+        in_bytes = generate<pueo_##RAW##_t, pueo_write_##RAW>(rawdir, #RAW, opts);\
+        if (in_bytes >= 0)\
+        {\
+          std::ofstream done(rawdir + "/.done");\
+          done << rawParams(opts) << "\n" << in_bytes << std::endl;\
+        }\
+        else std::cerr << "Couldn't generate " #RAW " packets, skipping " << tag << std::endl;\
+      }\
+    }
+
+    if (0) {}
+    PUEO_CONVERTIBLE_TYPES(GENERATE)
+    else
+    {
+      std::cerr << "Unknown typetag " << tag << ", skipping" << std::endl;
+      continue;
+    }
+
+    if (in_bytes < 0) continue;
+
+    for (const auto & codec : opts.codecs)
+    {
+      std::string outfile = opts.workdir + "/" + tag + "_" + codecName(codec.first) + std::to_string(codec.second) + ".root";
+      BenchResult res = runOne(tag.c_str(), rawdir, outfile, in_bytes, codec.first, codec.second);
+
+      double in_mb = res.in_bytes / 1048576.;
+      double out_mb = res.out_bytes / 1048576.;
+      double rate = res.seconds > 0 ? res.nprocessed / res.seconds : 0;
+      double mbps = res.seconds > 0 ? in_mb / res.seconds : 0;
+
+      std::cout << std::left << std::setw(12) << tag << std::setw(8) << codecName(codec.first) << std::setw(7) << codec.second
+                << std::right << std::fixed << std::setprecision(2)
+                << std::setw(10) << res.nprocessed << std::setw(10) << res.seconds << std::setw(12) << rate
+                << std::setw(10) << in_mb << std::setw(10) << mbps << std::setw(12) << res.maxrss_kb / 1024.
+                << std::setw(10) << out_mb << std::setw(8) << res.ratio << std::endl;
+
+      if (csv.is_open())
+      {
+        csv << tag << "," << codecName(codec.first) << "," << codec.second << "," << res.nprocessed << ","
+            << res.seconds << "," << rate << "," << in_mb << "," << mbps << "," << res.maxrss_kb / 1024. << ","
+            << out_mb << "," << res.ratio << "\n";
+      }
+
+      if (!opts.keep) unlink(outfile.c_str());
+    }
+  }
+
+  if (!opts.keep && !workdir.owned())
+  {
+    for (const auto & dir : rawdirs_made)
+    {
+      std::error_code ec;
+      std::filesystem::remove_all(dir, ec);
+    }
+  }
+
+  return 0;
+}
@@ -3,17 +3,32 @@
 #include <iostream>
 #include <vector>
 #include <string.h>
+#include <stdlib.h>
+#include <strings.h>
 
 void usage()
 {
 
-  std::cout << "Usage: pueo-convert [-f] [-t tmpsuf] [-s sortby] [-P postprocessor args] typetag outfile.root input [input2]                                 \n"
+  std::cout << "Usage: pueo-convert [-f] [-t tmpsuf] [-s sortby] [-P postprocessor args] [-c codec:level] [-N] [-R] [-D] [-W window] [-r report] [-M tags] [-T timetable] [-E headers] [-K nitems] [--resume] typetag outfile.root input [input2]\n"
                "   -f   allow clobbering output                                                                                                              \n"
                "   -t   set a temporary file suffix                                                                                                          \n"
                "   -s   sort by an expression (quotes for complex expression, anything that goes in TTree::Draw and produces a double will work).            \n"
                "        Mostly useful for telemetered data. A useful expression may be \"run*1e9+event\".                                                    \n"
                "   -P   post processor args (quote for multiple)                                                                                             \n"
+               "   -c   compression as codec:level, codec one of zlib, lzma, lz4, zstd (default zstd:3)                                                    \n"
+               "   -N   don't use the per-type storage profiles (basket size, cluster size, split level), just ROOT defaults                                 \n"
+               "   -R   write an RNTuple instead of a TTree (needs ROOT >= 6.34). pueo::Dataset reads either.                                                \n"
+               "   -D   drop repeated packets (same run/event for events and headers, same sensor and time for hsk, same readout time otherwise)        \n"
+               "   -W   number of most recent keys remembered exactly when deduplicating (default 1048576). Older repeats are counted but kept.           \n"
+               "   -r   write a report of the dropped packets to this file (implies -D)                                                                    \n"
+               "   -M   comma separated typetags to write with the demux typetag (default header,attitude,sunsensors,hsk,daqhsk,timemark)                 \n"
+               "   -T   correct header trigger times while converting, with a time_table.root or a directory with run<N>/time_table.root          \n"
+               "   -E   fill in the run and event number of timemarks, from a headFile or a directory with run<N>/headFile<N>.root (with corrected \n"
+               "        trigger times). The match needs every timemark, so it's done on the final rewrite of the output                              \n"
+               "   -K   checkpoint every this many input items, so an interrupted conversion can be continued with --resume                  \n"
+               "   --resume  continue from the last checkpoint of outfile's temporary file (same inputs and options), instead of starting over    \n"
                "   typetag  typetag of input, or use auto to try to determine (problematic if more than one ROOT type can be generate from the same raw type)\n"
+               "            or demux to convert mixed inputs in one pass, writing one file per type (see -M) into outfile, which is then a directory       \n"
                "   outfile  name of output file                                                                                                              \n"
                "   input    name(s) of input files or directories. Note that directories are not recursive.                                                  \n"
                "            So, as an example, converting all timemarks (file structure timemarks/<year>_<month>_<day>/*.timemark.dat) into one root file,   \n"
@@ -50,6 +65,65 @@ int main(int nargs, char ** args)
       CHECK_NOT_LAST
       opts.sort_by = args[++i];
     }
+    else if (!strcmp(args[i],"-c"))
+    {
+      CHECK_NOT_LAST
+      char * codec = args[++i];
+      char * colon = strchr(codec,':');
+      if (colon)
+      {
+        *colon = 0;
+        opts.compression_level = atoi(colon+1);
+      }
+      if (!strcasecmp(codec,"zlib")) opts.compression_algo = ROOT::RCompressionSetting::EAlgorithm::kZLIB;
+      else if (!strcasecmp(codec,"lzma")) opts.compression_algo = ROOT::RCompressionSetting::EAlgorithm::kLZMA;
+      else if (!strcasecmp(codec,"lz4")) opts.compression_algo = ROOT::RCompressionSetting::EAlgorithm::kLZ4;
+      else if (!strcasecmp(codec,"zstd")) opts.compression_algo = ROOT::RCompressionSetting::EAlgorithm::kZSTD;
+      else
+      {
+        std::cerr << "Unknown codec " << codec << std::endl;
+        usage();
+        return 1;
+      }
+    }
+    else if (!strcmp(args[i],"-N")) opts.use_storage_profiles = false;
+    else if (!strcmp(args[i],"-R")) opts.rntuple = true;
+    else if (!strcmp(args[i],"-D")) opts.dedup = true;
+    else if (!strcmp(args[i],"-W"))
+    {
+      CHECK_NOT_LAST
+      opts.dedup_window = atol(args[++i]);
+    }
+    else if (!strcmp(args[i],"-r"))
+    {
+      CHECK_NOT_LAST
+      opts.dedup = true;
+      opts.dedup_report = args[++i];
+    }
+    else if (!strcmp(args[i],"-M"))
+    {
+      CHECK_NOT_LAST
+      opts.demux_tags = args[++i];
+    }
+    else if (!strcmp(args[i],"-T"))
+    {
+      CHECK_NOT_LAST
+      opts.time_table = args[++i];
+    }
+    else if (!strcmp(args[i],"-E"))
+    {
+      CHECK_NOT_LAST
+      opts.timemark_events = args[++i];
+    }
+    else if (!strcmp(args[i],"-K"))
+    {
+      CHECK_NOT_LAST
+      opts.checkpoint_every = strtoul(args[++i], nullptr, 0);
+    }
+    else if (!strcmp(args[i],"--resume"))
+    {
+      opts.resume = true;
+    }
     else if (!typetag)
     {
       typetag = args[i];
@@ -0,0 +1,51 @@
+// pueo-decimate: writes the decimated ("10%") dataset of runs or of a whole flight
+//
+// For each run, run<N>/decimatedHeadFile<N>.root gets the headers of the events
+// picked by pueo::decimation::selected, which only depends on the event number
+// and the seed, so rerunning this after a reprocessing gives the same events.
+// With -E the events go in run<N>/decimatedEventFile<N>.root too, and a
+// decimated Dataset reads those instead of the full event file. Runs are done
+// in parallel, see pueo/Decimation.h.
+
+#include "pueo/Decimation.h"
+#include "pueo/RunFiles.h"
+
+#include <iostream>
+#include <sstream>
+#include <string.h>
+#include <stdlib.h>
+
+void usage()
+{
+  std::ostringstream help;
+  help << "   -f   fraction of events to keep (default: " << pueo::decimation::kDefaultFraction << ")\n"
+          "   -s   seed of the selection (default: 0)\n"
+          "   -E   also write the decimated events\n";
+  pueo::runfiles::toolUsage("pueo-decimate", "[-f fraction] [-s seed] [-E] ", help.str().c_str());
+}
+
+int main(int nargs, char ** args)
+{
+  pueo::runfiles::ToolArgs targs;
+  pueo::decimation::Config cfg;
+
+  auto extra = [&](int & i)
+  {
+    if (!strcmp(args[i],"-E")) cfg.events = true;
+    else if (i == nargs - 1) return false;
+    else if (!strcmp(args[i],"-f")) cfg.fraction = atof(args[++i]);
+    else if (!strcmp(args[i],"-s")) cfg.seed = strtoull(args[++i], 0, 10);
+    else return false;
+    return true;
+  };
+  if (!pueo::runfiles::parseToolArgs(nargs, args, &targs, usage, extra)) return 1;
+  cfg.out_dir = targs.out_dir;
+
+  if (cfg.fraction <= 0 || cfg.fraction > 1)
+  {
+    std::cerr << "The fraction has to be in (0,1]" << std::endl;
+    return 1;
+  }
+
+  return pueo::runfiles::reportRuns([&]() { return pueo::decimation::write(targs.data_dir, targs.runs, cfg, targs.nthreads, &std::cout); });
+}
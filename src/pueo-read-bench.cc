@@ -0,0 +1,221 @@
+// pueo-read-bench: TTree vs. RNTuple read throughput
+//
+// Takes a file produced by pueo-convert (TTree output), writes an RNTuple copy
+// of it with pueo::convert::treeToRNTuple and times reading both: every entry,
+// and a single column. With -j the reads are repeated with ROOT's implicit
+// multithreading enabled, which parallelizes decompression for both formats.
+//
+// With -D run instead, times a pueo::Dataset loop over header() and raw() for
+// that run. Run it once with PUEO_ROOT_DATA pointing at TTree-converted data
+// and once at RNTuple-converted data (pueo-convert -R) to compare end-to-end.
+
+#include "pueo/Converter.h"
+#include "pueo/Dataset.h"
+
+#include "TFile.h"
+#include "TTree.h"
+#include "TROOT.h"
+#include "RVersion.h"
+
+#include <ROOT/RNTuple.hxx>
+#include <ROOT/RNTupleReader.hxx>
+#include <ROOT/RNTupleView.hxx>
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <memory>
+#include <chrono>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+// RNTuple moved out of ROOT::Experimental in 6.36
+#if ROOT_VERSION_CODE >= ROOT_VERSION(6,36,0)
+namespace rnt = ROOT;
+#else
+namespace rnt = ROOT::Experimental;
+#endif
+
+void usage()
+{
+  std::cout << "Usage: pueo-read-bench [-j nthreads] [-C column] [-o rntuple.root] [-k] tag file.root \n"
+               "       pueo-read-bench [-j nthreads] [-n nevents] -D run                             \n"
+               "   -j   also time with ROOT implicit multithreading with this many threads             \n"
+               "   -C   member to use for the single column read (default: eventNumber)                \n"
+               "   -o   where to write the RNTuple copy (default: file.root with .rntuple.root suffix)  \n"
+               "   -k   keep the RNTuple copy                                                          \n"
+               "   -n   maximum number of entries for the Dataset loop (default: all)                  \n"
+               "   -D   time a pueo::Dataset loop over the given run instead                           \n"
+               "   tag       the typetag of the file (the tree is <tag>Tree)                           \n"
+               "   file.root a TTree file produced by pueo-convert                                     \n"
+    << std::endl;
+}
+
+static double elapsed(std::chrono::steady_clock::time_point start)
+{
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void report(const char * what, Long64_t n, double secs)
+{
+  std::cout << std::setw(36) << std::left << what << std::right << std::setw(12) << n << " entries "
+            << std::setw(10) << std::setprecision(4) << secs << " s "
+            << std::setw(12) << std::setprecision(6) << (secs > 0 ? n / secs : 0) << " entries/s" << std::endl;
+}
+
+static void benchFiles(const char * tag, const char * treefile, const char * ntfile, const char * column, const char * label)
+{
+  TString treename = TString::Format("%sTree", tag);
+
+  {
+    TFile f(treefile);
+    TTree * t = f.Get<TTree>(treename);
+    auto start = std::chrono::steady_clock::now();
+    for (Long64_t i = 0; i < t->GetEntries(); i++) t->GetEntry(i);
+    report(TString::Format("TTree all %s", label), t->GetEntries(), elapsed(start));
+
+    t->SetBranchStatus("*",0);
+    t->SetBranchStatus(column,1);
+    start = std::chrono::steady_clock::now();
+    for (Long64_t i = 0; i < t->GetEntries(); i++) t->GetEntry(i);
+    report(TString::Format("TTree %s %s", column, label), t->GetEntries(), elapsed(start));
+  }
+
+  {
+    TFile f(ntfile);
+    std::unique_ptr<ROOT::RNTuple> anchor(f.Get<ROOT::RNTuple>(treename));
+    auto reader = rnt::RNTupleReader::Open(*anchor);
+    auto start = std::chrono::steady_clock::now();
+    for (auto i : reader->GetEntryRange()) reader->LoadEntry(i);
+    report(TString::Format("RNTuple all %s", label), reader->GetNEntries(), elapsed(start));
+
+    auto view = reader->GetView<void>(std::string(tag) + "." + column);
+    start = std::chrono::steady_clock::now();
+    for (auto i : reader->GetEntryRange()) view(i);
+    report(TString::Format("RNTuple %s %s", column, label), reader->GetNEntries(), elapsed(start));
+  }
+}
+
+static int benchDataset(int run, Long64_t nmax, const char * label)
+{
+  auto start = std::chrono::steady_clock::now();
+  pueo::Dataset d(run);
+  if (!d.fRunLoaded) return 1;
+  report(TString::Format("Dataset load (%s) %s", d.usingRNTuple() ? "RNTuple" : "TTree", label), d.N(), elapsed(start));
+
+  Long64_t n = nmax > 0 && nmax < d.N() ? nmax : d.N();
+  start = std::chrono::steady_clock::now();
+  for (Long64_t i = 0; i < n; i++)
+  {
+    d.getEntry(i);
+    d.header();
+  }
+  report(TString::Format("Dataset header() %s", label), n, elapsed(start));
+
+  start = std::chrono::steady_clock::now();
+  for (Long64_t i = 0; i < n; i++)
+  {
+    d.getEntry(i);
+    d.raw();
+  }
+  report(TString::Format("Dataset raw() %s", label), n, elapsed(start));
+  return 0;
+}
+
+int main(int nargs, char ** args)
+{
+  const char * tag = nullptr;
+  const char * input = nullptr;
+  const char * column = "eventNumber";
+  std::string output;
+  int nthreads = 0;
+  int run = -1;
+  Long64_t nmax = -1;
+  bool keep = false;
+
+#define CHECK_NOT_LAST if (i == nargs -1) { usage(); return 1; }
+  for (int i = 1; i < nargs; i++)
+  {
+    if (!strcmp(args[i],"-j"))
+    {
+      CHECK_NOT_LAST
+      nthreads = atoi(args[++i]);
+    }
+    else if (!strcmp(args[i],"-C"))
+    {
+      CHECK_NOT_LAST
+      column = args[++i];
+    }
+    else if (!strcmp(args[i],"-o"))
+    {
+      CHECK_NOT_LAST
+      output = args[++i];
+    }
+    else if (!strcmp(args[i],"-n"))
+    {
+      CHECK_NOT_LAST
+      nmax = atoll(args[++i]);
+    }
+    else if (!strcmp(args[i],"-D"))
+    {
+      CHECK_NOT_LAST
+      run = atoi(args[++i]);
+    }
+    else if (!strcmp(args[i],"-k")) keep = true;
+    else if (!tag) tag = args[i];
+    else if (!input) input = args[i];
+    else
+    {
+      usage();
+      return 1;
+    }
+  }
+
+  if (run >= 0)
+  {
+    if (benchDataset(run, nmax, "(serial)")) return 1;
+    if (nthreads > 0)
+    {
+      ROOT::EnableImplicitMT(nthreads);
+      return benchDataset(run, nmax, TString::Format("(%d threads)", nthreads));
+    }
+    return 0;
+  }
+
+  if (!tag || !input)
+  {
+    usage();
+    return 1;
+  }
+
+  if (output == "") output = std::string(input) + ".rntuple.root";
+
+  {
+    TFile fin(input);
+    TTree * t = fin.Get<TTree>(TString::Format("%sTree", tag));
+    if (!t)
+    {
+      std::cerr << "No " << tag << "Tree in " << input << std::endl;
+      return 1;
+    }
+
+    TFile fout(output.c_str(),"RECREATE");
+    auto start = std::chrono::steady_clock::now();
+    Long64_t n = pueo::convert::treeToRNTuple(t, tag, TString::Format("%sTree", tag), &fout);
+    if (n < 0) return 1;
+    fout.Close();
+    report("RNTuple copy write", n, elapsed(start));
+    std::cout << "TTree file: " << fin.GetSize() << " bytes, RNTuple file: " << fout.GetSize() << " bytes" << std::endl;
+  }
+
+  benchFiles(tag, input, output.c_str(), column, "(serial)");
+  if (nthreads > 0)
+  {
+    ROOT::EnableImplicitMT(nthreads);
+    benchFiles(tag, input, output.c_str(), column, TString::Format("(%d threads)", nthreads));
+  }
+
+  if (!keep) unlink(output.c_str());
+  return 0;
+}
@@ -0,0 +1,111 @@
+// pueo-run-catalog: builds (or lists) the run catalog of a flight
+//
+// The catalog is what Dataset::getRunAtTime, getRunContainingEventNumber and
+// locateEvent use, see pueo/RunCatalog.h. By default it's written to
+// runcatalog.dat in the data directory, which is where RunCatalog::forFlight
+// looks for it, so rerunning this after new runs are converted is all that's
+// needed.
+
+#include "pueo/RunCatalog.h"
+
+#include <iostream>
+#include <string>
+#include <thread>
+#include <chrono>
+#include <string.h>
+#include <stdlib.h>
+
+void usage()
+{
+  std::cout << "Usage: pueo-run-catalog [-j nthreads] [-d rootdata] [-o out] [-f flight]        \n"
+               "       pueo-run-catalog -l catalog                                              \n"
+               "   -j   number of header files to read at once (default: number of cores)       \n"
+               "   -d   directory with run<N>/headFile<N>.root (default: $PUEO_ROOT_DATA)       \n"
+               "   -o   the catalog to write (default: rootdata/runcatalog.dat)                 \n"
+               "   -f   flight the data is from (default: 1)                                    \n"
+               "   -l   print the runs in an existing catalog instead                           \n"
+    << std::endl;
+}
+
+static int list(const char * file)
+{
+  pueo::RunCatalog catalog(file);
+  if (!catalog.valid())
+  {
+    std::cerr << "Couldn't load " << file << std::endl;
+    return 1;
+  }
+
+  std::cout << "# flight " << catalog.flight() << ", " << catalog.size() << " runs, " << catalog.nranges() << " event ranges" << std::endl;
+  std::cout << "# run start_time end_time first_event last_event nentries nranges" << std::endl;
+  for (size_t i = 0; i < catalog.size(); i++)
+  {
+    const auto & e = catalog[i];
+    std::cout << e.run << " " << e.start_time << " " << e.end_time << " " << e.first_event << " "
+              << e.last_event << " " << e.nentries << " " << catalog.rangesEnd(i) - catalog.rangesBegin(i) << std::endl;
+  }
+  return 0;
+}
+
+int main(int nargs, char ** args)
+{
+  const char * rootdata = getenv("PUEO_ROOT_DATA");
+  const char * list_file = nullptr;
+  std::string output;
+  int nthreads = std::thread::hardware_concurrency();
+  int flight = 1;
+
+#define CHECK_NOT_LAST if (i == nargs -1) { usage(); return 1; }
+  for (int i = 1; i < nargs; i++)
+  {
+    if (!strcmp(args[i],"-j"))
+    {
+      CHECK_NOT_LAST
+      nthreads = atoi(args[++i]);
+    }
+    else if (!strcmp(args[i],"-d"))
+    {
+      CHECK_NOT_LAST
+      rootdata = args[++i];
+    }
+    else if (!strcmp(args[i],"-o"))
+    {
+      CHECK_NOT_LAST
+      output = args[++i];
+    }
+    else if (!strcmp(args[i],"-f"))
+    {
+      CHECK_NOT_LAST
+      flight = atoi(args[++i]);
+    }
+    else if (!strcmp(args[i],"-l"))
+    {
+      CHECK_NOT_LAST
+      list_file = args[++i];
+    }
+    else
+    {
+      usage();
+      return 1;
+    }
+  }
+
+  if (list_file) return list(list_file);
+
+  if (!rootdata)
+  {
+    std::cerr << "PUEO_ROOT_DATA not defined and no -d given" << std::endl;
+    usage();
+    return 1;
+  }
+  if (nthreads < 1) nthreads = 1;
+  if (output == "") output = std::string(rootdata) + "/runcatalog.dat";
+
+  auto start = std::chrono::steady_clock::now();
+  int n = pueo::RunCatalog::build(rootdata, output.c_str(), flight, nthreads);
+  if (n < 0) return 1;
+
+  std::cout << "Wrote " << n << " runs to " << output << " in "
+            << std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() << " s" << std::endl;
+  return 0;
+}
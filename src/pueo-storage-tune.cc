@@ -0,0 +1,366 @@
+// pueo-storage-tune: storage layout benchmark for converted files
+//
+// Takes an existing converted ROOT file and rewrites its tree with a grid of
+// basket sizes, cluster (auto flush) sizes and codecs, measuring for each the
+// file size, the time to read every entry, the time to read a single column
+// and the latency of random single-entry access. Prints a table and the
+// PUEO_STORAGE_PROFILE line for pueo/Converter.h (and the pueo-convert -c
+// codec) that best matches the chosen metric.
+//
+// Note that the split level is taken from the input file: a cloned tree keeps
+// the branch structure of the original, so to evaluate a different split level
+// the input has to be converted again.
+
+#include "pueo/Converter.h"
+
+#include "TFile.h"
+#include "TTree.h"
+#include "TBranch.h"
+#include "TObjArray.h"
+#include "TSystem.h"
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <random>
+#include <chrono>
+#include <string.h>
+#include <strings.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+typedef ROOT::RCompressionSetting::EAlgorithm::EValues algo_t;
+
+struct TuneOpts
+{
+  const char * input = nullptr;
+  const char * tag = nullptr;
+  std::string workdir = "";
+  std::vector<int> baskets = { 32000, 64000, 256000, 1048576 };
+  std::vector<Long64_t> flushes = { 0, 16, 256, -30000000 };
+  std::vector<std::pair<algo_t,int>> codecs;
+  const char * column = nullptr;
+  int nrandom = 200;
+  const char * metric = "size";
+  unsigned seed = 1234;
+  bool keep = false;
+};
+
+struct TuneResult
+{
+  int basket;
+  Long64_t flush;
+  algo_t algo;
+  int level;
+  Long64_t bytes;
+  double scan_s;
+  double column_s;
+  double random_ms;
+};
+
+void usage()
+{
+  std::cout << "Usage: pueo-storage-tune [-w workdir] [-b basket[,basket...]] [-a flush[,flush...]] [-c codec:level[,codec:level...]] [-C column] [-r nrandom] [-m metric] [-S seed] [-k] tag file.root\n"
+               "   -w   working directory for the rewritten files (default: a fresh directory under $TMPDIR)                 \n"
+               "   -b   comma separated basket sizes in bytes (default: 32000,64000,256000,1048576)                          \n"
+               "   -a   comma separated auto flush values, as in TTree::SetAutoFlush (default: 0,16,256,-30000000)          \n"
+               "   -c   comma separated codec:level pairs, codec one of zlib, lzma, lz4, zstd (default: lz4:4,zstd:3,zstd:9)  \n"
+               "   -C   branch to use for the single column scan (default: the first leaf branch)                            \n"
+               "   -r   number of random entries to read for the latency measurement (default: 200)                          \n"
+               "   -m   metric to pick the recommendation by: size, scan, column or random (default: size)                   \n"
+               "   -S   random seed (default: 1234)                                                                          \n"
+               "   -k   keep the rewritten files                                                                             \n"
+               "   tag       the typetag of the file (the tree is <tag>Tree)                                                 \n"
+               "   file.root a file produced by pueo-convert                                                                 \n"
+    << std::endl;
+}
+
+// as pueo-convert -c (and our own -c) take it
+static const char * codecName(algo_t a)
+{
+  switch (a)
+  {
+    case ROOT::RCompressionSetting::EAlgorithm::kZLIB: return "zlib";
+    case ROOT::RCompressionSetting::EAlgorithm::kLZMA: return "lzma";
+    case ROOT::RCompressionSetting::EAlgorithm::kLZ4: return "lz4";
+    case ROOT::RCompressionSetting::EAlgorithm::kZSTD: return "zstd";
+    default: return "default";
+  }
+}
+
+static bool parseCodec(char * str, std::pair<algo_t,int> * codec)
+{
+  char * colon = strchr(str,':');
+  codec->second = 3;
+  if (colon)
+  {
+    *colon = 0;
+    codec->second = atoi(colon+1);
+  }
+  if (!strcasecmp(str,"zlib")) codec->first = ROOT::RCompressionSetting::EAlgorithm::kZLIB;
+  else if (!strcasecmp(str,"lzma")) codec->first = ROOT::RCompressionSetting::EAlgorithm::kLZMA;
+  else if (!strcasecmp(str,"lz4")) codec->first = ROOT::RCompressionSetting::EAlgorithm::kLZ4;
+  else if (!strcasecmp(str,"zstd")) codec->first = ROOT::RCompressionSetting::EAlgorithm::kZSTD;
+  else return false;
+  return true;
+}
+
+static double elapsed(std::chrono::steady_clock::time_point start)
+{
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void setCompressionRecursive(TObjArray * branches, int settings)
+{
+  for (int i = 0; i < branches->GetEntriesFast(); i++)
+  {
+    TBranch * b = (TBranch*) branches->UncheckedAt(i);
+    b->SetCompressionSettings(settings);
+    setCompressionRecursive(b->GetListOfBranches(), settings);
+  }
+}
+
+static const char * firstLeafBranch(TObjArray * branches)
+{
+  for (int i = 0; i < branches->GetEntriesFast(); i++)
+  {
+    TBranch * b = (TBranch*) branches->UncheckedAt(i);
+    if (!b->GetListOfBranches()->GetEntriesFast()) return b->GetName();
+    if (const char * name = firstLeafBranch(b->GetListOfBranches())) return name;
+  }
+  return nullptr;
+}
+
+// rewrites the input tree into out with the given settings, returns the file size or -1
+static Long64_t rewrite(TTree * in, const char * out, int basket, Long64_t flush, algo_t algo, int level)
+{
+  TFile f(out,"RECREATE");
+  if (f.IsZombie()) return -1;
+  int settings = ROOT::CompressionSettings(algo, level);
+  f.SetCompressionSettings(settings);
+
+  TTree * t = in->CloneTree(0);
+  t->SetAutoSave(0);
+  t->SetAutoFlush(flush);
+  t->SetBasketSize("*", basket);
+  setCompressionRecursive(t->GetListOfBranches(), settings);
+  t->CopyEntries(in);
+  t->Write();
+  f.Close();
+  return f.GetSize();
+}
+
+static double scan(const char * file, const char * treename, const char * column)
+{
+  TFile f(file);
+  TTree * t = (TTree*) f.Get(treename);
+  if (!t) return -1;
+  if (column)
+  {
+    t->SetBranchStatus("*",0);
+    t->SetBranchStatus(column,1);
+  }
+  auto start = std::chrono::steady_clock::now();
+  for (Long64_t i = 0; i < t->GetEntries(); i++) t->GetEntry(i);
+  return elapsed(start);
+}
+
+static double randomAccess(const char * file, const char * treename, int n, unsigned seed)
+{
+  TFile f(file);
+  TTree * t = (TTree*) f.Get(treename);
+  if (!t || !t->GetEntries() || n <= 0) return -1;
+  std::mt19937 rng(seed);
+  std::uniform_int_distribution<Long64_t> dist(0, t->GetEntries()-1);
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < n; i++) t->GetEntry(dist(rng));
+  return elapsed(start) * 1e3 / n;
+}
+
+static double metricOf(const TuneResult & r, const char * metric)
+{
+  if (!strcmp(metric,"scan")) return r.scan_s;
+  if (!strcmp(metric,"column")) return r.column_s;
+  if (!strcmp(metric,"random")) return r.random_ms;
+  return r.bytes;
+}
+
+int main(int nargs, char ** args)
+{
+  TuneOpts opts;
+
+#define CHECK_NOT_LAST if (i == nargs -1) { usage(); return 1; }
+  for (int i = 1; i < nargs; i++)
+  {
+    if (!strcmp(args[i],"-w"))
+    {
+      CHECK_NOT_LAST
+      opts.workdir = args[++i];
+    }
+    else if (!strcmp(args[i],"-b"))
+    {
+      CHECK_NOT_LAST
+      opts.baskets.clear();
+      for (char * tok = strtok(args[++i],","); tok; tok = strtok(nullptr,",")) opts.baskets.push_back(atoi(tok));
+    }
+    else if (!strcmp(args[i],"-a"))
+    {
+      CHECK_NOT_LAST
+      opts.flushes.clear();
+      for (char * tok = strtok(args[++i],","); tok; tok = strtok(nullptr,",")) opts.flushes.push_back(atoll(tok));
+    }
+    else if (!strcmp(args[i],"-c"))
+    {
+      CHECK_NOT_LAST
+      char * list = args[++i];
+      for (char * tok = strtok(list,","); tok; tok = strtok(nullptr,","))
+      {
+        std::pair<algo_t,int> codec;
+        if (!parseCodec(tok,&codec))
+        {
+          std::cerr << "Unknown codec " << tok << std::endl;
+          return 1;
+        }
+        opts.codecs.push_back(codec);
+      }
+    }
+    else if (!strcmp(args[i],"-C"))
+    {
+      CHECK_NOT_LAST
+      opts.column = args[++i];
+    }
+    else if (!strcmp(args[i],"-r"))
+    {
+      CHECK_NOT_LAST
+      opts.nrandom = atoi(args[++i]);
+    }
+    else if (!strcmp(args[i],"-m"))
+    {
+      CHECK_NOT_LAST
+      opts.metric = args[++i];
+      if (strcmp(opts.metric,"size") && strcmp(opts.metric,"scan") && strcmp(opts.metric,"column") && strcmp(opts.metric,"random"))
+      {
+        usage();
+        return 1;
+      }
+    }
+    else if (!strcmp(args[i],"-S"))
+    {
+      CHECK_NOT_LAST
+      opts.seed = atoi(args[++i]);
+    }
+    else if (!strcmp(args[i],"-k")) opts.keep = true;
+    else if (!opts.tag) opts.tag = args[i];
+    else if (!opts.input) opts.input = args[i];
+    else
+    {
+      usage();
+      return 1;
+    }
+  }
+
+  if (!opts.tag || !opts.input || !opts.baskets.size() || !opts.flushes.size())
+  {
+    usage();
+    return 1;
+  }
+
+  if (!opts.codecs.size())
+  {
+    opts.codecs = { {ROOT::RCompressionSetting::EAlgorithm::kLZ4, 4},
+                    {ROOT::RCompressionSetting::EAlgorithm::kZSTD, 3},
+                    {ROOT::RCompressionSetting::EAlgorithm::kZSTD, 9} };
+  }
+
+  if (opts.workdir == "")
+  {
+    std::string tmpl = std::string(getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp") + "/pueo-storage-tune.XXXXXX";
+    std::vector<char> buf(tmpl.begin(), tmpl.end());
+    buf.push_back(0);
+    if (!mkdtemp(&buf[0]))
+    {
+      std::cerr << "Could not create working directory" << std::endl;
+      return 1;
+    }
+    opts.workdir = &buf[0];
+  }
+  else
+  {
+    gSystem->mkdir(opts.workdir.c_str(), true);
+  }
+
+  TString treename = TString::Format("%sTree", opts.tag);
+  TFile fin(opts.input);
+  TTree * in = (TTree*) fin.Get(treename);
+  if (!in)
+  {
+    std::cerr << "No " << treename << " in " << opts.input << std::endl;
+    return 1;
+  }
+
+  const char * column = opts.column ? opts.column : firstLeafBranch(in->GetListOfBranches());
+  int split = in->GetBranch(opts.tag) ? in->GetBranch(opts.tag)->GetSplitLevel() : 99;
+
+  std::cout << "Tuning " << treename << " from " << opts.input << " (" << in->GetEntries() << " entries, split level " << split << ")" << std::endl;
+  std::cout << "Single column scan uses " << (column ? column : "(none)") << std::endl;
+  std::cout << "Output in " << opts.workdir << std::endl << std::endl;
+
+  std::vector<TuneResult> results;
+  std::cout << std::setw(10) << "basket" << std::setw(12) << "autoflush" << std::setw(8) << "codec" << std::setw(6) << "level"
+            << std::setw(14) << "bytes" << std::setw(10) << "scan[s]" << std::setw(10) << "col[s]" << std::setw(12) << "rand[ms]" << std::endl;
+
+  for (int basket : opts.baskets)
+  {
+    for (Long64_t flush : opts.flushes)
+    {
+      for (const auto & codec : opts.codecs)
+      {
+        std::string out = opts.workdir + "/" + opts.tag + TString::Format(".%d.%lld.%d.%d.root", basket, flush, (int) codec.first, codec.second).Data();
+        TuneResult r;
+        r.basket = basket;
+        r.flush = flush;
+        r.algo = codec.first;
+        r.level = codec.second;
+        r.bytes = rewrite(in, out.c_str(), basket, flush, codec.first, codec.second);
+        if (r.bytes < 0)
+        {
+          std::cerr << "Could not write " << out << std::endl;
+          continue;
+        }
+        r.scan_s = scan(out.c_str(), treename, nullptr);
+        r.column_s = column ? scan(out.c_str(), treename, column) : -1;
+        r.random_ms = randomAccess(out.c_str(), treename, opts.nrandom, opts.seed);
+        results.push_back(r);
+
+        std::cout << std::setw(10) << r.basket << std::setw(12) << r.flush << std::setw(8) << codecName(r.algo) << std::setw(6) << r.level
+                  << std::setw(14) << r.bytes << std::setw(10) << std::setprecision(4) << r.scan_s << std::setw(10) << r.column_s
+                  << std::setw(12) << r.random_ms << std::endl;
+
+        if (!opts.keep) unlink(out.c_str());
+      }
+    }
+  }
+
+  if (!opts.keep) rmdir(opts.workdir.c_str());
+
+  if (!results.size()) return 1;
+
+  const TuneResult * best = &results[0];
+  for (const auto & r : results)
+  {
+    if (metricOf(r, opts.metric) < metricOf(*best, opts.metric)) best = &r;
+  }
+
+  std::cout << std::endl << "Best by " << opts.metric << ":" << std::endl;
+  std::cout << "PUEO_STORAGE_PROFILE(/*|*/ " << opts.tag << ", /*|*/ " << best->basket << ", /*|*/ " << best->flush
+            << ", /*|*/ " << split << " )\\" << std::endl;
+  std::cout << "with pueo-convert -c " << codecName(best->algo) << ":" << best->level << std::endl;
+
+  if (const pueo::convert::StorageProfile * cur = pueo::convert::getStorageProfile(opts.tag))
+  {
+    std::cout << "(currently: basket " << cur->basket_size << ", auto flush " << cur->auto_flush << ", split " << cur->split_level << ")" << std::endl;
+  }
+
+  return 0;
+}
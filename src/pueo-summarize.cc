@@ -0,0 +1,28 @@
+// pueo-summarize: writes the per-channel summary files of runs or of a whole flight
+//
+// For each run, run<N>/summaryFile<N>.root gets a pueo::EventSummary (RMS,
+// peak-to-peak, max |ADC|, saturated samples and power in a few bands for
+// every channel) per event of run<N>/eventFile<N>.root. Dataset::summary()
+// reads them, and cuts given to Dataset::setCut can use them without reading
+// the events. pueo-convert summary writes the same thing straight from the raw
+// data. Runs are done in parallel, see pueo/EventSummary.h.
+
+#include "pueo/EventSummary.h"
+#include "pueo/RunFiles.h"
+
+#include <iostream>
+
+void usage()
+{
+  pueo::runfiles::toolUsage("pueo-summarize");
+}
+
+int main(int nargs, char ** args)
+{
+  pueo::runfiles::ToolArgs targs;
+  if (!pueo::runfiles::parseToolArgs(nargs, args, &targs, usage)) return 1;
+
+  pueo::summary::Config cfg;
+  cfg.out_dir = targs.out_dir;
+  return pueo::runfiles::reportRuns([&]() { return pueo::summary::write(targs.data_dir, targs.runs, cfg, targs.nthreads, &std::cout); });
+}
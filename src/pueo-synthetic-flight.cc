@@ -0,0 +1,96 @@
+// pueo-synthetic-flight: writes a synthetic PUEO_ROOT_DATA
+//
+// Headers, events, attitude, hsk and daqhsk for each run plus the flight's
+// timemarks, with a drifting TURF clock, a mix of trigger types, and missing
+// seconds and runs with year-1970 event seconds at configurable rates, see
+// pueo/SyntheticFlight.h. Point PUEO_ROOT_DATA at the output to run anything
+// against it, e.g. pueo-run-catalog, or pueo-time-table on outdir/timemark.root
+// (the headers carry the true corrected times to check its tables against).
+
+#include "pueo/SyntheticFlight.h"
+
+#include <iostream>
+#include <cstdio>
+#include <string.h>
+#include <stdlib.h>
+
+void usage()
+{
+  pueo::synthetic::FlightConfig def;
+  std::cout << "Usage: pueo-synthetic-flight [options] outdir\n"
+               "   -r  first,n    first run and number of runs (default: " << def.first_run << "," << def.nruns << ")\n"
+               "   -l  seconds    length of each run (default: " << def.run_length << ")\n"
+               "   -t  time       true start time of the first run (default: " << def.start_time << ")\n"
+               "   -e  event      first event number (default: " << def.first_event << ")\n"
+               "   -R  rf,soft    RF and soft trigger rates in Hz (default: " << def.rf_rate << "," << def.soft_rate << ")\n"
+               "   -P             no PPS triggers\n"
+               "   -M  seconds    mean time between timemarks, 0 for none (default: " << def.timemark_interval << ")\n"
+               "   -c  offset,walk clock offset from nominal [Hz] and its random walk [Hz/s] (default: "
+                    << def.clock_offset << "," << def.clock_walk << ")\n"
+               "   -m  prob       chance of a missing second (default: " << def.missing_second_prob << ")\n"
+               "   -y  prob       chance of a run with event seconds from 1970 (default: " << def.year1970_run_prob << ")\n"
+               "   -Z             zero waveforms instead of noise (much faster and smaller)\n"
+               "   -S  seed       random seed (default: " << def.seed << ")\n"
+               "   -q             don't print a line per run\n"
+    << std::endl;
+}
+
+int main(int nargs, char ** args)
+{
+  pueo::synthetic::FlightConfig cfg;
+  const char * outdir = nullptr;
+  bool quiet = false;
+
+#define CHECK_NOT_LAST if (i == nargs -1) { usage(); return 1; }
+  for (int i = 1; i < nargs; i++)
+  {
+    if (!strcmp(args[i],"-r"))
+    {
+      CHECK_NOT_LAST
+      if (sscanf(args[++i], "%d,%d", &cfg.first_run, &cfg.nruns) != 2) { usage(); return 1; }
+    }
+    else if (!strcmp(args[i],"-l")) { CHECK_NOT_LAST cfg.run_length = atof(args[++i]); }
+    else if (!strcmp(args[i],"-t")) { CHECK_NOT_LAST cfg.start_time = atoi(args[++i]); }
+    else if (!strcmp(args[i],"-e")) { CHECK_NOT_LAST cfg.first_event = strtoul(args[++i], 0, 10); }
+    else if (!strcmp(args[i],"-R"))
+    {
+      CHECK_NOT_LAST
+      if (sscanf(args[++i], "%lf,%lf", &cfg.rf_rate, &cfg.soft_rate) != 2) { usage(); return 1; }
+    }
+    else if (!strcmp(args[i],"-P")) { cfg.pps_trigger = false; }
+    else if (!strcmp(args[i],"-M")) { CHECK_NOT_LAST cfg.timemark_interval = atof(args[++i]); }
+    else if (!strcmp(args[i],"-c"))
+    {
+      CHECK_NOT_LAST
+      if (sscanf(args[++i], "%lf,%lf", &cfg.clock_offset, &cfg.clock_walk) != 2) { usage(); return 1; }
+    }
+    else if (!strcmp(args[i],"-m")) { CHECK_NOT_LAST cfg.missing_second_prob = atof(args[++i]); }
+    else if (!strcmp(args[i],"-y")) { CHECK_NOT_LAST cfg.year1970_run_prob = atof(args[++i]); }
+    else if (!strcmp(args[i],"-Z")) { cfg.waveforms = false; }
+    else if (!strcmp(args[i],"-S")) { CHECK_NOT_LAST cfg.seed = strtoul(args[++i], 0, 10); }
+    else if (!strcmp(args[i],"-q")) { quiet = true; }
+    else if (args[i][0] == '-' || outdir)
+    {
+      usage();
+      return 1;
+    }
+    else outdir = args[i];
+  }
+
+  if (!outdir || cfg.nruns < 1 || cfg.run_length < 1)
+  {
+    usage();
+    return 1;
+  }
+
+  pueo::synthetic::FlightSummary summary;
+  if (pueo::synthetic::writeFlight(outdir, cfg, &summary, quiet ? nullptr : &std::cout))
+  {
+    std::cerr << "Failed writing the flight to " << outdir << std::endl;
+    return 1;
+  }
+
+  std::cout << "Wrote " << summary.nruns << " runs, " << summary.nevents << " events, " << summary.ntimemarks << " timemarks ("
+            << summary.missing_seconds << " missing seconds, " << summary.year1970_runs << " runs from 1970) to " << outdir << std::endl;
+  return 0;
+}
@@ -0,0 +1,195 @@
+// pueo-time-table: builds the time tables (PPS clock correction) of a flight
+//
+// All runs are processed in one process by a pool of threads, sharing one
+// TimemarkIndex that is loaded once. Runs are started longest first, so a
+// long run doesn't end up being the tail of the whole job.
+//
+// Output is outdir/run<N>/time_table.root (and .txt, _color.txt), which is
+// what pueo-convert -T and pueo::timing::TimeTable read.
+//
+// With -m, the timemarks are then matched to the (corrected) events of all the
+// runs in one merge pass, and written out with run and event_number filled.
+
+#include "pueo/Timing.h"
+#include "pueo/RunFiles.h"
+
+#include "TROOT.h"
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <sys/stat.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+void usage()
+{
+  std::cout << "Usage: pueo-time-table [-j nthreads] [-d rootdata] [-o outdir] [-q] [-m matched.root] timemark.root [run ...]                   \n"
+               "   -j   number of runs to process at once (default: number of cores)                                            \n"
+               "   -d   directory with run<N>/headFile<N>.root (default: $PUEO_ROOT_DATA)                                      \n"
+               "   -o   where to write run<N>/time_table.root (default: ./time_tables)                                         \n"
+               "   -q   only print a summary line per run, not the full log                                                   \n"
+               "   -m   match the timemarks to events with the new time tables, writing them with run/event_number here       \n"
+               "   timemark.root  all the timemarks of the flight (timemarkTree)                                                \n"
+               "   run  runs to process (default: every run in rootdata)                                                        \n"
+    << std::endl;
+}
+
+struct Job
+{
+  int run;
+  std::string header_file;
+  off_t size;
+};
+
+int main(int nargs, char ** args)
+{
+  const char * rootdata = getenv("PUEO_ROOT_DATA");
+  const char * outdir = "./time_tables";
+  const char * timemark_file = nullptr;
+  const char * match_file = nullptr;
+  int nthreads = std::thread::hardware_concurrency();
+  bool quiet = false;
+  std::vector<int> runs;
+
+#define CHECK_NOT_LAST if (i == nargs -1) { usage(); return 1; }
+  for (int i = 1; i < nargs; i++)
+  {
+    if (!strcmp(args[i],"-j"))
+    {
+      CHECK_NOT_LAST
+      nthreads = atoi(args[++i]);
+    }
+    else if (!strcmp(args[i],"-d"))
+    {
+      CHECK_NOT_LAST
+      rootdata = args[++i];
+    }
+    else if (!strcmp(args[i],"-o"))
+    {
+      CHECK_NOT_LAST
+      outdir = args[++i];
+    }
+    else if (!strcmp(args[i],"-m"))
+    {
+      CHECK_NOT_LAST
+      match_file = args[++i];
+    }
+    else if (!strcmp(args[i],"-q")) quiet = true;
+    else if (!timemark_file) timemark_file = args[i];
+    else runs.push_back(atoi(args[i]));
+  }
+
+  if (!timemark_file || !rootdata)
+  {
+    if (!rootdata) std::cerr << "PUEO_ROOT_DATA not defined and no -d given" << std::endl;
+    usage();
+    return 1;
+  }
+  if (nthreads < 1) nthreads = 1;
+
+  if (runs.empty() && !pueo::runfiles::findRuns(rootdata, &runs)) return 1;
+
+  std::vector<Job> jobs;
+  for (int run : runs)
+  {
+    Job job { run, std::string(rootdata) + "/run" + std::to_string(run) + "/headFile" + std::to_string(run) + ".root", 0 };
+    struct stat st;
+    if (stat(job.header_file.c_str(), &st))
+    {
+      std::cerr << "No " << job.header_file << ", skipping run " << run << std::endl;
+      continue;
+    }
+    job.size = st.st_size;
+    jobs.push_back(job);
+  }
+
+  // longest first, so the long runs don't end up last
+  std::stable_sort(jobs.begin(), jobs.end(), [](const Job & l, const Job & r) { return l.size > r.size; });
+
+  ROOT::EnableThreadSafety();
+
+  auto start = std::chrono::steady_clock::now();
+  pueo::timing::TimemarkIndex timemarks(timemark_file);
+  if (!timemarks.valid())
+  {
+    std::cerr << "No timemarks loaded from " << timemark_file << std::endl;
+    return 1;
+  }
+  std::cout << "Loaded " << timemarks.size() << " timemarks, building " << jobs.size() << " time tables with "
+            << nthreads << " threads" << std::endl;
+
+  std::atomic<size_t> next(0);
+  std::mutex print_mutex;
+  std::map<int, int32_t> results;
+  std::vector<pueo::timing::EventTime> events; // for -m
+
+  auto worker = [&]()
+  {
+    for (size_t ijob = next++; ijob < jobs.size(); ijob = next++)
+    {
+      const Job & job = jobs[ijob];
+      std::ostringstream log;
+      std::string rundir = std::string(outdir) + "/run" + std::to_string(job.run);
+      int32_t err = pueo::timing::buildTimeTable(job.header_file.c_str(), timemarks, rundir.c_str(), log);
+
+      std::vector<pueo::timing::EventTime> run_events;
+      if (match_file && !err)
+      {
+        pueo::timing::TimeTable table((rundir + "/time_table.root").c_str());
+        if (table.valid()) pueo::timing::loadEventTimes(job.header_file.c_str(), &run_events, &table);
+      }
+
+      // each run's log is printed in one piece
+      std::lock_guard<std::mutex> lock(print_mutex);
+      results[job.run] = err;
+      events.insert(events.end(), run_events.begin(), run_events.end());
+      if (!quiet) std::cout << log.str();
+      std::cout << "run " << job.run << ": " << (err ? "failed (error " + std::to_string(err) + ")" : std::string("done")) << std::endl;
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (int i = 0; i < std::min<int>(nthreads, jobs.size()); i++) threads.emplace_back(worker);
+  for (auto & t : threads) t.join();
+
+  int nfailed = 0;
+  int npreamp = 0;
+  for (const auto & r : results)
+  {
+    // pre-amp runs are skipped on purpose
+    if (r.second == pueo::timing::ERR_PreAmpRun) npreamp++;
+    else if (r.second) nfailed++;
+  }
+
+  std::cout << "Built " << results.size() - nfailed - npreamp << " time tables (skipped " << npreamp << " pre-amp runs) in "
+            << std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() << " s";
+  if (nfailed)
+  {
+    std::cout << ", failed:";
+    for (const auto & r : results)
+    {
+      if (r.second && r.second != pueo::timing::ERR_PreAmpRun) std::cout << " " << r.first;
+    }
+  }
+  std::cout << std::endl;
+
+  if (match_file)
+  {
+    size_t nevents = events.size();
+    size_t nmatched = timemarks.match(std::move(events));
+    std::cout << "Matched " << nmatched << " of " << timemarks.size() << " timemarks to " << nevents << " events" << std::endl;
+    if (!timemarks.save(match_file)) return 1;
+  }
+
+  return nfailed ? 1 : 0;
+}
@@ -0,0 +1,137 @@
+/****************************************************************************************
+*  pueo/AsyncFetch.h             Loading events in the background, see Dataset::fetchAsync
+*
+*  (C) 2023-, The Payload for Ultrahigh Energy Observations (PUEO) Collaboration
+*
+*  This file is part of pueoEvent, the ROOT I/O library for PUEO.
+*
+*  pueoEvent is free software: you can redistribute it and/or modify it under the
+*  terms of the GNU General Public License as published by the Free Software
+*  Foundation, either version 2 of the License, or (at your option) any later
+*  version.
+*
+*  Foobar is distributed in the hope that it will be useful, but WITHOUT ANY
+*  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+*  A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+*
+*  You should have received a copy of the GNU General Public License along with
+*  Foobar. If not, see <https://www.gnu.org/licenses/
+*
+****************************************************************************************/
+
+#ifndef PUEO_ASYNC_FETCH_H
+#define PUEO_ASYNC_FETCH_H
+
+#include <memory>
+#include <functional>
+#include "RtypesCore.h"
+
+namespace pueo
+{
+  class Dataset;
+  class RawHeader;
+  class RawEvent;
+  class UsefulEvent;
+  class TruthEvent;
+  namespace nav
+  {
+    class Attitude;
+  }
+
+  /** What fetchAsync loads */
+  enum FetchWhat
+  {
+    kFetchHeader = 0x01,  ///< always loaded
+    kFetchRaw = 0x02,
+    kFetchUseful = 0x04,
+    kFetchGps = 0x08,
+    kFetchTruth = 0x10,
+    kFetchDefault = kFetchHeader | kFetchUseful | kFetchGps | kFetchTruth
+  };
+
+  /** Copies of everything of one entry, as the Dataset would have given it (time tables,
+   * blinding and all), independent of the Dataset and of any other bundle. What wasn't
+   * asked for, or isn't there (like truth in flight data), is nullptr. */
+  class EventBundle
+  {
+    public:
+      EventBundle();
+      ~EventBundle();
+
+      int run() const { return fRun; }
+      Long64_t entry() const { return fEntry; }
+      const RawHeader * header() const { return fHeader.get(); }
+      const RawEvent * raw() const { return fRaw.get(); }
+      const UsefulEvent * useful() const { return fUseful.get(); }
+      const nav::Attitude * gps() const { return fGps.get(); }
+      const TruthEvent * truth() const { return fTruth.get(); }
+
+    private:
+      friend class DatasetFetcher;
+      int fRun;
+      Long64_t fEntry;
+      std::unique_ptr<RawHeader> fHeader;
+      std::unique_ptr<RawEvent> fRaw;
+      std::unique_ptr<UsefulEvent> fUseful;
+      std::unique_ptr<nav::Attitude> fGps;
+      std::unique_ptr<TruthEvent> fTruth;
+  };
+
+  /** A handle to a fetch in progress. Copies refer to the same fetch, and the bundle lives as
+   * long as any of them (or a share() of it) does. The calls are plain so that they work the
+   * same from PyROOT: f = d.fetchAsync(i); ...; b = f.get() */
+  class EventFuture
+  {
+    public:
+      EventFuture() {}
+
+      /** False for a default constructed one */
+      bool valid() const { return (bool) fState; }
+
+      /** True once the fetch is done (or failed), without waiting */
+      bool ready() const;
+
+      /** Waits for the fetch, at most timeout seconds if that's not negative. True if it's done */
+      bool wait(double timeout = -1) const;
+
+      /** Waits for the fetch and returns the bundle, or nullptr if it failed (entry out of range,
+       * run that couldn't be loaded, the Dataset went away first) */
+      const EventBundle * get() const;
+
+      /** The same, as something to hold on to the bundle with after the future is gone */
+      std::shared_ptr<const EventBundle> share() const;
+
+      struct State;
+
+    private:
+      friend class DatasetFetcher;
+      std::shared_ptr<State> fState;
+  };
+
+  /** The I/O threads behind Dataset::fetchAsync. Each has its own Dataset made with make (for the run
+   * it's asked for), since a Dataset, and its trees, can only be used by one thread at a time. At most
+   * max_in_flight fetches are queued or running at once, fetch() waits for one to finish otherwise.
+   * That bounds the work ahead of you, not memory: a finished bundle is kept for as long as its
+   * futures are, so keep only the futures you're about to use. */
+  class DatasetFetcher
+  {
+    public:
+      DatasetFetcher(std::function<Dataset*(int run)> make, int nthreads = 2, int max_in_flight = 8);
+
+      /** Fails the fetches that haven't started, and waits for the ones that have */
+      ~DatasetFetcher();
+      DatasetFetcher(const DatasetFetcher &) = delete;
+      DatasetFetcher & operator=(const DatasetFetcher &) = delete;
+
+      EventFuture fetch(int run, Long64_t entry, unsigned what = kFetchDefault);
+
+      /** Fetches queued or running */
+      int inFlight() const;
+
+    private:
+      struct Impl;
+      std::unique_ptr<Impl> fImpl;
+  };
+}
+
+#endif
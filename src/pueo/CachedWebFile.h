@@ -0,0 +1,88 @@
+/****************************************************************************************
+*  pueo/CachedWebFile.h             TWebFile with a local disk block cache
+*
+*  Used by Dataset for http(s):// PUEO_ROOT_DATA when PUEO_WEB_CACHE is set, so repeat
+*  analyses don't download the same baskets again.
+*
+*  (C) 2023-, The Payload for Ultrahigh Energy Observations (PUEO) Collaboration
+*
+*  This file is part of pueoEvent, the ROOT I/O library for PUEO.
+*
+*  pueoEvent is free software: you can redistribute it and/or modify it under the
+*  terms of the GNU General Public License as published by the Free Software
+*  Foundation, either version 2 of the License, or (at your option) any later
+*  version.
+*
+*  Foobar is distributed in the hope that it will be useful, but WITHOUT ANY
+*  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+*  A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+*
+*  You should have received a copy of the GNU General Public License along with
+*  Foobar. If not, see <https://www.gnu.org/licenses/
+*
+****************************************************************************************/
+
+#ifndef PUEO_CACHED_WEB_FILE_H
+#define PUEO_CACHED_WEB_FILE_H
+
+#include "TWebFile.h"
+#include <string>
+
+namespace pueo
+{
+  /** A TWebFile that keeps what it reads in a local, size-bounded block cache.
+   *
+   * Reads are rounded out to kBlockSize blocks. Blocks are stored one per file under the
+   * cache directory, named by a hash of the URL and file size plus the block number, so a
+   * file that changes on the server (and so changes size) doesn't hit stale blocks. All the
+   * blocks missing for one read, or for one TTreeCache cluster (ReadBuffers), are fetched
+   * in a single multi-range request, with adjacent blocks coalesced into one range.
+   *
+   * Blocks are written to a temporary file and renamed into place, so any number of processes
+   * (on a node, or sharing the directory) can use the same cache. Whenever a process has written
+   * about 1/16 of the limit it trims the cache back below it, least recently used blocks first.
+   *
+   * Configured with the environment (or setCache):
+   *   PUEO_WEB_CACHE       the cache directory. Caching is off if unset.
+   *   PUEO_WEB_CACHE_MB    the size limit in MB (default: 10240)
+   *
+   * Anything that supports range requests works as the server, so a local web server
+   * serving a copy of the data is enough to try it out.
+   */
+  class CachedWebFile : public TWebFile
+  {
+    public:
+      static constexpr Long64_t kBlockSize = 1 << 20;
+
+      CachedWebFile(const char * url, Option_t * opt = "");
+
+      using TWebFile::ReadBuffer;
+      Bool_t ReadBuffer(char * buf, Int_t len) override;
+      Bool_t ReadBuffers(char * buf, Long64_t * pos, Int_t * len, Int_t nbuf) override;
+
+      /** The cache directory, or nullptr if caching is off */
+      static const char * cacheDir();
+
+      /** Overrides the environment. A null dir turns caching off, max_mb of 0 keeps the current limit */
+      static void setCache(const char * dir, size_t max_mb = 0);
+
+      /** Removes the least recently used blocks until the cache is under its limit. Does
+       * nothing if another process is already doing it. */
+      static void trim();
+
+      Long64_t blocksFromCache() const { return fBlockHits; }
+      Long64_t blocksFetched() const { return fBlockMisses; }
+
+    private:
+      Bool_t readCached(char * buf, const Long64_t * pos, const Int_t * len, Int_t nbuf);
+      std::string blockPath(Long64_t block) const;
+
+      std::string fKey;
+      Long64_t fBlockHits = 0;
+      Long64_t fBlockMisses = 0;
+
+      ClassDefOverride(CachedWebFile,0);
+  };
+}
+
+#endif
@@ -29,6 +29,11 @@
 
 
 #include "Compression.h"
+#include <vector>
+#include <functional>
+
+class TTree;
+class TDirectory;
 
 
 #ifdef HAVE_PUEORAWDATA
@@ -64,19 +69,53 @@ namespace pueo
 // has_arity should be 1 in case a raw type corresponds to multiple root types, in which case an arity
 // template specialization below should also be defined
 //
+// sensors and hsk are both generated from sensors_disk. sensors is the compact
+// format (pueo::hsk::Reading rows plus a sensorDictTree written once per file,
+// read back with pueo::hsk::SensorDictionary), hsk the original one with all
+// the strings on every row.
+//
 #define PUEO_CONVERTIBLE_TYPES(PUEO_CONVERT_TYPE)\
 /*                  |  tag           |     raw type        | ROOT type                |  postprocessor  | has_arity    */\
 /*==================================================================================================================== */\
 PUEO_CONVERT_TYPE(/*|*/ event,     /*|*/  full_waveforms, /*|*/ pueo::RawEvent,       /*|*/ nullptr,    /*|*/ 0           )\
+PUEO_CONVERT_TYPE(/*|*/ summary,   /*|*/  full_waveforms, /*|*/ pueo::EventSummary,   /*|*/ nullptr,    /*|*/ 0           )\
 PUEO_CONVERT_TYPE(/*|*/ header,    /*|*/  full_waveforms, /*|*/ pueo::RawHeader,      /*|*/ nullptr,    /*|*/ 0           )\
 PUEO_CONVERT_TYPE(/*|*/ attitude,  /*|*/  nav_att,        /*|*/ pueo::nav::Attitude,  /*|*/ nullptr,    /*|*/ 0           )\
 PUEO_CONVERT_TYPE(/*|*/ sunsensors,/*|*/  ss,             /*|*/ pueo::nav::SunSensors,/*|*/ nullptr,    /*|*/ 0           )\
+PUEO_CONVERT_TYPE(/*|*/ sensors,   /*|*/  sensors_disk,   /*|*/ pueo::hsk::Reading,   /*|*/ nullptr,    /*|*/ 1           )\
 PUEO_CONVERT_TYPE(/*|*/ hsk,       /*|*/  sensors_disk,   /*|*/ pueo::hsk::Sensor,    /*|*/ nullptr,    /*|*/ 1           )\
 PUEO_CONVERT_TYPE(/*|*/ daqhsk,    /*|*/  daq_hsk,        /*|*/ pueo::daqhsk::DaqHsk, /*|*/ nullptr,    /*|*/ 0           )\
 PUEO_CONVERT_TYPE(/*|*/ timemark,  /*|*/  timemark,       /*|*/ pueo::Timemark,       /*|*/ nullptr,    /*|*/ 0           )\
 
 
 
+// X-macro defining the storage profile used for each convertible type (unless
+// ConvertOpts::use_storage_profiles is false, in which case ROOT defaults are used).
+//
+// arguments are: (tag, basket size, auto flush, split level)
+//
+// basket size is in bytes (0 for ROOT's default).
+// auto flush is the cluster size as in TTree::SetAutoFlush: entries if > 0, bytes if < 0, 0 for ROOT's default.
+// Compression is the same for every type, from ConvertOpts (pueo-convert -c).
+//
+// RawEvents are ~450 kB each and mostly read one at a time, so we want baskets that fit a couple
+// of them and small clusters; RawHeaders are small and scanned column-wise, so we want big baskets.
+// pueo-storage-tune can be used to benchmark alternatives on real data and will print lines for this table.
+//
+#define PUEO_STORAGE_PROFILES(PUEO_STORAGE_PROFILE)\
+/*                     |  tag           | basket size   | auto flush    | split  */\
+/*=========================================================================== */\
+PUEO_STORAGE_PROFILE(/*|*/ event,     /*|*/ 1048576,  /*|*/ 16,       /*|*/ 99 )\
+PUEO_STORAGE_PROFILE(/*|*/ summary,   /*|*/ 256000,   /*|*/ 0,        /*|*/ 99 )\
+PUEO_STORAGE_PROFILE(/*|*/ header,    /*|*/ 256000,   /*|*/ 0,        /*|*/ 99 )\
+PUEO_STORAGE_PROFILE(/*|*/ attitude,  /*|*/ 64000,    /*|*/ 0,        /*|*/ 99 )\
+PUEO_STORAGE_PROFILE(/*|*/ sunsensors,/*|*/ 64000,    /*|*/ 0,        /*|*/ 99 )\
+PUEO_STORAGE_PROFILE(/*|*/ sensors,   /*|*/ 256000,   /*|*/ 0,        /*|*/ 99 )\
+PUEO_STORAGE_PROFILE(/*|*/ hsk,       /*|*/ 256000,   /*|*/ 0,        /*|*/ 99 )\
+PUEO_STORAGE_PROFILE(/*|*/ daqhsk,    /*|*/ 256000,   /*|*/ 0,        /*|*/ 99 )\
+PUEO_STORAGE_PROFILE(/*|*/ timemark,  /*|*/ 64000,    /*|*/ 0,        /*|*/ 99 )\
+
+
 // If a ROOT constructor should take an index (because we've batched stuff), we should set has_arity to 1 above
 // and then define an appropriate template specialization here
 template <typename T> int arity(const T * t) { (void) t ; return -1; }
@@ -94,9 +133,86 @@ template <> inline int arity<pueo_sensors_disk_t> (const pueo_sensors_disk_t * d
       const char * sort_by = nullptr;
       ROOT::RCompressionSetting::EAlgorithm::EValues compression_algo = ROOT::RCompressionSetting::EAlgorithm::kZSTD;
       int compression_level = 3;
+      bool use_storage_profiles = true; //< use the per-type settings in PUEO_STORAGE_PROFILES
+      bool rntuple = false; //< write an RNTuple (with the same name as the tree would have) instead of a TTree. Needs ROOT >= 6.34
+      bool dedup = false; //< drop repeated packets (same run/event, sensor/time, readout time... depending on the type)
+      size_t dedup_window = 1 << 20; //< how many keys are remembered exactly when deduplicating
+      const char * dedup_report = nullptr; //< if set, every dropped packet is listed in this file
+      const char * demux_tags = "header,attitude,sunsensors,hsk,daqhsk,timemark"; //< comma separated outputs of convertFilesDemux
+      const char * time_table = nullptr; //< correct header trigger times while converting, with a time_table.root or a directory of run<N>/time_table.root
+      const char * timemark_events = nullptr; //< fill in the run and event_number of timemarks while converting, from a headFile or a directory of run<N>/headFile<N>.root
+      size_t checkpoint_every = 0; //< save the temporary output and input position every this many input items (0: never), so a conversion can be resumed
+      bool resume = false; //< continue from the last checkpoint of the temporary output, if there is one, instead of starting over
+    };
 
+
+    /** A columnar view of a staged (not yet final) tree, for stages that need to see
+     * every entry before anything is written. */
+    class StagedView
+    {
+      public:
+        StagedView(TTree * t) : t(t) {}
+
+        /** Evaluates expr (anything TTree::Draw understands) for every entry, in staging order */
+        std::vector<double> column(const char * expr) const;
+
+        Long64_t size() const;
+        TTree * tree() const { return t; }
+
+      private:
+        TTree * t;
     };
 
+    /** A post-processing stage, run by the converter on each item before it is written.
+     *
+     * Streaming stages only implement process(), which may modify the item or drop it by
+     * returning false. They run as items are converted, so they don't cost an extra write.
+     *
+     * Stages that need the whole run (e.g. assigning events to timemarks) first return true from
+     * wholeTree(). prepare() is then given a columnar view of the staged tree, and process() is called
+     * on the final (rewriting) pass, for every stage. Sorting happens on that same pass.
+     */
+    template <typename RootType>
+    class Stage
+    {
+      public:
+        virtual ~Stage() {}
+        virtual const char * name() const = 0;
+        virtual bool wholeTree() const { return false; }
+        virtual bool prepare(const StagedView & view) { (void) view; return true; }
+        virtual bool process(RootType & R) = 0;
+        /** Called instead of process() on items already written before a checkpoint when resuming, to rebuild any state */
+        virtual void replay(const RootType & R) { (void) R; }
+        /** Called when items start coming from a different input file */
+        virtual void beginFile(const char * infile) { (void) infile; }
+        /** Called once everything has been written, e.g. to print a summary */
+        virtual void finish() {}
+    };
+
+    struct StorageProfile
+    {
+      const char * tag;
+      int basket_size;
+      Long64_t auto_flush;
+      int split_level;
+    };
+
+    /** Returns the storage profile for a typetag, or nullptr if there isn't one */
+    const StorageProfile * getStorageProfile(const char * typetag);
+
+    /** Copies the object branch of a tree into a new RNTuple in dir, with a single field
+     * named after the branch. If order is not null, entries are copied in that order.
+     * Compression is taken from opts.
+     *
+     * If filter is given, it is called with the object after each entry is read and may modify it, or skip
+     * the entry by returning false.
+     *
+     * Returns the number of entries written, or -1 on failure (including when compiled without RNTuple support).
+     */
+    Long64_t treeToRNTuple(TTree * t, const char * branch, const char * ntuple_name, TDirectory * dir,
+                           const ConvertOpts & opts = ConvertOpts(), const std::vector<Long64_t> * order = nullptr,
+                           const std::function<bool(void*)> & filter = nullptr);
+
    /** Convert input files to output file
      *
      * If typetag is NULL, empty or auto, the first packet from the first file will be read to determine the type. 
@@ -116,12 +232,26 @@ template <> inline int arity<pueo_sensors_disk_t> (const pueo_sensors_disk_t * d
      */
     int convertFiles(const char * typetag, int nfiles, const char ** infiles,  const char * outfile, const ConvertOpts & opts = ConvertOpts());
 
+    /** Converts heterogeneous input files (e.g. telemetry dumps) in one pass.
+     *
+     * Every packet is read with the low-level reader and handed to the writers
+     * for its type, so each input is only read once. One output file per typetag in
+     * opts.demux_tags is written, as outdir/<tag>.root. Packets of types not
+     * in demux_tags are skipped (and counted).
+     *
+     * This is also what convertFiles does if typetag is "demux", in which case outfile is the output directory.
+     *
+     * Returns the total number of things converted, or -1 on failure
+     */
+    int convertFilesDemux(int nfiles, const char ** infiles, const char * outdir, const ConvertOpts & opts = ConvertOpts());
+
     /** Similar to above, but an argument can be a directory instead of a file and in that case everything in the directory is added */
     int convertFilesOrDirectories(const char * typetag, int N, const char ** in,  const char * outfile, const ConvertOpts & opts = ConvertOpts());
 
     namespace tags
     {
       constexpr const char * automatic = "auto"; //since we can't use auto as a token :)
+      constexpr const char * demux = "demux"; // all the types in ConvertOpts::demux_tags, see convertFilesDemux
 #define DEFINE_TAG(TAG, IG,NO,RE,D) constexpr const char * TAG = #TAG;
       PUEO_CONVERTIBLE_TYPES(DEFINE_TAG)
     }
@@ -133,7 +263,13 @@ template <> inline int arity<pueo_sensors_disk_t> (const pueo_sensors_disk_t * d
      **/
     typedef int ( * postprocess_fn) (const char * infile, const char * outfile, const char * args);
 
-    //TODO
+    /* Standalone versions of the post-processing, for files that are already converted.
+     * These run the same stages as the converter would, rewriting infile to outfile once.
+     *
+     * postprocess_headers: args is a time table (file or directory, as ConvertOpts::time_table)
+     * postprocess_attitudes: sorts by readout time and drops repeats, args is an optional sort expression
+     * postprocess_hsks: sorts by sensor time and drops repeats, args is an optional sort expression
+     */
     int postprocess_headers(const char * infile, const char * outfile, const char * args);
     int postprocess_attitudes(const char * infile, const char * outfile, const char * args) ;
     int postprocess_hsks(const char * infile, const char * outfile, const char * args) ;
@@ -8,6 +8,9 @@
  *
  *
  *  -it prefers calibrated event files , but can fall back to event files
+ *
+ *  Datasets can be used from several threads at once (one Dataset per thread), once
+ *  ROOT::EnableThreadSafety() has been called. Nothing global is changed per entry.
  *  Cosmin Deaconu <cozzyd@kicp.uchicago.edu>
  *  Ben Strutt <strutt@physics.ucla.edu> 
  *
@@ -15,8 +18,11 @@
 
 #include <vector>
 #include "pueo/Conventions.h"
+#include "pueo/DatasetStats.h"
+#include "pueo/AsyncFetch.h"
 #include "TString.h"
 #include "TRandom3.h"
+#include <iostream>
 
 class TTree;
 class TFile;
@@ -26,6 +32,7 @@ class TEventList;
 namespace pueo 
 {
   class RawHeader;
+  class SharedEventCache;
   namespace nav
   {
     class Attitude;
@@ -33,6 +40,11 @@ namespace pueo
   class UsefulEvent;
   class RawEvent;
   class TruthEvent;
+  class EventSummary;
+  namespace timing
+  {
+    class TimeTable;
+  }
 
   class Dataset
   {
@@ -110,9 +122,9 @@ namespace pueo
       virtual ~Dataset();
 
 
-      /** Loads run. Can use decimated to load the 10% data file 
-       *
-       *
+      /** Loads run. Can use decimated to load the 10% data file (run<N>/decimatedHeadFile<N>.root, see
+       * pueo-decimate and pueo/Decimation.h). Decimated runs take their events from
+       * run<N>/decimatedEventFile<N>.root if there is one, so they don't need the full event file.
        **/
 
       bool loadRun(int run,  DataDirectory dir  = PUEO_ROOT_DATA, bool decimated = false );
@@ -191,7 +203,8 @@ namespace pueo
 
 
     /** Loads a playlist for your dataset.Playlist format is RUN EVENTNUMBER\n or EVENTNUMBER\n
-     * After applying playlist, use these to iterate through. Need runToEv files from MagicDisplay */
+     * After applying playlist, use these to iterate through. The run of EVENTNUMBER-only lines
+     * is looked up with locateEvent, so that needs the flight's run catalog (pueo-run-catalog) */
       int setPlaylist(const char* playlist);
 
       /** The number of events in the playlist (or -1 if no playlist) */
@@ -212,6 +225,23 @@ namespace pueo
       /** Loads the nth playlist event. Returns the entry number or -1 if no playlist */
       int nthInPlaylist(int i);
 
+      /** Skims: writes the selected events (headers, events, truth and the attitude gps() would give for them)
+       * to outdir/run<N>/ under the run's file names, with their indices built, so a Dataset reading outdir
+       * (PUEO_ROOT_DATA=outdir) gets just those. A tree that's selected in full has its compressed baskets
+       * copied as they are, otherwise it's copied entry by entry. Headers are copied as stored, so time tables
+       * still apply. Skims of several runs get a run catalog. These return the number of events written, or -1,
+       * leave the Dataset on the event it was on, and need TTrees rather than RNTuples.
+       *
+       * This one writes the events passing cut in each of runs (default: the current run). Existing files are
+       * replaced, so skim different runs into the same outdir rather than the same run twice. */
+      int skim(const char * outdir, const TCut & cut, const std::vector<int> & runs = std::vector<int>());
+
+      /** Skims the entries of the current run that are true in selected (entries of the decimated tree if decimated) */
+      int skim(const char * outdir, const std::vector<bool> & selected);
+
+      /** Skims the events in the playlist */
+      int skimPlaylist(const char * outdir);
+
       /** Loads the useful event. If force_reload is true,
        * the event will be reloaded from the tree (in case you made some changes
        * and want a fresh copy). This will either be created from the
@@ -237,6 +267,11 @@ namespace pueo
 
       /** Loads the MCTruth. This will be NULL if there is no truth (like if you're working with real data. */ 
       TruthEvent * truth(bool force_reload = true); 
+
+      /** Per-channel waveform features of the current event (see EventSummary), without reading the event.
+       *  NULL if the run has no summaryFile (see pueo-summarize) or the event isn't in it. Cuts given to
+       *  setCut and skim can use them too, as summaryTree.<feature>[chan]. */
+      EventSummary * summary(bool force_reload = false);
       
       /** Lets you check to see if you have a header and event file actually loaded, or if it failed loading */
       bool fRunLoaded;
@@ -253,11 +288,103 @@ namespace pueo
       /* Where was hical? Uses the current header realTime*/ 
       void hiCal(char which, Double_t& longitude,  Double_t& latitude, Double_t& altitude);
 
+      /** The run at a given time, from the flight's run catalog (see RunCatalog) if there is one */
       static int getRunAtTime(double t);
+
+      /** The run with an event number, from the run catalog of the flight (default: the current version), or -1 */
+      static int getRunContainingEventNumber(UInt_t eventNumber, int flight = -1);
+
+      /** Finds an event anywhere in the flight (default: the current version) using the run catalog's
+       * event index. Returns its run, or -1, and optionally its header tree entry in that run */
+      static int locateEvent(UInt_t eventNumber, Long64_t * entry = 0, int flight = -1);
       static void setVerboseOutput(bool v);
 
+      /** True if the loaded run was converted to RNTuples (pueo-convert -R) rather than TTrees.
+       *  Everything works the same way except for setCut, which needs a TTree. */
+      bool usingRNTuple() const { return fNTuple != 0; }
+
+      /** Correct header trigger times (corrected_trigger_time, corrected_pps and clock_frequency) as they're read,
+       *  with the run's time table (see pueo-time-table), instead of using what's stored in the header file.
+       *  The time table is looked for as run<N>/time_table.root in dir, then in $PUEO_TIME_TABLES, then in the
+       *  data directory. This is on by default if PUEO_TIME_TABLES is set. Headers of runs without a (valid)
+       *  time table are left alone.
+       */
+      void useTimeTables(bool use = true, const char * dir = nullptr);
+
+      /** The time table used for the current run, or nullptr if there isn't one (or they're not used) */
+      const timing::TimeTable * timeTable();
+
+      /** How the TTreeCaches of the run's trees are set up. */
+      enum AccessMode
+      {
+        kAccessAuto,         ///< starts out interactive, sequential after a stretch of next()'s, sparse when iterating over a cut or playlist
+        kAccessSequential,   ///< large caches holding a couple of clusters of every branch
+        kAccessSparse,       ///< only the baskets with entries in the cut (or else the run's playlist events) are prefetched
+        kAccessInteractive   ///< small caches, for jumping around
+      };
+
+      /** Sets the access mode (default: kAccessAuto). This only affects TTrees, RNTuples manage their own cluster cache. */
+      void setAccessMode(AccessMode mode);
+      AccessMode getAccessMode() const { return fAccessMode; }
+
+      /** Prints the read calls, bytes read and TTreeCache hit rate of each of the current run's trees */
+      void printCacheStats(std::ostream & os = std::cout) const;
+
+      /** Turns the counters and timers of this Dataset (see DatasetStats) on or off. They're off by
+       *  default and then cost a pointer check per read. PUEO_DATASET_STATS=1 in the environment
+       *  turns them on for every Dataset and prints them when it's destroyed. */
+      void enableStats(bool enable = true);
+
+      /** The counters so far, or nullptr if they're off */
+      const DatasetStats * stats() const { return fStats; }
+
+      /** After this, signal signum (e.g. SIGUSR1) makes every Dataset with stats on print them to stderr on its next getEntry */
+      static void dumpStatsOnSignal(int signum);
+
+      /** What this Dataset holds in memory right now: loaded baskets, caches, indices, event objects and cut lists.
+       *  Not what ROOT itself keeps per file (streamer infos, keys etc.), which doesn't depend on how it's used. */
+      DatasetMemory memoryUsage() const;
+
+      /** Caps what the TTreeCaches may add to the rest of memoryUsage(), in bytes (0 for no limit). They're
+       *  shrunk, or turned off, as needed to fit when they're set up. The default is $PUEO_DATASET_MEMORY_MB. */
+      void setMemoryBudget(size_t bytes);
+      size_t getMemoryBudget() const { return fMemoryBudget; }
+
+      /** Shares headers and raw events with the other processes on the node through the node's
+       *  SharedEventCache, so each is only unzipped once per node rather than once per process.
+       *  On by default if PUEO_SHM_CACHE_MB is set, which is also how big the cache is. */
+      void useSharedCache(bool use = true);
+
+      /** Starts loading an entry (of the current run, counted like getEntry) in the background and
+       *  returns right away, without moving this Dataset off its entry. The future gives copies of
+       *  what getEntry would have given (see EventBundle), so event K+1 can be on its way while you
+       *  work on event K. I/O threads with their own Datasets do the loading, see setAsyncFetch. */
+      EventFuture fetchAsync(Long64_t entry, unsigned what = kFetchDefault);
+
+      /** The same for an entry of any run */
+      EventFuture fetchRunAsync(int run, Long64_t entry, unsigned what = kFetchDefault);
+
+      /** The number of I/O threads for fetchAsync (default: 2) and how many fetches can be queued or
+       *  running at once (default: 8), past which fetchAsync waits. Finished ones don't count, however
+       *  long their futures are kept (see DatasetFetcher). Fetches not started yet fail. */
+      void setAsyncFetch(int nthreads, int max_in_flight);
+
     protected:
       void unloadRun();
+
+      // these dispatch to either the trees or the RNTuple readers
+      struct NTupleSources;
+      NTupleSources * fNTuple; //! RNTuple readers, if any
+      void setupNTuples();
+      Long64_t headEntries() const;
+      Long64_t headEntryWithEvent(UInt_t eventNumber) const;
+      void loadHeadEntry(Long64_t entry, bool force = false);
+      bool haveEvents() const;
+      bool loadEventEntry(Long64_t entry, bool force = false);
+      void loadGpsEntry(Long64_t entry, bool force = false);
+      Long64_t gpsEntryAtTime(UInt_t sec, UInt_t nsec) const;
+      void setupCaches(AccessMode mode, bool playlist = false);
+      int skimRun(const char * outdir, std::vector<Long64_t> entries); // full header tree entries of the current run
       TTree * fHeadTree;
       TTree * fDecimatedHeadTree; //only used when using decimated
       Long64_t * fIndices;
@@ -272,6 +399,8 @@ namespace pueo
       nav::Attitude * fGps;
       TTree * fTruthTree; 
       TruthEvent * fTruth;
+      TTree * fSummaryTree; // a friend of the header tree just while drawing cuts, so GetEntry doesn't read it
+      EventSummary * fSummary;
 
 
       /* place to store the current run but that can't be confusingly changed */
@@ -283,6 +412,8 @@ namespace pueo
       Bool_t fHaveUsefulFile;
       std::vector<TFile *> filesToClose;
       bool fDecimated;
+      bool fDecimatedEvents; // fEventTree is from decimatedEventFile, with the entries of fDecimatedHeadTree
+      Long64_t eventEntry() const { return fDecimatedEvents ? fDecimatedEntry : fWantedEntry; }
       TEventList * fCutList;
       int fCutIndex;
 
@@ -323,6 +454,35 @@ namespace pueo
 
       DataDirectory datadir; 
 
+      bool fUseTimeTables;
+      TString fTimeTableDir;
+      timing::TimeTable * fTimeTable; //! for the current run
+      int fTimeTableRun; // run fTimeTable was looked up for
+
+      AccessMode fAccessMode;
+      AccessMode fCacheMode; // what the caches are set up for now
+      bool fCachePlaylist; // in kAccessSparse, prefetching the playlist rather than the cut
+      int fSequentialReads; // getEntry()'s of the next entry in a row, for kAccessAuto
+      TEventList * fPrefetchList; //! entries prefetched in kAccessSparse
+
+      DatasetStats * fStats; //! null unless enableStats
+      bool fDumpStats; // print fStats in the destructor
+      int fStatsGeneration; // of the dumpStatsOnSignal signals, the last one fStats was printed for
+      size_t fMemoryBudget; // for setupCaches, 0 if none
+
+      void setupSharedCache();
+      SharedEventCache * fShmCache; //! shared by the whole process, null if not used
+      uint64_t fShmHeadKey; // the file part of the keys of the run's headers, 0 if they're not cached
+      uint64_t fShmEventKey; // the same for the events
+      Long64_t fShmHeadEntry; // entry in fHeader, -1 if unknown
+      Long64_t fShmEventEntry; // entry in fRawEvent, -1 if unknown
+
+      DatasetFetcher * fFetcher; //! for fetchAsync, made on first use
+      int fFetchThreads;
+      int fFetchMaxInFlight;
+      DataDirectory fFetcherDir; // what fFetcher's Datasets are made with
+      bool fFetcherDecimated;
+
     
   };
 
@@ -0,0 +1,96 @@
+/****************************************************************************************
+*  pueo/DatasetStats.h             I/O, timing and memory accounting for pueo::Dataset
+*
+*  (C) 2023-, The Payload for Ultrahigh Energy Observations (PUEO) Collaboration
+*
+*  This file is part of pueoEvent, the ROOT I/O library for PUEO.
+*
+*  pueoEvent is free software: you can redistribute it and/or modify it under the
+*  terms of the GNU General Public License as published by the Free Software
+*  Foundation, either version 2 of the License, or (at your option) any later
+*  version.
+*
+*  Foobar is distributed in the hope that it will be useful, but WITHOUT ANY
+*  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+*  A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+*
+*  You should have received a copy of the GNU General Public License along with
+*  Foobar. If not, see <https://www.gnu.org/licenses/
+*
+****************************************************************************************/
+
+#ifndef PUEO_DATASET_STATS_H
+#define PUEO_DATASET_STATS_H
+
+#include <cstdint>
+#include <iostream>
+
+namespace pueo
+{
+  /** Counters and timers for a Dataset, see Dataset::enableStats.
+   *
+   * Everything is cumulative since the stats were enabled (or reset), across runs.
+   * Latencies are kept in power of two histograms (bin i counts times in [2^i, 2^(i+1)) ns),
+   * which is what the percentiles are estimated from.
+   */
+  struct DatasetStats
+  {
+    struct Timer
+    {
+      static constexpr int kNBins = 40;
+      uint64_t n = 0;
+      uint64_t total_ns = 0;
+      uint64_t max_ns = 0;
+      uint64_t hist[kNBins] = {0};
+
+      void add(uint64_t ns);
+      double mean() const { return n ? double(total_ns) / n : 0; }
+
+      /** upper edge of the bin the q quantile (0-1) falls in */
+      uint64_t quantile(double q) const;
+    };
+
+    enum Tree
+    {
+      kHead,
+      kEvent,
+      kGps,
+      kNTrees
+    };
+
+    struct TreeStats
+    {
+      Timer get_entry;            ///< entries read (calls that actually read something)
+      uint64_t bytes_read = 0;    ///< compressed bytes read from the file
+      uint64_t bytes_unzipped = 0;///< bytes of entries unpacked (TTree only)
+      uint64_t shm_hits = 0;      ///< entries from the shared event cache instead (see SharedEventCache)
+    };
+
+    TreeStats trees[kNTrees];
+    Timer useful_build;     ///< building UsefulEvents from RawEvents
+    Timer index_build;      ///< building the event number / time indices in loadRun
+    Timer load_run;         ///< all of loadRun
+    uint64_t files_opened = 0;
+    uint64_t run_switches = 0;  ///< loadRun's after the first one
+
+    void reset() { *this = DatasetStats(); }
+    void print(std::ostream & os = std::cerr) const;
+
+    static const char * treeName(Tree t);
+  };
+
+  /** What a Dataset holds in memory, see Dataset::memoryUsage. In bytes. */
+  struct DatasetMemory
+  {
+    uint64_t baskets = 0;   ///< TTree baskets currently loaded
+    uint64_t caches = 0;    ///< TTreeCache buffers
+    uint64_t indices = 0;   ///< TTreeIndex's (or their RNTuple equivalent) and the time table
+    uint64_t events = 0;    ///< header, RawEvent, UsefulEvent, attitude and truth objects
+    uint64_t cut_lists = 0; ///< cut, prefetch and playlist entries
+
+    uint64_t total() const { return baskets + caches + indices + events + cut_lists; }
+    void print(std::ostream & os = std::cerr) const;
+  };
+}
+
+#endif
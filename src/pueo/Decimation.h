@@ -0,0 +1,64 @@
+/****************************************************************************************
+*  pueo/Decimation.h             The decimated ("10%") dataset
+*
+*  Picks the events of the decimated dataset and writes the run<N>/decimatedHeadFile<N>.root
+*  files that Dataset reads when asked for a decimated run.
+*
+*  (C) 2023-, The Payload for Ultrahigh Energy Observations (PUEO) Collaboration
+*
+*  This file is part of pueoEvent, the ROOT I/O library for PUEO.
+*
+*  pueoEvent is free software: you can redistribute it and/or modify it under the
+*  terms of the GNU General Public License as published by the Free Software
+*  Foundation, either version 2 of the License, or (at your option) any later
+*  version.
+*
+*  Foobar is distributed in the hope that it will be useful, but WITHOUT ANY
+*  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+*  A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+*
+*  You should have received a copy of the GNU General Public License along with
+*  Foobar. If not, see <https://www.gnu.org/licenses/
+*
+****************************************************************************************/
+
+#ifndef PUEO_DECIMATION_H
+#define PUEO_DECIMATION_H
+
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+namespace pueo
+{
+  namespace decimation
+  {
+    constexpr double kDefaultFraction = 0.1;
+
+    /** Whether an event is in the decimated dataset. Like Dataset::maybeInvertPolarity, it only
+     * depends on the event number (and the seed), so it's the same however the runs are processed
+     * and every reprocessing gives the same decimated dataset. */
+    bool selected(uint32_t eventNumber, double fraction = kDefaultFraction, uint64_t seed = 0);
+
+    struct Config
+    {
+      double fraction = kDefaultFraction;
+      uint64_t seed = 0;
+      bool events = false;            ///< also write run<N>/decimatedEventFile<N>.root from eventFile<N>.root
+      const char * out_dir = nullptr; ///< where the run<N> directories go (default: the data directory)
+    };
+
+    /** Writes run<N>/decimatedHeadFile<N>.root (headerTree, with its eventNumber index) with the
+     * selected headers of the run's head file, in the same order and with the same compression, and
+     * optionally the matching events. Files are written under a temporary name and renamed when
+     * done, so a Dataset never sees half of one. Returns the number of events selected, or -1. */
+    int64_t writeRun(const char * data_dir, int run, const Config & cfg = Config());
+
+    /** writeRun for each of runs (default: every run<N> in data_dir), nthreads at a time.
+     * Returns the number of runs written, or -1 if any failed. */
+    int write(const char * data_dir, const std::vector<int> & runs, const Config & cfg = Config(),
+              int nthreads = 1, std::ostream * log = nullptr);
+  }
+}
+
+#endif
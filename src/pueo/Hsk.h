@@ -27,9 +27,16 @@
 #define PUEO_HSK_H
 
 #include "Rtypes.h"
+#include <string>
+#include <vector>
 #ifdef HAVE_PUEORAWDATA
 #include "pueo/rawdata.h"
 #endif
+
+class TFile;
+class TDirectory;
+class TTree;
+
 namespace pueo 
 {
 namespace hsk 
@@ -66,6 +73,100 @@ public:
   char kind_unit;
   ClassDefNV(Sensor,3);
 };
+
+// Per-sensor metadata, written once per file (in sensorDictTree) by the compact
+// (sensors) conversion instead of once per row.
+class SensorInfo
+{
+public:
+  SensorInfo() {;}
+#ifdef HAVE_PUEORAWDATA
+  SensorInfo(UShort_t id):
+    sensor_id(id),
+    subsys(id < PUEO_MAX_SENSORS ? pueo_sensor_id_get_subsystem(id) : throw "sensor out range"),
+    sens_name(pueo_sensor_id_get_name(id)),
+    typetag(pueo_sensor_id_get_type_tag(id)),
+    kind_unit(pueo_sensor_id_get_kind(id)){;}
+#endif
+  UShort_t sensor_id=0;
+  std::string subsys;
+  std::string sens_name;
+  char typetag=0;
+  char kind_unit=0;
+  ClassDefNV(SensorInfo,1);
+};
+
+// Compact housekeeping row: just the sensor id, the time and the value bits.
+// The type of the value (and the sensor's name etc.) comes from the SensorInfo
+// with the same sensor_id, see SensorDictionary.
+class Reading
+{
+public:
+  Reading() {;}
+#ifdef HAVE_PUEORAWDATA
+  Reading(const pueo_sensors_disk_t *hsk,int whichsensor):
+    sensor_id(hsk->sensors[whichsensor].sensor_id < PUEO_MAX_SENSORS ? hsk->sensors[whichsensor].sensor_id : throw "sensor out range"),
+    time_ms(hsk->sensors[whichsensor].time_ms),
+    time_secs(hsk->sensors[whichsensor].time_secs),
+    raw(hsk->sensors[whichsensor].val.uval){;}
+#endif
+  UShort_t sensor_id=0;
+  UShort_t time_ms=0;
+  UInt_t time_secs=0;
+  UInt_t raw=0; ///< value bits, interpret according to the sensor's typetag
+
+  Float_t fval() const;
+  Int_t ival() const { return (Int_t) raw; }
+  UInt_t uval() const { return raw; }
+
+  /** The value interpreted according to typetag ('f' float, 'i' signed, anything else unsigned) */
+  double value(char typetag) const;
+  double time() const { return time_secs + 1e-3 * time_ms; }
+  ClassDefNV(Reading,1);
+};
+
+// Reader-side access to the sensor dictionary of a compact hsk file.
+// Nothing is read until a name or type is first asked for.
+class SensorDictionary
+{
+public:
+  static constexpr const char * tree_name = "sensorDictTree";
+
+  /** Use the dictionary in dir (or gDirectory if nullptr). The directory must outlive this */
+  SensorDictionary(TDirectory * dir = nullptr);
+
+  /** Open the dictionary in this file */
+  SensorDictionary(const char * file);
+  ~SensorDictionary();
+
+  // owns fFile, so not copyable
+  SensorDictionary(const SensorDictionary &) = delete;
+  SensorDictionary & operator=(const SensorDictionary &) = delete;
+
+  /** Returns nullptr if the sensor is not in the dictionary */
+  const SensorInfo * get(UShort_t sensor_id) const;
+  const char * name(UShort_t sensor_id) const;
+  const char * subsystem(UShort_t sensor_id) const;
+  char typetag(UShort_t sensor_id) const;
+
+  /** Sensor id given subsystem and name, or -1 if not found */
+  int find(const char * subsys, const char * name) const;
+
+  double value(const Reading & r) const;
+
+  /** Expand to the (old, verbose) Sensor format */
+  Sensor expand(const Reading & r) const;
+
+  size_t size() const;
+
+private:
+  void load() const;
+  TFile * fFile = nullptr;
+  TTree * fTree = nullptr;
+  mutable bool fLoaded = false;
+  mutable std::vector<SensorInfo> fInfos;
+  mutable std::vector<int> fIndex; // sensor_id -> index in fInfos (or -1)
+};
 }
 }
 
@@ -0,0 +1,126 @@
+/****************************************************************************************
+*  pueo/RunCatalog.h             PUEO run catalog
+*
+*  Per-flight table of runs (start/end time, event number range, number of entries)
+*  and a flight-wide event number -> (run, entry) index, stored in a small binary file
+*  that is memory-mapped at runtime. Built with pueo-run-catalog, replaces the
+*  generated pueo1-runinfo.h.
+*
+*  (C) 2023-, The Payload for Ultrahigh Energy Observations (PUEO) Collaboration
+*
+*  This file is part of pueoEvent, the ROOT I/O library for PUEO.
+*
+*  pueoEvent is free software: you can redistribute it and/or modify it under the
+*  terms of the GNU General Public License as published by the Free Software
+*  Foundation, either version 2 of the License, or (at your option) any later
+*  version.
+*
+*  Foobar is distributed in the hope that it will be useful, but WITHOUT ANY
+*  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+*  A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+*
+*  You should have received a copy of the GNU General Public License along with
+*  Foobar. If not, see <https://www.gnu.org/licenses/
+*
+****************************************************************************************/
+
+#ifndef PUEO_RUN_CATALOG_H
+#define PUEO_RUN_CATALOG_H
+
+#include <cstdint>
+#include <cstddef>
+
+namespace pueo
+{
+  /** One run in the catalog. This is the on-disk layout (little endian), so don't change it without bumping RunCatalog::kVersion */
+  struct RunCatalogEntry
+  {
+    int32_t run;
+    uint32_t flags;           ///< unused for now
+    int64_t start_time;       ///< first trigger second of the run
+    int64_t end_time;         ///< last trigger second of the run + 1
+    uint32_t first_event;     ///< smallest event number
+    uint32_t last_event;      ///< largest event number
+    uint64_t nentries;        ///< entries in the header tree
+  };
+  static_assert(sizeof(RunCatalogEntry) == 40, "RunCatalogEntry must be packed the same everywhere");
+
+  /** A block of consecutive event numbers at consecutive entries of one run. Also on-disk layout. */
+  struct RunCatalogEventRange
+  {
+    uint32_t first_event;
+    uint32_t first_entry;     ///< header tree entry of first_event
+    uint32_t n;               ///< number of events in the block
+  };
+  static_assert(sizeof(RunCatalogEventRange) == 12, "RunCatalogEventRange must be packed the same everywhere");
+
+  /** A memory-mapped run catalog.
+   *
+   * The file is a 40 byte header ("PUEORCAT", format version, flight, flags, number of runs,
+   * number of event ranges) followed by the RunCatalogEntry's sorted by run, nruns+1 offsets of
+   * each run's first event range and the RunCatalogEventRange's, sorted by event number within
+   * each run. Since event numbers are mostly consecutive within a run, the event index is usually
+   * a handful of ranges per run rather than an entry per event.
+   *
+   * Lookups by time and event number are binary searches, since runs are chronological and event
+   * numbers increase between them. The builder checks that, and if it ever isn't true the lookups
+   * fall back to a linear scan over the runs.
+   */
+  class RunCatalog
+  {
+    public:
+      static constexpr uint32_t kVersion = 2;
+
+      /** Maps a catalog file. Check valid() afterwards */
+      RunCatalog(const char * file);
+      ~RunCatalog();
+      RunCatalog(const RunCatalog &) = delete;
+      RunCatalog & operator=(const RunCatalog &) = delete;
+
+      bool valid() const { return fEntries; }
+      int flight() const { return fFlight; }
+      size_t size() const { return fN; }
+      const RunCatalogEntry & operator[](size_t i) const { return fEntries[i]; }
+      const RunCatalogEntry * begin() const { return fEntries; }
+      const RunCatalogEntry * end() const { return fEntries + fN; }
+
+      /** The entry for a run, or nullptr */
+      const RunCatalogEntry * find(int run) const;
+
+      /** The run going on at time t (unix seconds), or -1 */
+      int runAtTime(double t) const;
+
+      /** The run containing an event number, or -1 */
+      int runWithEvent(uint32_t event_number) const;
+
+      /** Where an event is: fills run and its header tree entry (either can be null).
+       * Unlike runWithEvent, false for event numbers in the gaps of a run. */
+      bool locate(uint32_t event_number, int * run, int64_t * entry = nullptr) const;
+
+      /** The event ranges of the ith run */
+      const RunCatalogEventRange * rangesBegin(size_t i) const { return fRanges + fOffsets[i]; }
+      const RunCatalogEventRange * rangesEnd(size_t i) const { return fRanges + fOffsets[i+1]; }
+      size_t nranges() const { return fNRanges; }
+
+      /** Builds a catalog from data_dir/run<N>/headFile<N>.root (all of them), reading
+       * the header files with nthreads threads. Returns the number of runs, or -1 on failure. */
+      static int build(const char * data_dir, const char * outfile, int flight, int nthreads = 1);
+
+      /** The catalog for a flight: $PUEO_RUN_CATALOG if set, otherwise runcatalog.dat in the
+       * flight's data directory. Opened once and kept, returns nullptr if there isn't one. */
+      static const RunCatalog * forFlight(int flight);
+
+    private:
+      void * fMap = nullptr;
+      size_t fMapSize = 0;
+      const RunCatalogEntry * fEntries = nullptr;
+      size_t fN = 0;
+      const uint64_t * fOffsets = nullptr;
+      const RunCatalogEventRange * fRanges = nullptr;
+      size_t fNRanges = 0;
+      int fFlight = 0;
+      bool fMonotonic = true;
+  };
+}
+
+#endif
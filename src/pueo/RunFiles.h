@@ -0,0 +1,78 @@
+/****************************************************************************************
+*  pueo/RunFiles.h               Going over the run<N> directories of a data directory
+*
+*  Finding the runs of a data directory, writing a file per run in parallel, writing
+*  files so that no one sees half of one, and the command line of the tools that do it.
+*
+*  (C) 2023-, The Payload for Ultrahigh Energy Observations (PUEO) Collaboration
+*
+*  This file is part of pueoEvent, the ROOT I/O library for PUEO.
+*
+*  pueoEvent is free software: you can redistribute it and/or modify it under the
+*  terms of the GNU General Public License as published by the Free Software
+*  Foundation, either version 2 of the License, or (at your option) any later
+*  version.
+*
+*  Foobar is distributed in the hope that it will be useful, but WITHOUT ANY
+*  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+*  A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+*
+*  You should have received a copy of the GNU General Public License along with
+*  Foobar. If not, see <https://www.gnu.org/licenses/
+*
+****************************************************************************************/
+
+#ifndef PUEO_RUN_FILES_H
+#define PUEO_RUN_FILES_H
+
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <vector>
+
+namespace pueo
+{
+  /** What the tools that make a file per run (decimation, summaries, time tables, the run catalog) share */
+  namespace runfiles
+  {
+    /** Appends the N of every run<N> directory in data_dir to runs, sorted. False if data_dir can't be read */
+    bool findRuns(const char * data_dir, std::vector<int> * runs);
+
+    /** Calls fn(run) for each of runs (default: every run<N> in data_dir), nthreads at a time. fn returns
+     * the number of events it wrote, which is logged, or -1 on failure. Returns the number of runs done,
+     * or -1 if any failed. */
+    int forEachRun(const char * data_dir, const std::vector<int> & runs, int nthreads,
+                   const std::function<int64_t(int run)> & fn, std::ostream * log = nullptr);
+
+    /** Has write(tmp) write fname under a temporary name, which is renamed to fname if it returns true,
+     * so that no one ever sees half of it. Returns false (having removed the temporary file) otherwise. */
+    bool writeAtomically(const char * fname, const std::function<bool(const char * tmp)> & write);
+
+    /** The command line pueo-decimate and pueo-summarize share: -j nthreads, -d rootdata,
+     * -o outdir, and the runs as N or first-last */
+    struct ToolArgs
+    {
+      const char * data_dir = nullptr;  ///< default: $PUEO_ROOT_DATA
+      const char * out_dir = nullptr;
+      int nthreads = 0;                 ///< default: the number of cores
+      std::vector<int> runs;            ///< empty for every run in data_dir
+    };
+
+    /** Prints the usage of such a tool, with its own options in the synopsis (extra_opts, e.g.
+     * "[-f fraction] ") and one line each in extra_help, after the shared ones */
+    void toolUsage(const char * name, const char * extra_opts = "", const char * extra_help = "");
+
+    /** Parses args into targs. Anything that isn't a shared option or a run goes to extra(i), which
+     * takes args[i] (advancing i past its value) and returns true, or returns false if it doesn't
+     * know it. Returns false, having called usage() or said what's wrong, if the args are no good
+     * or there is no data directory. */
+    bool parseToolArgs(int nargs, char ** args, ToolArgs * targs, void (*usage)(),
+                       const std::function<bool(int & i)> & extra = nullptr);
+
+    /** Calls write(), which returns the number of runs written or -1, and reports that and how
+     * long it took. Returns the exit code of the tool. */
+    int reportRuns(const std::function<int()> & write);
+  }
+}
+
+#endif
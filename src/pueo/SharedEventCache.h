@@ -0,0 +1,128 @@
+/****************************************************************************************
+*  pueo/SharedEventCache.h             Node-local shared memory cache of decoded events
+*
+*  Lets the processes on a node that read the same runs (event displays, scans, notebooks)
+*  decompress each header and event once between them instead of once each.
+*
+*  (C) 2023-, The Payload for Ultrahigh Energy Observations (PUEO) Collaboration
+*
+*  This file is part of pueoEvent, the ROOT I/O library for PUEO.
+*
+*  pueoEvent is free software: you can redistribute it and/or modify it under the
+*  terms of the GNU General Public License as published by the Free Software
+*  Foundation, either version 2 of the License, or (at your option) any later
+*  version.
+*
+*  Foobar is distributed in the hope that it will be useful, but WITHOUT ANY
+*  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+*  A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+*
+*  You should have received a copy of the GNU General Public License along with
+*  Foobar. If not, see <https://www.gnu.org/licenses/
+*
+****************************************************************************************/
+
+#ifndef PUEO_SHARED_EVENT_CACHE_H
+#define PUEO_SHARED_EVENT_CACHE_H
+
+#include <cstdint>
+#include <cstddef>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace pueo
+{
+  /** A cache of records (Dataset stores RawHeaders and RawEvents, streamed but not compressed)
+   * in a POSIX shared memory segment that every process on the node attaches to.
+   *
+   * Records are keyed by the file they came from (Dataset uses the file's UUID, so reprocessed
+   * files don't get stale records), run, entry and kind. When it's full, the least recently used
+   * records are evicted, chosen LRU-wise from a sample like memcached and redis do, which avoids
+   * keeping a list in order across processes. If there's no room for a record near where the last
+   * one went, the records overlapping the room starting at the chosen one are evicted together.
+   * One process-shared mutex protects it; records are copied in and out while holding it, so no
+   * process ever holds on to a record, and a process dying while holding the mutex just gets the
+   * cache cleared.
+   *
+   * The segment counts the processes attached to it and is removed when the last one detaches
+   * (unless PUEO_SHM_CACHE_KEEP=1), so it doesn't hold on to the node's memory for no one.
+   */
+  class SharedEventCache
+  {
+    public:
+      struct Key
+      {
+        uint64_t file;
+        int64_t entry;
+        int32_t run;
+        int32_t kind;
+      };
+
+      struct Stats
+      {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t insertions = 0;
+        uint64_t evictions = 0;
+        uint64_t records = 0;
+        uint64_t bytes_used = 0;
+        uint64_t capacity = 0;
+        int attached = 0;
+      };
+
+      /** Attaches to the segment name (e.g. /pueo-event-cache), creating it with room for
+       * about bytes of records if it doesn't exist yet. Check valid() afterwards. */
+      SharedEventCache(const char * name, size_t bytes);
+      ~SharedEventCache();
+      SharedEventCache(const SharedEventCache &) = delete;
+      SharedEventCache & operator=(const SharedEventCache &) = delete;
+
+      bool valid() const { return fSegment; }
+
+      /** Copies the record into out, false if it isn't there */
+      bool get(const Key & key, std::vector<char> & out);
+
+      /** Adds a record, evicting others as needed. False if it didn't fit (records over
+       * an eighth of the cache aren't kept) */
+      bool put(const Key & key, const void * data, size_t n);
+
+      /** Drops every record */
+      void clear();
+
+      Stats stats() const;
+      void print(std::ostream & os = std::cout) const;
+
+      /** The node's cache: $PUEO_SHM_CACHE_NAME (default /pueo-event-cache-<uid>) with
+       * $PUEO_SHM_CACHE_MB of room. Attached on first use, nullptr if PUEO_SHM_CACHE_MB
+       * isn't set or it couldn't be. */
+      static SharedEventCache * instance();
+
+    private:
+      struct Segment;
+      struct Slot;
+      class Lock;
+
+      Segment * fSegment = nullptr;
+      size_t fMapSize = 0;
+      std::string fName;
+      Slot * fSlots = nullptr;
+      uint64_t * fBitmap = nullptr;
+      uint32_t * fOwners = nullptr; // the slot of the record using each unit
+      char * fData = nullptr;
+
+      Slot * find(const Key & key) const;
+      void erase(Slot * s);
+      void setOwner(const Slot * s);
+      Slot * sampleVictim();
+      bool evictOne();
+      int64_t evictRange(uint64_t units);
+      int64_t allocate(uint64_t units, uint64_t max_scan);
+      void release(uint64_t first, uint64_t units);
+      void reset();
+      void attach();
+      void detach();
+  };
+}
+
+#endif
@@ -0,0 +1,139 @@
+/****************************************************************************************
+*  pueo/SyntheticFlight.h             Synthetic PUEO_ROOT_DATA for testing at scale
+*
+*  Writes a whole flight's worth of ROOT files with the library's own classes, with a
+*  realistic clock and trigger model, so Dataset, cuts, playlists and the time table
+*  builder can be exercised (and benchmarked) without flight data.
+*
+*  (C) 2023-, The Payload for Ultrahigh Energy Observations (PUEO) Collaboration
+*
+*  This file is part of pueoEvent, the ROOT I/O library for PUEO.
+*
+*  pueoEvent is free software: you can redistribute it and/or modify it under the
+*  terms of the GNU General Public License as published by the Free Software
+*  Foundation, either version 2 of the License, or (at your option) any later
+*  version.
+*
+*  Foobar is distributed in the hope that it will be useful, but WITHOUT ANY
+*  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+*  A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+*
+*  You should have received a copy of the GNU General Public License along with
+*  Foobar. If not, see <https://www.gnu.org/licenses/
+*
+****************************************************************************************/
+
+#ifndef PUEO_SYNTHETIC_FLIGHT_H
+#define PUEO_SYNTHETIC_FLIGHT_H
+
+#include "pueo/Timing.h"
+#include <cstdint>
+#include <iostream>
+#include <string>
+
+namespace pueo
+{
+  namespace synthetic
+  {
+    /** What to generate. The defaults are a small flight (a few GB with waveforms) that
+     * still has a bit of everything the time table builder has to deal with. */
+    struct FlightConfig
+    {
+      int first_run = timing::FIRST_AMP_RUN;
+      int nruns = 10;
+      int32_t start_time = timing::LAUNCH_SECOND + 3600; ///< true start of the first run
+      double run_length = 600;      ///< [s]
+      double run_gap = 10;          ///< dead time between runs [s]
+      uint32_t first_event = 1;
+
+      /* trigger mix, in Hz (Poisson) except for the PPS trigger which is once a second */
+      double rf_rate = 5;
+      double soft_rate = 1;
+      bool pps_trigger = true;
+      double timemark_interval = 10;///< mean seconds between timemarked (external) triggers, 0 for none
+
+      /* the TURF clock: nominally timing::NOMINAL_CLOCK_FREQ */
+      double clock_offset = 40;     ///< how far off nominal the clock starts [Hz]
+      double clock_walk = 2;        ///< random walk of the clock rate [Hz per second]
+
+      /* things that go wrong */
+      double missing_second_prob = 1e-3;  ///< chance a second has no events at all
+      double year1970_run_prob = 0.1;     ///< chance a run's event seconds count from 0 instead of the epoch
+
+      /* the rest of the files */
+      bool waveforms = true;        ///< noise in the waveforms, otherwise zeros (which compress to nothing)
+      float noise_rms = 20;         ///< [adu]
+      double attitude_rate = 5;     ///< [Hz]
+      double hsk_interval = 10;     ///< [s], all the sensors each time
+      int nsensors = 32;
+      double daqhsk_interval = 1;   ///< [s]
+
+      unsigned seed = 1;
+    };
+
+    /** What was written */
+    struct FlightSummary
+    {
+      int nruns = 0;
+      uint64_t nevents = 0;
+      uint64_t ntimemarks = 0;
+      uint64_t missing_seconds = 0;
+      int year1970_runs = 0;
+    };
+
+    /** Writes a synthetic flight to data_dir, in the layout Dataset and the tools read:
+     *
+     *   run<N>/headFile<N>.root    headerTree, with corrected_trigger_time etc. set to the truth
+     *   run<N>/eventFile<N>.root   eventTree (noise or zero waveforms)
+     *   run<N>/gpsFile<N>.root     attitudeTree
+     *   run<N>/hsk.root            hskTree
+     *   run<N>/daqhsk.root         daqhskTree
+     *   timemark.root              timemarkTree of the whole flight (as pueo-time-table takes it)
+     *
+     * Headers have triggerTime/lastPPS/trigTime from a drifting 32-bit clock, so a time table
+     * built from the flight (pueo-time-table) should reproduce corrected_trigger_time.
+     * Returns 0, or -1 if something couldn't be written. The same config and seed always give
+     * the same flight. */
+    int writeFlight(const char * data_dir, const FlightConfig & cfg, FlightSummary * summary = nullptr,
+                    std::ostream * log = nullptr);
+
+    /** A working directory for the tools and tests. Unless dir is given, a new one is made with
+     * mkdtemp under $TMPDIR (named <prefix>.XXXXXX), and only such a directory is removed, with
+     * everything in it, when this goes away (unless keep() was called). A given dir is created if
+     * needed but never removed, what was written in it is up to the caller. Check ok(). */
+    class ScratchDir
+    {
+      public:
+        ScratchDir(const char * prefix, const std::string & dir = "");
+        ~ScratchDir();
+        ScratchDir(const ScratchDir &) = delete;
+        ScratchDir & operator=(const ScratchDir &) = delete;
+
+        bool ok() const { return !fPath.empty(); }
+        const std::string & path() const { return fPath; }
+        /** True if it was made here, and so will be removed */
+        bool owned() const { return fOwned; }
+        void keep(bool k = true) { fKeep = k; }
+
+      private:
+        std::string fPath;
+        bool fOwned = false;
+        bool fKeep = false;
+    };
+
+    /** A synthetic flight in a ScratchDir (a new one unless dir is given), with PUEO_ROOT_DATA
+     * pointing at it, as the tests and benchmarks use. Check written(). */
+    class ScratchFlight : public ScratchDir
+    {
+      public:
+        ScratchFlight(const char * prefix, const FlightConfig & cfg, std::ostream * log = &std::cout,
+                      const std::string & dir = "");
+        bool written() const { return fWritten; }
+
+      private:
+        bool fWritten = false;
+    };
+  }
+}
+
+#endif
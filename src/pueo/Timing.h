@@ -0,0 +1,251 @@
+/****************************************************************************************
+*  pueo/Timing.h             PUEO trigger time correction
+*  
+*  Building time tables (the PPS clock correction, see pueo-time-table) and applying
+*  them to RawHeaders.
+* 
+*  (C) 2023-, The Payload for Ultrahigh Energy Observations (PUEO) Collaboration
+* 
+*  This file is part of pueoEvent, the ROOT I/O library for PUEO. 
+* 
+*  pueoEvent is free software: you can redistribute it and/or modify it under the
+*  terms of the GNU General Public License as published by the Free Software
+*  Foundation, either version 2 of the License, or (at your option) any later
+*  version.
+* 
+*  Foobar is distributed in the hope that it will be useful, but WITHOUT ANY
+*  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+*  A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+* 
+*  You should have received a copy of the GNU General Public License along with
+*  Foobar. If not, see <https://www.gnu.org/licenses/
+*
+****************************************************************************************/ 
+
+#ifndef PUEO_TIMING_H
+#define PUEO_TIMING_H
+
+#include "Rtypes.h"
+#include "pueo/Timemark.h"
+#include <cstdint>
+#include <map>
+#include <vector>
+#include <utility>
+#include <tuple>
+#include <iostream>
+
+namespace pueo
+{
+  class RawHeader;
+
+  namespace timing
+  {
+    constexpr int32_t NOMINAL_CLOCK_FREQ = 125000000;
+    constexpr int32_t FIRST_AMP_RUN = 783; ///< time tables aren't made for runs before this one
+    constexpr int32_t LAUNCH_SECOND = 1766163240;
+
+    /** The part of a time table row needed to correct a header */
+    struct TimeTableRow
+    {
+      int32_t corrected_event_second = 0;
+      double avg_relative_delta = 0;
+      double corrected_pps = 0;
+    };
+
+    /** A run's time table, keyed by the (uncorrected) event second, i.e. RawHeader::triggerTime.
+     * Seconds in a run are contiguous (the builder inserts missing ones), so it's stored densely. */
+    class TimeTable
+    {
+      public:
+        TimeTable() {}
+
+        /** Loads time_table_tree from file */
+        TimeTable(const char * file) { load(file); }
+
+        /** Loads time_table_tree from file (anything TFile::Open takes), returns false if it couldn't */
+        bool load(const char * file);
+
+        /** True if the table was loaded and has corrected seconds (the builder writes 0 when it couldn't find any) */
+        bool valid() const { return fValid; }
+
+        /** The row for an event second, or nullptr */
+        const TimeTableRow * find(int32_t event_second) const
+        {
+          int64_t i = (int64_t) event_second - fFirst;
+          return i >= 0 && i < (int64_t) fRows.size() && fHave[i] ? &fRows[i] : nullptr;
+        }
+
+        /** Fills clock_frequency, corrected_pps and corrected_trigger_time of h.
+         * Returns false (leaving h alone) if the table is invalid or has no row for h's second. */
+        bool correct(RawHeader & h) const;
+
+        size_t size() const { return fN; }
+
+      private:
+        int32_t fFirst = 0;
+        std::vector<TimeTableRow> fRows;
+        std::vector<char> fHave;
+        size_t fN = 0;
+        bool fValid = false;
+    };
+
+
+    /** Error and warning bits returned by the time table builder */
+    enum err_code
+    {
+      ERR_MoreThanOneRun       = 1<<0, ///< fatal, more than one run present in the header file
+      ERR_PreAmpRun            = 1<<1, ///< fatal, because we are just going to ignore these
+      ERR_Year1970             = 1<<2, ///< should be recoverable
+      ERR_TimeTableTooShort    = 1<<3, ///< fatal, time tables with only 1 or 2 seconds can't be processed
+      ERR_MissingSecond        = 1<<4, ///< recoverable
+      ERR_LargeDelta           = 1<<5, ///< recoverable
+      ERR_EmptyTable           = 1<<6, ///< fatal but probably won't be reached
+      ERR_NoStableRegion       = 1<<7, ///< recoverable
+      ERR_NoNearbyTimemark     = 1<<8, ///< no timestamped event near the event's readout time, should be recoverable
+      ERR_NoMatchingSubsecond  = 1<<9, ///< can't find the timestamped event in the header tree
+      ERR_NoTimemarkAtAll      = 1<<10,///< can't find a single timestamped event in the run
+      ERR_NotIdentical         = 1<<11,///< corrected event second and the original are not identical
+      ERR_NotContiguous        = 1<<12,///< corrected event seconds are not contiguous
+      ERR_NoHeaders            = 1<<13 ///< fatal, couldn't read the header file
+    };
+
+    /** One second of a run while its time table is built.
+     * Nominally, delta := (next_pps - this_pps) should be about 125E6 (with wraparound),
+     * relative_delta is (delta - 125E6). */
+    struct SecondRow
+    {
+      uint32_t run = 0;                ///< run number
+      int32_t  corrected_sec = 0;      ///< corrected event second
+      int32_t  readout_time_sec = 0;   ///< CPU readout time, not necessarily the same as event second
+      uint32_t this_pps = 0;           ///< value of the sysclk counter of the current second
+      uint32_t next_pps = 0;           ///< value of the sysclk counter of the next second
+      int32_t  relative_delta = 0;     ///< (next_pps - this_pps) - 125E6
+      double   avg_relative_delta = 0; ///< moving average of relative_delta
+      double   corrected_pps = 0;      ///< this_pps corrected with avg_relative_delta
+      bool     missing = false;        ///< the second was missing and has been inserted
+      bool     invalid_delta = false;  ///< relative_delta can't be computed
+      bool     is_anchor_row = false;  ///< corrected_pps == this_pps here, extrapolated from here
+      bool     has_timestamp = false;  ///< corrected with a timemark
+    };
+
+    /** A time table being built, keyed by event second */
+    typedef std::map<int32_t, SecondRow> BuildTable;
+
+    /** The header fields the builder needs */
+    struct HeaderTimes
+    {
+      uint32_t run;
+      int32_t triggerTime;
+      int32_t readoutTime;
+      uint32_t lastPPS;
+      uint32_t trigTime;
+    };
+
+    /** When an event triggered, for matching to timemarks */
+    struct EventTime
+    {
+      uint32_t run;
+      uint32_t event_number;
+      int64_t ns; ///< corrected trigger time, in ns since the epoch
+    };
+
+    /** All the timemarks of a flight, loaded once into a flat array sorted by rising edge time,
+     * with O(log n) nearest and range queries. It's read-only after construction (other than match()),
+     * so one can be shared by builders running in several threads. */
+    class TimemarkIndex
+    {
+      public:
+        /** Loads timemarkTree from file */
+        TimemarkIndex(const char * file);
+
+        /** Indexes timemarks already in memory, in file order */
+        TimemarkIndex(const std::vector<Timemark> & marks) { build(marks); }
+
+        bool valid() const { return fMarks.size(); }
+        size_t size() const { return fMarks.size(); }
+
+        /** All the timemarks, sorted by rising */
+        const std::vector<Timemark> & marks() const { return fMarks; }
+
+        /** Index of the first timemark with rising at or after t */
+        size_t lowerBound(const TTimeStamp & t) const;
+
+        /** The timemark with rising closest to t, at most max_dist_ns away, or nullptr */
+        const Timemark * nearestRising(const TTimeStamp & t, int64_t max_dist_ns) const;
+
+        /** The timemarks with rising in [from, to), as [first, last) */
+        std::pair<const Timemark *, const Timemark *> range(const TTimeStamp & from, const TTimeStamp & to) const;
+
+        /** The timemark with readout second closest to readout_sec, at most max_dist away, or nullptr.
+         * Ties go to the later one in the file. This is what the time table builder uses, since it
+         * doesn't know the trigger time yet. */
+        const Timemark * nearest(int32_t readout_sec, int32_t max_dist = 5) const;
+
+        /** Fills run and event_number of the timemarks whose rising edge is within tolerance_ns of an event,
+         * (the nearest one if there's more than one) in one merge pass over both. events needn't be sorted,
+         * and can be a whole flight. Returns the number of timemarks matched. */
+        size_t match(std::vector<EventTime> events, int64_t tolerance_ns = 200);
+
+        /** Writes the timemarks (in rising order) to timemarkTree in file */
+        bool save(const char * file) const;
+
+      private:
+        void build(const std::vector<Timemark> & marks);
+
+        std::vector<Timemark> fMarks; // sorted by rising
+        std::vector<int64_t> fRising; // rising of fMarks in ns, for searching
+        std::vector<std::tuple<int64_t, size_t, size_t>> fByReadout; // (readout second, file order, index into fMarks), sorted
+    };
+
+    /** Reads the corrected trigger times of a headFile, correcting them with table first if given.
+     * Returns 0 or ERR_NoHeaders */
+    int32_t loadEventTimes(const char * header_file, std::vector<EventTime> * events, const TimeTable * table = nullptr);
+
+    /** Reads the header fields needed from a headFile, returns 0 or ERR_NoHeaders */
+    int32_t loadHeaderTimes(const char * header_file, std::vector<HeaderTimes> * headers);
+
+    /** Fills table with a row per event second (inserting missing seconds) and computes relative
+     * deltas. Rows whose delta can't be computed are moved to invalid_seconds.
+     * Returns 0, a fatal error (e.g. ERR_TimeTableTooShort) or warnings (e.g. ERR_MissingSecond) */
+    int32_t prepareTable(const std::vector<HeaderTimes> & headers, uint32_t * run, BuildTable * table,
+                         BuildTable * invalid_seconds, std::ostream & log = std::cerr);
+
+    /** Computes avg_relative_delta for each second from its neighbours.
+     * Returns ERR_TimeTableTooShort if the table is short compared to half_width */
+    int32_t simpleMovingAverage(BuildTable * table, size_t half_width = 8);
+
+    /** Finds the mid-point of a stable period, where delta ≈ avg_relative_delta for every second.
+     * anchor_point is the first second if there isn't one (returning ERR_NoStableRegion). */
+    int32_t findStableRegionMidPoint(BuildTable * table, BuildTable::iterator * anchor_point);
+
+    /** Puts the invalid seconds back, with avg_relative_delta from their neighbours */
+    void insertInvalidSecondsBack(BuildTable * table, BuildTable * invalid_seconds);
+
+    /** Computes corrected_pps for every second by extrapolating from anchor_point with avg_relative_delta */
+    void extrapolatePPS(BuildTable * table, const BuildTable::iterator & anchor_point);
+
+    /** Returns ERR_Year1970 if any event second is before launch (some runs started from the epoch) */
+    int32_t checkEventSeconds(const BuildTable * table);
+
+    /** Tries to correct the event second of row with a timemark near its readout time. row may be moved
+     * to the row actually corrected. headers must be sorted by readoutTime. */
+    int32_t correctOneEventSecond(BuildTable * table, BuildTable::iterator * row,
+                                  const std::vector<HeaderTimes> & headers, const TimemarkIndex & timemarks);
+
+    /** After at least one row has been corrected, corrects all the others from it */
+    void correctAllEventSeconds(BuildTable * table, int32_t first_corrected);
+
+    void printTable(const BuildTable * table, std::ostream & stream = std::cout, bool color = true);
+
+    /** Writes time_table_tree (what TimeTable reads) */
+    bool saveTable(const BuildTable * table, const char * file);
+
+    /** Builds the time table of the run in header_file, writing time_table.root, time_table.txt and
+     * time_table_color.txt into output_dir if not null. Messages go to log.
+     * Returns 0 on success, otherwise the fatal error code. */
+    int32_t buildTimeTable(const char * header_file, const TimemarkIndex & timemarks,
+                           const char * output_dir = nullptr, std::ostream & log = std::cerr);
+  }
+}
+
+#endif
@@ -0,0 +1,293 @@
+// pueoEvent-bench: benchmarks of the library's hot paths
+//
+// Writes a one-run synthetic flight (see pueo/SyntheticFlight.h) to a working
+// directory, points PUEO_ROOT_DATA at it, and times Dataset::loadRun, sequential
+// next()+useful(), random getEvent, setCut, UsefulEvent construction, makeGraph,
+// GeomTool channel mapping lookups and geodetic conversions. No flight data needed, only the geometry from
+// pueo-data.
+//
+// Each benchmark is repeated and the min and median time per operation are
+// reported. With -o, the results are also written as JSON, to compare between
+// releases (the bench target in CMakeLists.txt writes bench.json in the build
+// directory).
+
+#include "pueo/Dataset.h"
+#include "pueo/UsefulEvent.h"
+#include "pueo/RawEvent.h"
+#include "pueo/RawHeader.h"
+#include "pueo/GeomTool.h"
+#include "pueo/Version.h"
+#include "pueo/SyntheticFlight.h"
+
+#include "TCut.h"
+#include "TGraph.h"
+#include "TROOT.h"
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <random>
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <functional>
+#include <cmath>
+#include <string.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+
+struct BenchOpts
+{
+  std::string workdir = "";
+  int nevents = 250;
+  int reps = 5;
+  unsigned seed = 1234;
+  bool keep = false;
+  const char * filter = nullptr;
+  const char * json = nullptr;
+};
+
+void usage()
+{
+  std::cout << "Usage: pueoEvent-bench [-w workdir] [-n nevents] [-r reps] [-S seed] [-f filter] [-k] [-o out.json]    \n"
+               "   -w   working directory for the synthetic run (default: a fresh directory under $TMPDIR)            \n"
+               "   -n   about how many events in the synthetic run (default: 250)                                     \n"
+               "   -r   repetitions of each benchmark (default: 5)                                                    \n"
+               "   -S   random seed (default: 1234)                                                                   \n"
+               "   -f   only run benchmarks whose name contains this                                                  \n"
+               "   -k   keep the working directory afterwards (with -w, the run written to it)                        \n"
+               "   -o   also write results as JSON to this file                                                       \n"
+    << std::endl;
+}
+
+static const int kRun = 1000;
+static const uint32_t kFirstEvent = 100000;
+
+
+struct BenchResult
+{
+  std::string name;
+  long iterations = 0;
+  std::vector<double> ns_per_op;
+
+  double min() const { return *std::min_element(ns_per_op.begin(), ns_per_op.end()); }
+  double median() const
+  {
+    std::vector<double> v = ns_per_op;
+    std::sort(v.begin(), v.end());
+    return v.size() % 2 ? v[v.size()/2] : (v[v.size()/2-1] + v[v.size()/2]) / 2;
+  }
+};
+
+static std::vector<BenchResult> results;
+static volatile double sink; // keeps the compiler from dropping what we time
+
+/** Times op(i) for i in [0, iterations), reps times. setup, if given, runs untimed before each repetition. */
+static void bench(const BenchOpts & opts, const char * name, long iterations,
+                  const std::function<void(long)> & op, const std::function<void()> & setup = nullptr)
+{
+  if (opts.filter && !strstr(name, opts.filter)) return;
+
+  BenchResult res;
+  res.name = name;
+  res.iterations = iterations;
+  for (int rep = 0; rep < opts.reps; rep++)
+  {
+    if (setup) setup();
+    auto start = std::chrono::steady_clock::now();
+    for (long i = 0; i < iterations; i++) op(i);
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    res.ns_per_op.push_back(secs * 1e9 / iterations);
+  }
+
+  std::cout << std::setw(28) << std::left << name << std::right << std::setw(10) << iterations << " ops "
+            << std::setw(14) << std::fixed << std::setprecision(1) << res.min() << " ns/op (min) "
+            << std::setw(14) << res.median() << " ns/op (median)" << std::endl;
+  results.push_back(res);
+}
+
+static long maxRssKb()
+{
+  struct rusage usage;
+  return getrusage(RUSAGE_SELF, &usage) ? 0 : usage.ru_maxrss;
+}
+
+static bool writeJson(const char * file, const BenchOpts & opts)
+{
+  std::ofstream out(file);
+  if (!out)
+  {
+    std::cerr << "Couldn't open " << file << std::endl;
+    return false;
+  }
+
+  out << std::setprecision(6) << "{\n"
+      << "  \"suite\": \"pueoEvent-bench\",\n"
+      << "  \"pueo_version\": " << pueo::version::get() << ",\n"
+      << "  \"root_version\": \"" << gROOT->GetVersion() << "\",\n"
+      << "  \"nevents\": " << opts.nevents << ",\n"
+      << "  \"repetitions\": " << opts.reps << ",\n"
+      << "  \"seed\": " << opts.seed << ",\n"
+      << "  \"max_rss_kb\": " << maxRssKb() << ",\n"
+      << "  \"results\": [\n";
+  for (size_t i = 0; i < results.size(); i++)
+  {
+    const BenchResult & r = results[i];
+    out << "    { \"name\": \"" << r.name << "\", \"iterations\": " << r.iterations
+        << ", \"ns_per_op_min\": " << r.min() << ", \"ns_per_op_median\": " << r.median()
+        << ", \"ops_per_s\": " << 1e9 / r.median() << " }" << (i + 1 < results.size() ? "," : "") << "\n";
+  }
+  out << "  ]\n}" << std::endl;
+  return true;
+}
+
+int main(int nargs, char ** args)
+{
+  BenchOpts opts;
+
+#define CHECK_NOT_LAST if (i == nargs -1) { usage(); return 1; }
+  for (int i = 1; i < nargs; i++)
+  {
+    if (!strcmp(args[i],"-k")) opts.keep = true;
+    else if (!strcmp(args[i],"-w")) { CHECK_NOT_LAST opts.workdir = args[++i]; }
+    else if (!strcmp(args[i],"-n")) { CHECK_NOT_LAST opts.nevents = std::max(1, atoi(args[++i])); }
+    else if (!strcmp(args[i],"-r")) { CHECK_NOT_LAST opts.reps = std::max(1, atoi(args[++i])); }
+    else if (!strcmp(args[i],"-S")) { CHECK_NOT_LAST opts.seed = strtoul(args[++i], 0, 10); }
+    else if (!strcmp(args[i],"-f")) { CHECK_NOT_LAST opts.filter = args[++i]; }
+    else if (!strcmp(args[i],"-o")) { CHECK_NOT_LAST opts.json = args[++i]; }
+    else
+    {
+      usage();
+      return 1;
+    }
+  }
+
+  /* The synthetic run: about 100 Hz of RF triggers with noise waveforms, so -n events take
+   * -n/100 seconds. Written to a fresh directory that goes away afterwards, or to -w where
+   * only what we wrote is removed afterwards. */
+  pueo::synthetic::FlightConfig cfg;
+  cfg.first_run = kRun;
+  cfg.nruns = 1;
+  cfg.first_event = kFirstEvent;
+  cfg.rf_rate = 100;
+  cfg.soft_rate = 0;
+  cfg.run_length = opts.nevents / cfg.rf_rate;
+  cfg.missing_second_prob = 0;
+  cfg.year1970_run_prob = 0;
+  cfg.seed = opts.seed;
+
+  std::string rundir = opts.workdir + "/run" + std::to_string(kRun);
+  std::string timemarks = opts.workdir + "/timemark.root";
+  bool made_rundir = opts.workdir.empty() || !std::filesystem::exists(rundir);
+  bool made_timemarks = opts.workdir.empty() || !std::filesystem::exists(timemarks);
+
+  pueo::synthetic::ScratchFlight flight("pueoEvent-bench", cfg, &std::cout, opts.workdir);
+  if (!flight.written()) return 1;
+  flight.keep(opts.keep);
+  rundir = flight.path() + "/run" + std::to_string(kRun);
+  timemarks = flight.path() + "/timemark.root";
+
+  // the Dataset benchmarks
+  {
+    pueo::Dataset d(kRun);
+    if (!d.fRunLoaded)
+    {
+      std::cerr << "Couldn't load the synthetic run" << std::endl;
+      return 1;
+    }
+    opts.nevents = d.N();
+
+    bench(opts, "Dataset::loadRun", 5, [&](long) { d.loadRun(kRun); });
+
+    bench(opts, "Dataset::next+useful", d.N(), [&](long i)
+    {
+      if (i) d.next();
+      else d.first();
+      sink = d.useful()->volts[0][0];
+    });
+
+    std::mt19937 rng(opts.seed);
+    std::uniform_int_distribution<int> pick(0, d.N() - 1);
+    std::vector<int> events(1000);
+    for (int & ev : events) ev = kFirstEvent + pick(rng);
+    bench(opts, "Dataset::getEvent(random)", events.size(), [&](long i)
+    {
+      d.getEvent(events[i]);
+      sink = d.header()->triggerTime;
+    });
+
+    bench(opts, "Dataset::setCut", 5, [&](long) { sink = d.setCut(TCut("eventNumber % 3 == 0")); });
+  }
+
+  // everything else works on one event in memory
+  pueo::RawHeader header;
+  pueo::RawEvent * raw = new pueo::RawEvent;
+  {
+    std::mt19937 rng(opts.seed);
+    std::normal_distribution<float> noise(0, 20);
+    for (auto & chan : raw->data)
+    {
+      for (auto & s : chan) s = (Short_t) noise(rng);
+    }
+  }
+
+  pueo::UsefulEvent * useful = nullptr;
+  bench(opts, "UsefulEvent(raw, header)", 100, [&](long)
+  {
+    delete useful;
+    useful = new pueo::UsefulEvent(*raw, header);
+  });
+  if (!useful) useful = new pueo::UsefulEvent(*raw, header);
+
+  bench(opts, "UsefulEvent::makeGraph", pueo::k::NUM_RF_CHANNELS, [&](long i)
+  {
+    TGraph * g = useful->makeGraph((size_t) i);
+    sink = g->GetN();
+    delete g;
+  });
+
+  const pueo::GeomTool & geom = pueo::GeomTool::Instance();
+  bench(opts, "GeomTool mapping", 100000, [&](long i)
+  {
+    int ant;
+    pueo::pol::pol_t pol;
+    geom.getAntPolFromChanIndex(i % pueo::k::NUM_RF_CHANNELS, ant, pol);
+    sink = geom.getChanIndexFromAntPol(ant, pol) + geom.getPhiFromAnt(ant) + geom.getRingFromAnt(ant);
+  });
+
+  bench(opts, "geodetic round trip", 100000, [&](long i)
+  {
+    double p[3];
+    double lat, lon, alt;
+    pueo::GeomTool::getCartesianCoords(-77.86 + (i % 1000) * 1e-3, 167.2 + (i % 360), 37000, p);
+    pueo::GeomTool::getLatLonAltFromCartesian(p, lat, lon, alt);
+    sink = lat + lon + alt;
+  });
+
+  delete useful;
+  delete raw;
+
+  std::cout << "Peak RSS: " << maxRssKb() << " KB" << std::endl;
+
+  int ret = 0;
+  if (opts.json && !writeJson(opts.json, opts)) ret = 1;
+
+  if (!opts.keep && !flight.owned())
+  {
+    std::error_code ec;
+    if (made_rundir) std::filesystem::remove_all(rundir, ec);
+    else
+    {
+      for (const std::string & name : {"headFile" + std::to_string(kRun), "eventFile" + std::to_string(kRun),
+                                       "gpsFile" + std::to_string(kRun), std::string("hsk"), std::string("daqhsk")})
+      {
+        std::filesystem::remove(rundir + "/" + name + ".root", ec);
+      }
+    }
+    if (made_timemarks) std::filesystem::remove(timemarks, ec);
+  }
+
+  return ret;
+}